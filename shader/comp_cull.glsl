@@ -0,0 +1,80 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//frustum culls the indirect commands & compacts the survivors per material bucket
+layout(local_size_x = 64) in;
+
+layout(binding = 0) uniform UniformMatrix {
+    mat4 view;
+    mat4 proj;
+} matrix;
+
+struct DrawData {
+    mat4 model;
+    uint materialIndex;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, binding = 1) readonly buffer DrawDataBuffer {
+    DrawData draw[];
+} drawData;
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, binding = 2) readonly buffer InputCommand {
+    DrawCommand command[];
+} inputCommand;
+
+struct CullData {
+    vec4 sphere;
+    uint bucket;
+    uint bucketFirst;
+};
+
+layout(std430, binding = 3) readonly buffer CullDataBuffer {
+    CullData cull[];
+} cullData;
+
+layout(std430, binding = 4) writeonly buffer OutputCommand {
+    DrawCommand command[];
+} outputCommand;
+
+layout(std430, binding = 5) buffer DrawCount {
+    uint count[];
+} drawCount;
+
+layout(push_constant) uniform CullConstant {
+    uint commandCount;
+} pc;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= pc.commandCount) {
+        return;
+    }
+    DrawCommand command = inputCommand.command[index];
+    CullData data = cullData.cull[index];
+    mat4 model = drawData.draw[command.firstInstance].model;
+    vec3 center = (model * vec4(data.sphere.xyz, 1.0)).xyz;
+    float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+    float radius = data.sphere.w * scale;
+
+    //rows of the combined matrix, same plane order as Culling.cpp
+    mat4 m = transpose(matrix.proj * matrix.view);
+    vec4 plane[6] = vec4[](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]);
+    for (int i = 0; i < 6; ++i) {
+        vec4 p = plane[i] / length(plane[i].xyz);
+        if (dot(p.xyz, center) + p.w < -radius) {
+            return;
+        }
+    }
+    uint slot = atomicAdd(drawCount.count[data.bucket], 1);
+    outputCommand.command[data.bucketFirst + slot] = command;
+}
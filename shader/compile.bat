@@ -1,9 +1,14 @@
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=vertex vert_min.glsl -o vert_min.spv
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=vertex vert_simple.glsl -o vert_simple.spv
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=vertex vert_lighting.glsl -o vert_lighting.spv
+C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=vertex vert_lighting_packed.glsl -o vert_lighting_packed.spv
+C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=vertex vert_depth.glsl -o vert_depth.spv
+C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=vertex vert_depth_packed.glsl -o vert_depth_packed.spv
 
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=fragment frag_color.glsl -o frag_color.spv
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=fragment frag_simple.glsl -o frag_simple.spv
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=fragment frag_pbr.glsl -o frag_pbr.spv
 C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=fragment frag_pbr_test.glsl -o frag_pbr_test.spv
+
+C:\VulkanSDK\1.2.135.0\Bin\glslc.exe -fshader-stage=compute comp_cull.glsl -o comp_cull.spv
 pause
\ No newline at end of file
@@ -2,6 +2,7 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 1) uniform UniformLight {
+    vec4 debugOption;
     vec4 cameraPos;
 	vec4 lightPos;
 	vec4 lightData;
@@ -13,9 +14,19 @@ layout(location = 2) in vec3 position;
 layout(location = 3) in vec3 normal;
 
 layout(set = 0, binding = 2) uniform sampler texSampler;
+//binding = texture slot + 1, slots the material lacks are bound to a placeholder
 layout(set = 1, binding = 1) uniform texture2D baseTex;
 layout(set = 1, binding = 2) uniform texture2D metallicRoughnessTex;
 layout(set = 1, binding = 3) uniform texture2D normalMap;
+layout(set = 1, binding = 4) uniform texture2D emissiveTex;
+layout(set = 1, binding = 5) uniform texture2D occlusionTex;
+
+//texture slots present in the material, set per pipeline variant so absent maps are compiled out
+layout(constant_id = 0) const bool hasBaseColor = true;
+layout(constant_id = 1) const bool hasMetallicRoughness = true;
+layout(constant_id = 2) const bool hasNormalMap = false;
+layout(constant_id = 3) const bool hasEmissive = false;
+layout(constant_id = 4) const bool hasOcclusion = false;
 
 layout(location = 0) out vec4 outColor;
 
@@ -112,16 +123,51 @@ vec3 BRDF(PBR_Data data) {
     return (specular + kD * BRDF_Diffuse(data)) * ndotl;
 }
 
+//no vertex tangents, the frame comes from the screen space derivatives of position & uv
+vec3 perturbNormal(vec3 n, vec3 mapNormal) {
+    vec3 dp1 = dFdx(position);
+    vec3 dp2 = dFdy(position);
+    vec2 duv1 = dFdx(texCoord);
+    vec2 duv2 = dFdy(texCoord);
+    vec3 dp2perp = cross(dp2, n);
+    vec3 dp1perp = cross(n, dp1);
+    vec3 t = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 b = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(t, t), dot(b, b)));
+    return normalize(mat3(t * invmax, b * invmax, n) * mapNormal);
+}
+
 void main() {
     PBR_Data pbr_data;
-	vec4 baseColor = texture(sampler2D(baseTex, texSampler), texCoord);
-    vec4 metallicRoughness = pow(texture(sampler2D(metallicRoughnessTex, texSampler), texCoord), vec4(1.0/2.2));
-    pbr_data.metalness = metallicRoughness.b;
-    pbr_data.roughness = metallicRoughness.g;
+    vec4 baseColor = vec4(1.0);
+    if (hasBaseColor) {
+        baseColor = texture(sampler2D(baseTex, texSampler), texCoord);
+    }
+    pbr_data.metalness = lighting.debugOption.y;
+    pbr_data.roughness = lighting.debugOption.z;
+    if (hasMetallicRoughness) {
+        //data maps are unorm views, sampled as stored
+        vec4 metallicRoughness = texture(sampler2D(metallicRoughnessTex, texSampler), texCoord);
+        pbr_data.metalness = metallicRoughness.b;
+        pbr_data.roughness = metallicRoughness.g;
+    }
     pbr_data.diffuseColor = pow(baseColor.rgb, vec3(1.0/2.2));
     pbr_data.lightDir = normalize(lighting.lightPos.xyz - position);
     pbr_data.viewDir = normalize(lighting.cameraPos.xyz - position);
     pbr_data.normal = normalize(normal);
+    if (hasNormalMap) {
+        vec3 mapNormal = texture(sampler2D(normalMap, texSampler), texCoord).xyz * 2.0 - 1.0;
+        pbr_data.normal = perturbNormal(pbr_data.normal, mapNormal);
+    }
     vec3 brdf = pow(BRDF(pbr_data), vec3(2.2));
-    outColor = vec4(brdf, baseColor.a);
+    //no ambient light otherwise, occlusion only darkens this term
+    vec3 ambient = vec3(0.03) * baseColor.rgb;
+    if (hasOcclusion) {
+        ambient *= texture(sampler2D(occlusionTex, texSampler), texCoord).r;
+    }
+    vec3 color = brdf + ambient;
+    if (hasEmissive) {
+        color += texture(sampler2D(emissiveTex, texSampler), texCoord).rgb;
+    }
+    outColor = vec4(color, baseColor.a);
 }
\ No newline at end of file
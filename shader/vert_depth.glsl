@@ -0,0 +1,30 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//depth prepass of vert_lighting, gl_Position has to come out bit identical for the equal depth test
+layout(binding = 0) uniform UniformMatrix {
+    mat4 view;
+    mat4 proj;
+} matrix;
+
+//per draw data, indexed by the firstInstance of each draw
+struct DrawData {
+    mat4 model;
+    uint materialIndex;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, binding = 3) readonly buffer DrawDataBuffer {
+    DrawData draw[];
+} drawData;
+
+layout(location = 0) in vec3 position;
+
+invariant gl_Position;
+
+void main() {
+    mat4 model = drawData.draw[gl_InstanceIndex].model;
+    vec4 worldPosition = model * vec4(position, 1.0);
+    gl_Position = matrix.proj * matrix.view * worldPosition;
+}
\ No newline at end of file
@@ -6,9 +6,17 @@ layout(binding = 0) uniform UniformMatrix {
     mat4 proj;
 } matrix;
 
-layout(push_constant) uniform MeshConstant {
+//per draw data, indexed by the firstInstance of each draw
+struct DrawData {
     mat4 model;
-} pc;
+    uint materialIndex;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, binding = 3) readonly buffer DrawDataBuffer {
+    DrawData draw[];
+} drawData;
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -20,11 +28,15 @@ layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragPosition;
 layout(location = 3) out vec3 fragNormal;
 
+//matches the depth prepass, see vert_depth
+invariant gl_Position;
+
 void main() {
-    vec4 worldPosition = pc.model * vec4(position, 1.0);
+    mat4 model = drawData.draw[gl_InstanceIndex].model;
+    vec4 worldPosition = model * vec4(position, 1.0);
     gl_Position = matrix.proj * matrix.view * worldPosition;
     fragColor = color;
     fragTexCoord = texCoord;
     fragPosition = worldPosition.xyz;
-    fragNormal = normalize(transpose(inverse(mat3(pc.model))) * position);
+    fragNormal = normalize(transpose(inverse(mat3(model))) * position);
 }
\ No newline at end of file
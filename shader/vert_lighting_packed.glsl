@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//vert_lighting for the packed vertex format, see src/VertexPacking.h
+layout(binding = 0) uniform UniformMatrix {
+    mat4 view;
+    mat4 proj;
+} matrix;
+
+//per draw data, indexed by the firstInstance of each draw
+struct DrawData {
+    mat4 model;
+    uint materialIndex;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, binding = 3) readonly buffer DrawDataBuffer {
+    DrawData draw[];
+} drawData;
+
+layout(location = 0) in vec4 position;//unorm over the mesh's aabb
+layout(location = 1) in vec2 normal;//octahedral
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec2 texCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragPosition;
+layout(location = 3) out vec3 fragNormal;
+
+//matches the depth prepass, see vert_depth_packed
+invariant gl_Position;
+
+vec3 octDecode(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+void main() {
+    DrawData draw = drawData.draw[gl_InstanceIndex];
+    vec3 meshPosition = draw.positionOffset.xyz + position.xyz * draw.positionScale.xyz;
+    vec4 worldPosition = draw.model * vec4(meshPosition, 1.0);
+    gl_Position = matrix.proj * matrix.view * worldPosition;
+    fragColor = color.rgb;
+    fragTexCoord = texCoord;
+    fragPosition = worldPosition.xyz;
+    fragNormal = normalize(transpose(inverse(mat3(draw.model))) * octDecode(normal));
+}
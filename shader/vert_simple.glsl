@@ -6,9 +6,17 @@ layout(binding = 0) uniform UniformMatrix {
     mat4 proj;
 } matrix;
 
-layout(push_constant) uniform MeshConstant {
+//per draw data, indexed by the firstInstance of each draw
+struct DrawData {
     mat4 model;
-} pc;
+    uint materialIndex;
+    vec4 positionOffset;
+    vec4 positionScale;
+};
+
+layout(std430, binding = 3) readonly buffer DrawDataBuffer {
+    DrawData draw[];
+} drawData;
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
@@ -18,7 +26,8 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = matrix.proj * matrix.view * pc.model * vec4(position, 1.0);
+    mat4 model = drawData.draw[gl_InstanceIndex].model;
+    gl_Position = matrix.proj * matrix.view * model * vec4(position, 1.0);
     fragColor = color;
     fragTexCoord = texCoord;
 }
\ No newline at end of file
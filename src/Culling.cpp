@@ -0,0 +1,181 @@
+#include "Culling.h"
+#include "SimdSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <iostream>
+
+Frustum makeFrustum(const glm::mat4& viewProj) {
+	//glm is column major, row n of the matrix is (m[0][n], m[1][n], m[2][n], m[3][n])
+	auto row = [&viewProj](int n) {
+		return glm::vec4(viewProj[0][n], viewProj[1][n], viewProj[2][n], viewProj[3][n]);
+	};
+	auto x = row(0);
+	auto y = row(1);
+	auto z = row(2);
+	auto w = row(3);
+	Frustum frustum{ { w + x, w - x, w + y, w - y, w + z, w - z } };
+	for (auto& plane : frustum.plane) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+glm::vec4 transformSphere(const glm::mat4& model, const glm::vec4& sphere) {
+	auto center = model * glm::vec4(glm::vec3(sphere), 1.0f);
+	auto scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	return glm::vec4(glm::vec3(center), sphere.w * scale);
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere) {
+	for (const auto& plane : frustum.plane) {
+		if (glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<uint32_t> cullSphere(const Frustum& frustum, const std::vector<glm::mat4>& model, const std::vector<glm::vec4>& sphere) {
+	std::vector<uint32_t> visible;
+	visible.reserve(sphere.size());
+	for (uint32_t i = 0; i < sphere.size(); ++i) {
+		if (sphereInFrustum(frustum, transformSphere(model[i], sphere[i]))) {
+			visible.push_back(i);
+		}
+	}
+	return visible;
+}
+
+void AabbSoA::resize(size_t count) {
+	for (auto* component : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ }) {
+		component->resize(count);
+	}
+}
+
+size_t AabbSoA::size() const noexcept {
+	return minX.size();
+}
+
+void AabbSoA::set(size_t index, const glm::vec3& min, const glm::vec3& max) {
+	minX[index] = min.x;
+	minY[index] = min.y;
+	minZ[index] = min.z;
+	maxX[index] = max.x;
+	maxY[index] = max.y;
+	maxZ[index] = max.z;
+}
+
+void transformAabb(const glm::mat4& model, const glm::vec3& min, const glm::vec3& max, glm::vec3& outMin, glm::vec3& outMax) {
+	//center/extent form, the extent goes through the absolute of the 3x3 part
+	auto center = glm::vec3(model * glm::vec4((min + max) * 0.5f, 1.0f));
+	auto extent = (max - min) * 0.5f;
+	glm::vec3 worldExtent(0.0f);
+	for (auto column = 0; column < 3; ++column) {
+		worldExtent += glm::abs(glm::vec3(model[column])) * extent[column];
+	}
+	outMin = center - worldExtent;
+	outMax = center + worldExtent;
+}
+
+bool aabbInFrustum(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max) {
+	for (const auto& plane : frustum.plane) {
+		//corner furthest along the plane normal
+		glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void cullAabbScalar(const Frustum& frustum, const AabbSoA& box, std::vector<uint32_t>& visible) {
+	auto count = static_cast<uint32_t>(box.size());
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec3 min(box.minX[i], box.minY[i], box.minZ[i]);
+		glm::vec3 max(box.maxX[i], box.maxY[i], box.maxZ[i]);
+		if (aabbInFrustum(frustum, min, max)) {
+			visible.push_back(i);
+		}
+	}
+}
+
+void cullAabb(const Frustum& frustum, const AabbSoA& box, std::vector<uint32_t>& visible) {
+	auto count = static_cast<uint32_t>(box.size());
+	uint32_t i = 0;
+#ifdef SIMD_SSE2
+	//the furthest corner only depends on the plane normal sign, so it picks whole arrays instead of lanes
+	const float* cornerX[6];
+	const float* cornerY[6];
+	const float* cornerZ[6];
+	__m128 normalX[6], normalY[6], normalZ[6], distance[6];
+	for (auto p = 0; p < 6; ++p) {
+		const auto& plane = frustum.plane[p];
+		cornerX[p] = plane.x >= 0.0f ? box.maxX.data() : box.minX.data();
+		cornerY[p] = plane.y >= 0.0f ? box.maxY.data() : box.minY.data();
+		cornerZ[p] = plane.z >= 0.0f ? box.maxZ.data() : box.minZ.data();
+		normalX[p] = _mm_set1_ps(plane.x);
+		normalY[p] = _mm_set1_ps(plane.y);
+		normalZ[p] = _mm_set1_ps(plane.z);
+		distance[p] = _mm_set1_ps(plane.w);
+	}
+	const auto zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (auto p = 0; p < 6; ++p) {
+			//same order as the scalar dot(normal, corner) + w, so boxes touching a plane get the same result on both paths
+			auto d = _mm_mul_ps(normalX[p], _mm_loadu_ps(cornerX[p] + i));
+			d = _mm_add_ps(d, _mm_mul_ps(normalY[p], _mm_loadu_ps(cornerY[p] + i)));
+			d = _mm_add_ps(d, _mm_mul_ps(normalZ[p], _mm_loadu_ps(cornerZ[p] + i)));
+			d = _mm_add_ps(d, distance[p]);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+		}
+		auto mask = _mm_movemask_ps(inside);
+		while (mask != 0) {
+			auto lane = 0;
+			while ((mask & (1 << lane)) == 0) ++lane;
+			visible.push_back(i + lane);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		glm::vec3 min(box.minX[i], box.minY[i], box.minZ[i]);
+		glm::vec3 max(box.maxX[i], box.maxY[i], box.maxZ[i]);
+		if (aabbInFrustum(frustum, min, max)) {
+			visible.push_back(i);
+		}
+	}
+}
+
+void benchmarkCull(uint32_t count) {
+	//boxes scattered around the canonical view volume, roughly half of them visible
+	std::mt19937 random(count);
+	std::uniform_real_distribution<float> position(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> size(0.01f, 0.1f);
+	AabbSoA box;
+	box.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec3 min(position(random), position(random), position(random));
+		box.set(i, min, min + glm::vec3(size(random), size(random), size(random)));
+	}
+	auto frustum = makeFrustum(glm::mat4(1.0f));
+	std::vector<uint32_t> visibleSimd, visibleScalar;
+	visibleSimd.reserve(count);
+	visibleScalar.reserve(count);
+
+	constexpr int Repeat = 16;
+	auto measure = [&](void (*kernel)(const Frustum&, const AabbSoA&, std::vector<uint32_t>&), std::vector<uint32_t>& visible) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto n = 0; n < Repeat; ++n) {
+			visible.clear();
+			kernel(frustum, box, visible);
+		}
+		auto time = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count() / Repeat;
+	};
+	auto simdTime = measure(cullAabb, visibleSimd);
+	auto scalarTime = measure(cullAabbScalar, visibleScalar);
+	std::cout << "cull " << count << " aabb: simd " << simdTime << "ms, scalar " << scalarTime << "ms, visible " << visibleSimd.size()
+		<< (visibleSimd == visibleScalar ? "" : " (MISMATCH)") << std::endl;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "glm.hpp"
+#include <vector>
+#include <cstdint>
+
+//sphere test is the cpu reference of shader/comp_cull.glsl, both have to agree on what is visible
+//aabb test is the cpu side culling, run over structure of arrays so 4 boxes go through one simd test
+
+struct Frustum {
+	glm::vec4 plane[6];//xyz:inward normal, w:distance
+};
+
+//per indirect command input of the cull pass
+struct CullData {
+	glm::vec4 sphere;//mesh space bounding sphere
+	uint32_t bucket;//index of the count written by the surviving command
+	uint32_t bucketFirst;//first output command of the bucket
+	uint32_t padding[2];
+};
+
+//planes are extracted from the combined matrix, near uses -w < z so both depth conventions are covered
+Frustum makeFrustum(const glm::mat4& viewProj);
+//radius is scaled by the largest axis scale of the model matrix
+glm::vec4 transformSphere(const glm::mat4& model, const glm::vec4& sphere);
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere);
+//returns the indices of the visible spheres, in input order
+std::vector<uint32_t> cullSphere(const Frustum& frustum, const std::vector<glm::mat4>& model, const std::vector<glm::vec4>& sphere);
+
+//world space boxes, one array per component
+struct AabbSoA {
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+
+	void resize(size_t count);
+	size_t size() const noexcept;
+	void set(size_t index, const glm::vec3& min, const glm::vec3& max);
+};
+
+//world space box enclosing the transformed mesh space box
+void transformAabb(const glm::mat4& model, const glm::vec3& min, const glm::vec3& max, glm::vec3& outMin, glm::vec3& outMax);
+bool aabbInFrustum(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max);
+//visible indices are appended in input order, sse when available with a scalar tail
+void cullAabb(const Frustum& frustum, const AabbSoA& box, std::vector<uint32_t>& visible);
+void cullAabbScalar(const Frustum& frustum, const AabbSoA& box, std::vector<uint32_t>& visible);
+//culls count random boxes with both kernels, logs the timing & whether they agree
+void benchmarkCull(uint32_t count);
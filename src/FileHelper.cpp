@@ -0,0 +1,52 @@
+#include "FileHelper.h"
+#include <cstdio>
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+uint64_t hashBytes(const uint8_t* data, size_t size) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t remainingBytes(std::ifstream& input) {
+	auto position = input.tellg();
+	if (position < 0 || !input.seekg(0, std::ios::end)) {
+		input.clear();
+		return 0;
+	}
+	auto end = input.tellg();
+	input.seekg(position);
+	return end > position ? static_cast<uint64_t>(end - position) : 0;
+}
+
+bool writeFileAtomic(const std::string& path, const std::function<void(std::ofstream& output)>& content) {
+	auto partialPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".partial";
+	std::ofstream output(partialPath, std::ios::binary | std::ios::trunc);
+	if (!output.is_open()) {
+		return false;
+	}
+	content(output);
+	output.close();
+	if (output.fail()) {
+		std::remove(partialPath.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	//std::rename does not replace an existing file on windows, MoveFileEx swaps it in one step
+	auto moved = MoveFileExA(partialPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	auto moved = std::rename(partialPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!moved) {
+		std::remove(partialPath.c_str());
+		return false;
+	}
+	return true;
+}
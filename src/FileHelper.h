@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <string>
+
+//fnv-1a, names & verifies cache files, not meant against tampering
+uint64_t hashBytes(const uint8_t* data, size_t size);
+
+//bytes between the read position and the end of the file, sizes read from a file are checked against it before allocating
+uint64_t remainingBytes(std::ifstream& input);
+
+//content goes to a per-thread file beside path, renamed over path once the stream closed cleanly
+//readers see the old file or the whole new one, never a torn one, even with two threads writing the same path
+bool writeFileAtomic(const std::string& path, const std::function<void(std::ofstream& output)>& content);
@@ -3,13 +3,36 @@
 #include <algorithm>
 #include <iostream>
 
+uint32_t blockSize(ImageFormat format) {
+	switch (format) {
+	case ImageFormat::Bc1:
+		return 8;
+	case ImageFormat::Bc3:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
 ImageInput ImageInput::operator=(ImageInput&& other) noexcept
 {
 	return ImageInput(std::move(other));
 }
 
 bool ImageInput::isValid() const {
-	return pixelData != nullptr;
+	return pixelData != nullptr || !bakedData.empty();
+}
+
+bool ImageInput::isBaked() const noexcept {
+	return !level.empty();
+}
+
+ImageFormat ImageInput::getFormat() const noexcept {
+	return format;
+}
+
+const std::vector<ImageLevel>& ImageInput::getLevel() const noexcept {
+	return level;
 }
 
 int ImageInput::getWidth() const {
@@ -21,6 +44,9 @@ int ImageInput::getHeight() const {
 }
 
 uint32_t ImageInput::getMipLevel() const {
+	if (isBaked()) {
+		return static_cast<uint32_t>(level.size());
+	}
 	return mipLevel > 1 ? mipLevel : 1;
 }
 
@@ -28,22 +54,30 @@ bool ImageInput::preserveData() const {
 	return preserve;
 }
 
+bool ImageInput::isSrgb() const noexcept {
+	return srgb;
+}
+
 bool ImageInput::shouldGenerateMipmap() const {
-	return mipLevel > 1;
+	return !isBaked() && mipLevel > 1;
 }
 
 uint32_t ImageInput::getByteSize() const {
-	return byteSize;
+	return isBaked() ? static_cast<uint32_t>(bakedData.size()) : byteSize;
 }
 
 const uint8_t* ImageInput::pixel() const noexcept {
-	return pixelData.get();
+	return isBaked() ? bakedData.data() : pixelData.get();
 }
 
 void ImageInput::setPreserved(const bool value) {
 	preserve = value;
 }
 
+void ImageInput::setSrgb(const bool value) noexcept {
+	srgb = value;
+}
+
 void ImageInput::setMipLevel(const int offset) {
 	mipLevel = static_cast<uint32_t>(std::floor(std::max(1.0, std::log2(std::max(width, height)) - offset)));
 }
@@ -70,6 +104,18 @@ bool ImageInput::loadRaw(const uint8_t* rawData, const int size) {
 	return true;
 }
 
+void ImageInput::setBaked(ImageFormat formatIn, std::vector<ImageLevel>&& levelIn, std::vector<uint8_t>&& data) {
+	format = formatIn;
+	level = std::move(levelIn);
+	bakedData = std::move(data);
+	width = static_cast<int>(level[0].width);
+	height = static_cast<int>(level[0].height);
+	channel = 4;
+	pixelData = nullptr;
+}
+
 void ImageInput::release() {
 	pixelData = nullptr;
+	bakedData.clear();
+	bakedData.shrink_to_fit();
 }
\ No newline at end of file
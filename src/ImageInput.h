@@ -3,17 +3,42 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
+
+//srgb or linear (unorm) as set on the image
+enum class ImageFormat : uint32_t {
+	Rgba8 = 0,
+	Bc1 = 1,//1 bit alpha, 8 bytes per 4x4 block
+	Bc3 = 2,//interpolated alpha, 16 bytes per 4x4 block
+};
+
+//bytes per 4x4 block, 0 for uncompressed formats
+uint32_t blockSize(ImageFormat format);
+
+//one mip level inside the baked data
+struct ImageLevel {
+	uint32_t offset;
+	uint32_t size;
+	uint32_t width;
+	uint32_t height;
+};
 
 class ImageInput
 {
 private:
 	std::unique_ptr<uint8_t> pixelData;
+	//precomputed mip chain, replaces pixelData & the gpu mip generation when set
+	std::vector<uint8_t> bakedData;
+	std::vector<ImageLevel> level;
+	ImageFormat format = ImageFormat::Rgba8;
 	int byteSize;
 	int width;
 	int height;
 	int channel;
 	uint32_t mipLevel = 1;
 	bool preserve = false;
+	//colour, false for data (normal, metallic roughness, occlusion) that is filtered & sampled as is
+	bool srgb = true;
 	const int BytePerPixel = 4;
 public:
 	ImageInput() = default;
@@ -22,17 +47,23 @@ public:
 	ImageInput operator=(const ImageInput&) = delete;
 	ImageInput operator=(ImageInput&&) noexcept;
 	bool isValid() const;
+	bool isBaked() const noexcept;
+	ImageFormat getFormat() const noexcept;
+	const std::vector<ImageLevel>& getLevel() const noexcept;
 	int getWidth() const;
 	int getHeight() const;
 	uint32_t getMipLevel() const;
 	bool preserveData() const;
+	bool isSrgb() const noexcept;
 	bool shouldGenerateMipmap() const;
 	uint32_t getByteSize() const;
 	const uint8_t* pixel() const noexcept;
 	void setPreserved(const bool value);
+	void setSrgb(const bool value) noexcept;
 	void setMipLevel(const int offset);
 	bool load(const std::string& path);
 	bool loadRaw(const uint8_t* rawData, const int size);
+	void setBaked(ImageFormat formatIn, std::vector<ImageLevel>&& levelIn, std::vector<uint8_t>&& data);
 	void release();
 };
 
@@ -1,5 +1,28 @@
 #include "MaterialInput.h"
 
+bool isColorSlot(TextureSlot slot) {
+	return slot == TextureSlot::BaseColor || slot == TextureSlot::Emissive;
+}
+
+std::vector<uint8_t> textureSrgb(const MaterialInput* material, size_t materialCount, size_t firstTexture, size_t textureCount) {
+	std::vector<uint8_t> color(textureCount, 0);
+	std::vector<uint8_t> data(textureCount, 0);
+	for (size_t k = 0; k < materialCount; ++k) {
+		for (const auto& entry : material[k].getTextureEntry()) {
+			if (entry.textureIndex < firstTexture || entry.textureIndex >= firstTexture + textureCount) {
+				continue;
+			}
+			auto& use = isColorSlot(entry.slot) ? color : data;
+			use[entry.textureIndex - firstTexture] = 1;
+		}
+	}
+	std::vector<uint8_t> srgb(textureCount);
+	for (size_t t = 0; t < textureCount; ++t) {
+		srgb[t] = color[t] || !data[t];
+	}
+	return srgb;
+}
+
 void MaterialInput::setShaderIndex(int index) {
 	shaderIndex = index;
 }
@@ -22,8 +45,16 @@ const std::vector<MaterialInput::ValueEntry> MaterialInput::getValueEntry() cons
 	return valueEntry;
 }
 
-void MaterialInput::addTextureEntry(const uint16_t index) {
-	textureEntry.push_back({ index });
+void MaterialInput::addTextureEntry(const uint16_t index, const TextureSlot slot) {
+	textureEntry.push_back({ index, slot });
+}
+
+uint32_t MaterialInput::getTextureMask() const {
+	uint32_t mask = 0;
+	for (const auto& entry : textureEntry) {
+		mask |= 1u << static_cast<uint32_t>(entry.slot);
+	}
+	return mask;
 }
 
 void MaterialInput::addValueEntry(const glm::vec4 value) {
@@ -32,12 +63,14 @@ void MaterialInput::addValueEntry(const glm::vec4 value) {
 
 bool MaterialInput::compatibleWith(const MaterialPrototype& prototype) const {
 	return prototype.textureCount == textureEntry.size()
-		&& prototype.valueCount == valueEntry.size();
+		&& prototype.valueCount == valueEntry.size()
+		&& prototype.textureMask == getTextureMask();
 }
 
 MaterialPrototype MaterialInput::makePrototype() const {
 	return {
 		static_cast<uint16_t>(textureEntry.size()),
-		static_cast<uint16_t>(valueEntry.size())
+		static_cast<uint16_t>(valueEntry.size()),
+		getTextureMask()
 	};
 }
\ No newline at end of file
@@ -1,11 +1,26 @@
 #pragma once
 #include "glm.hpp"
 #include <vector>
+#include <cstdint>
+
+//what a material texture is sampled as, also its descriptor binding (slot + 1) & the shader's specialization constant id
+enum class TextureSlot : uint8_t {
+	BaseColor,
+	MetallicRoughness,
+	Normal,
+	Emissive,
+	Occlusion,
+	Count,
+};
+
+//base color & emissive hold srgb colour, the other slots linear data
+bool isColorSlot(TextureSlot slot);
 
 struct MaterialPrototype {
 	//TODO shader input info
 	uint16_t textureCount;
 	uint16_t valueCount;
+	uint32_t textureMask;//bit per TextureSlot the material has, pipelines are specialized on it
 };
 
 class MaterialInput
@@ -13,6 +28,7 @@ class MaterialInput
 private:
 	struct TextureEntry {
 		uint16_t textureIndex;
+		TextureSlot slot;
 		//TODO sampler info
 		//TODO shader mapping info
 	};
@@ -36,10 +52,15 @@ public:
 	int getPrototypeIndex() const;
 	const std::vector<TextureEntry> getTextureEntry() const noexcept;
 	const std::vector<ValueEntry> getValueEntry() const noexcept;
-	void addTextureEntry(const uint16_t index);
+	//one texture per slot
+	void addTextureEntry(const uint16_t index, const TextureSlot slot);
+	uint32_t getTextureMask() const;
 	void addValueEntry(const glm::vec4 value);
 	//TODO remove an entry
 	bool compatibleWith(const MaterialPrototype& prototype) const;
 	MaterialPrototype makePrototype() const;
 };
 
+//per texture in [firstTexture, firstTexture + textureCount), 0 when the materials only sample it through data slots
+//a texture not referenced at all, or referenced as colour by any material, stays srgb
+std::vector<uint8_t> textureSrgb(const MaterialInput* material, size_t materialCount, size_t firstTexture, size_t textureCount);
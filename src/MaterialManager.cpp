@@ -27,9 +27,14 @@ int MaterialManager::count() const {
 	return static_cast<int>(materialList.size());
 }
 
+uint32_t MaterialManager::getVersion() const {
+	return version;
+}
+
 void MaterialManager::addMaterial(MaterialInput&& material) {
 	matchPrototype(material);
 	materialList.push_back(std::move(material));
+	++version;
 }
 
 void MaterialManager::matchPrototype(MaterialInput& material) {
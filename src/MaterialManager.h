@@ -7,6 +7,7 @@ class MaterialManager
 private:
 	std::vector<MaterialInput> materialList;
 	std::vector<MaterialPrototype> prototypeList;
+	uint32_t version = 0;
 public:
 	MaterialInput& getMaterial(const int index);
 	const MaterialInput& getMaterial(const int index) const;
@@ -14,6 +15,8 @@ public:
 	const MaterialPrototype& getPrototype(const int index) const;
 	const std::vector<MaterialPrototype>& getPrototypeList() const;
 	int count() const;
+	//changes whenever a material is added, descriptor sets written before are stale
+	uint32_t getVersion() const;
 	void addMaterial(MaterialInput&&);
 	void matchPrototype(MaterialInput&);
 };
@@ -0,0 +1,361 @@
+#include "MeshCache.h"
+#include "ThreadPool.h"
+#include "VertexPacking.h"
+#include "FileHelper.h"
+#include <sys/stat.h>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t formatVersion;
+		uint32_t importerVersion;
+		uint32_t importOption;//ModelImport::Option mask
+		uint32_t vertexSize;//sizeof(Vertex)
+		uint32_t viewSize;//sizeof(BufferView), views are stored as is
+		float scale;
+		int64_t sourceTime;
+		uint64_t sourceSize;
+		uint32_t pathLength;
+		uint32_t nodeCount;
+		uint32_t materialCount;
+		uint32_t imageCount;
+		uint64_t bufferOffset;//from the start of the file, 16 byte aligned
+		uint64_t bufferSize;
+	};
+	constexpr char MeshCacheMagic[4] = { 'V', 'P', 'M', 'S' };
+
+	//read only mapping of a whole file
+	class MappedFile {
+	private:
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		~MappedFile() {
+#ifdef _WIN32
+			if (data) UnmapViewOfFile(data);
+			if (mapping) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+			if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+		}
+		bool open(const std::string& path) {
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+				return false;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr) {
+				return false;
+			}
+			data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			size = static_cast<size_t>(fileSize.QuadPart);
+			return data != nullptr;
+#else
+			auto fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size == 0) {
+				close(fd);
+				return false;
+			}
+			auto* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (mapped == MAP_FAILED) {
+				return false;
+			}
+			data = static_cast<const uint8_t*>(mapped);
+			size = static_cast<size_t>(info.st_size);
+			return true;
+#endif
+		}
+		const uint8_t* begin() const noexcept {
+			return data;
+		}
+		size_t length() const noexcept {
+			return size;
+		}
+	};
+
+	//bounds checked cursor over the mapped file
+	class CacheReader {
+	private:
+		const uint8_t* data;
+		size_t size;
+		size_t offset = 0;
+	public:
+		CacheReader(const uint8_t* dataIn, size_t sizeIn) : data(dataIn), size(sizeIn) {}
+		const uint8_t* take(size_t count) {
+			if (count > size - offset) {
+				return nullptr;
+			}
+			auto* current = data + offset;
+			offset += count;
+			return current;
+		}
+		template<typename T>
+		bool read(T& value) {
+			const auto* bytes = take(sizeof(T));
+			if (bytes) {
+				memcpy(&value, bytes, sizeof(T));
+			}
+			return bytes != nullptr;
+		}
+	};
+
+	template<typename T>
+	void write(std::ofstream& output, const T& value) {
+		output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	bool sourceStamp(const std::string& path, int64_t& time, uint64_t& size) {
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(path.c_str(), &info) != 0) {
+			return false;
+		}
+#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) {
+			return false;
+		}
+#endif
+		time = static_cast<int64_t>(info.st_mtime);
+		size = static_cast<uint64_t>(info.st_size);
+		return true;
+	}
+
+	bool validHeader(const MeshCacheHeader& header, const std::string& sourcePath, float scale, uint32_t option) {
+		int64_t time;
+		uint64_t size;
+		return memcmp(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic)) == 0
+			&& header.formatVersion == MeshCacheVersion
+			&& header.importerVersion == ModelImport::Version
+			&& header.importOption == option
+			&& header.vertexSize == sizeof(Vertex)
+			&& header.viewSize == sizeof(BufferView)
+			&& header.scale == scale
+			&& header.pathLength == sourcePath.size()
+			&& sourceStamp(sourcePath, time, size)
+			&& header.sourceTime == time
+			&& header.sourceSize == size;
+	}
+}
+
+std::string meshCachePath(const std::string& sourcePath) {
+	return sourcePath + ".vpmesh";
+}
+
+bool loadMeshCache(const std::string& sourcePath, ModelLoadingInfo& info, const ModelImport::Offset& offset, uint32_t option, uint32_t threadCount) {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto file = std::make_shared<MappedFile>();
+	if (!file->open(meshCachePath(sourcePath))) {
+		return false;
+	}
+	CacheReader reader(file->begin(), file->length());
+	MeshCacheHeader header;
+	if (!reader.read(header) || !validHeader(header, sourcePath, info.scale, option)) {
+		std::cout << "mesh cache of " << sourcePath << " is stale" << std::endl;
+		return false;
+	}
+	const auto* path = reader.take(header.pathLength);
+	if (path == nullptr || sourcePath.compare(0, sourcePath.size(), reinterpret_cast<const char*>(path), header.pathLength) != 0) {
+		return false;
+	}
+	if (header.bufferOffset > file->length() || header.bufferSize > file->length() - header.bufferOffset) {
+		return false;
+	}
+
+	//everything is validated before anything is added to info
+	std::vector<MeshNodeData> nodeList(header.nodeCount);
+	for (size_t n = 0; n < nodeList.size(); ++n) {
+		auto& node = nodeList[n];
+		uint32_t viewCount;
+		if (!reader.read(node.parentIndex) || !reader.read(node.instanceOf) || !reader.read(node.matrix) || !reader.read(viewCount)) {
+			return false;
+		}
+		//parents & instance sources are written before the nodes referring to them
+		auto nodeIndex = static_cast<int64_t>(n);
+		if (node.parentIndex < -1 || node.parentIndex >= nodeIndex || node.instanceOf < -1 || node.instanceOf >= nodeIndex) {
+			return false;
+		}
+		node.view.resize(viewCount);
+		for (auto& view : node.view) {
+			if (!reader.read(view)) {
+				return false;
+			}
+			if (view.vertexOffset > header.bufferSize || view.vertexSize > header.bufferSize - view.vertexOffset
+				|| view.indexOffset > header.bufferSize || view.indexSize > header.bufferSize - view.indexOffset) {
+				return false;
+			}
+			if (view.vertexFormat != VertexFormat::Float && view.vertexFormat != VertexFormat::Packed) {
+				return false;
+			}
+			if (view.indexStride != 1 && view.indexStride != 2 && view.indexStride != 4) {
+				return false;
+			}
+			//the upload reads vertexCount * stride bytes, the view has to hold exactly that
+			if (view.vertexStride != vertexStride(view.vertexFormat)
+				|| static_cast<uint64_t>(view.vertexCount) * view.vertexStride != view.vertexSize) {
+				return false;
+			}
+			if (view.lodCount == 0 || view.lodCount > MaxLodCount || view.indexCount > view.indexSize / view.indexStride) {
+				return false;
+			}
+			for (uint32_t l = 0; l < view.lodCount; ++l) {
+				if (static_cast<uint64_t>(view.lod[l].firstIndex) + view.lod[l].indexCount > view.indexSize / view.indexStride) {
+					return false;
+				}
+			}
+			//material indices are stored relative to the model
+			if (view.materialIndex > -1) {
+				view.materialIndex += offset.material;
+			}
+		}
+	}
+	std::vector<MaterialInput> materialList(header.materialCount);
+	for (auto& material : materialList) {
+		uint32_t textureCount, valueCount;
+		if (!reader.read(textureCount) || !reader.read(valueCount)) {
+			return false;
+		}
+		for (uint32_t i = 0; i < textureCount; ++i) {
+			uint16_t texture;
+			uint8_t slot;
+			if (!reader.read(texture) || !reader.read(slot) || slot >= static_cast<uint8_t>(TextureSlot::Count)) {
+				return false;
+			}
+			material.addTextureEntry(static_cast<uint16_t>(texture + offset.texture), static_cast<TextureSlot>(slot));
+		}
+		for (uint32_t i = 0; i < valueCount; ++i) {
+			glm::vec4 value;
+			if (!reader.read(value)) {
+				return false;
+			}
+			material.addValueEntry(value);
+		}
+	}
+	std::vector<std::pair<const uint8_t*, uint64_t>> imageList(header.imageCount);
+	for (auto& image : imageList) {
+		if (!reader.read(image.second) || (image.first = reader.take(image.second)) == nullptr) {
+			return false;
+		}
+	}
+
+	auto firstTexture = info.texture.reserve(imageList.size());
+	auto imageSrgb = textureSrgb(materialList.data(), materialList.size(), firstTexture, imageList.size());
+	ThreadPool decodeThread;
+	decodeThread.create(threadCount);
+	decodeThread.run(static_cast<uint32_t>(imageList.size()), [&](uint32_t, uint32_t task) {
+		const auto& image = imageList[task];
+		info.texture.loadEncoded(firstTexture + task, image.first, static_cast<size_t>(image.second), imageSrgb[task] != 0);
+	});
+	decodeThread.destroy();
+	for (auto& material : materialList) {
+		info.material.addMaterial(std::move(material));
+	}
+	//the mesh keeps the mapping alive, its vertex & index bytes are staged straight from the file
+	std::shared_ptr<const uint8_t> buffer(file, file->begin() + header.bufferOffset);
+	info.mesh.setMesh(std::move(buffer), static_cast<size_t>(header.bufferSize), std::move(nodeList));
+	auto time = std::chrono::high_resolution_clock::now();
+	std::cout << sourcePath << " loaded from mesh cache in "
+		<< std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count() << "ms" << std::endl;
+	return true;
+}
+
+bool saveMeshCache(const std::string& sourcePath, const ModelLoadingInfo& info, const ModelImport::Offset& offset, uint32_t option, const std::vector<std::vector<uint8_t>>& image) {
+	if (info.texture.count() - offset.texture != static_cast<int>(image.size())) {
+		std::cout << "textures not loaded from " << sourcePath << " can't be cached" << std::endl;
+		return false;
+	}
+	MeshCacheHeader header{};
+	memcpy(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+	header.formatVersion = MeshCacheVersion;
+	header.importerVersion = ModelImport::Version;
+	header.importOption = option;
+	header.vertexSize = sizeof(Vertex);
+	header.viewSize = sizeof(BufferView);
+	header.scale = info.scale;
+	if (!sourceStamp(sourcePath, header.sourceTime, header.sourceSize)) {
+		return false;
+	}
+	auto nodeList = info.mesh.getNodeData();
+	header.pathLength = static_cast<uint32_t>(sourcePath.size());
+	header.nodeCount = static_cast<uint32_t>(nodeList.size());
+	header.materialCount = static_cast<uint32_t>(info.material.count() - offset.material);
+	header.imageCount = static_cast<uint32_t>(image.size());
+	header.bufferSize = nodeList.empty() ? 0 : info.mesh.bufferSize(0);
+
+	//written aside & renamed, a crash midway never leaves a file with a valid header & a zero buffer offset
+	return writeFileAtomic(meshCachePath(sourcePath), [&](std::ofstream& output) {
+		//header is rewritten once the buffer offset is known
+		write(output, header);
+		output.write(sourcePath.data(), sourcePath.size());
+		for (const auto& node : nodeList) {
+			write(output, node.parentIndex);
+			write(output, node.instanceOf);
+			write(output, node.matrix);
+			write(output, static_cast<uint32_t>(node.view.size()));
+			for (auto view : node.view) {
+				if (view.materialIndex > -1) {
+					view.materialIndex -= offset.material;
+				}
+				write(output, view);
+			}
+		}
+		for (auto i = offset.material; i < info.material.count(); ++i) {
+			const auto& material = info.material.getMaterial(i);
+			auto textureEntry = material.getTextureEntry();
+			auto valueEntry = material.getValueEntry();
+			write(output, static_cast<uint32_t>(textureEntry.size()));
+			write(output, static_cast<uint32_t>(valueEntry.size()));
+			for (const auto& entry : textureEntry) {
+				write(output, static_cast<uint16_t>(entry.textureIndex - offset.texture));
+				write(output, static_cast<uint8_t>(entry.slot));
+			}
+			for (const auto& entry : valueEntry) {
+				write(output, entry.value);
+			}
+		}
+		for (const auto& data : image) {
+			write(output, static_cast<uint64_t>(data.size()));
+			output.write(reinterpret_cast<const char*>(data.data()), data.size());
+		}
+		auto position = static_cast<uint64_t>(output.tellp());
+		header.bufferOffset = (position + 15) & ~static_cast<uint64_t>(15);
+		const char padding[16]{};
+		output.write(padding, header.bufferOffset - position);
+		if (header.bufferSize > 0) {
+			output.write(reinterpret_cast<const char*>(info.mesh.bufferData(0)), header.bufferSize);
+		}
+		output.seekp(0);
+		write(output, header);
+	});
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "ModelImport.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//preprocessed copy of a model next to its source, <source>.vpmesh
+//holds the packed MeshInput buffer, the node & view tables, the materials and the encoded images,
+//a load maps the file and hands the packed buffer to MeshInput without parsing anything
+//the cache is stale once the source path/mtime/size, the import scale & options, the file format or the importer version changes
+
+//bump whenever the file layout changes
+constexpr uint32_t MeshCacheVersion = 6;
+
+std::string meshCachePath(const std::string& sourcePath);
+//false when there is no valid cache, info is left untouched then
+//images are decoded on threadCount workers, 0 decodes on the calling thread
+bool loadMeshCache(const std::string& sourcePath, ModelLoadingInfo& info, const ModelImport::Offset& offset, uint32_t option, uint32_t threadCount);
+//option is the ModelImport::Option mask the import ran with
+//image holds the encoded images added by the import, in texture order
+bool saveMeshCache(const std::string& sourcePath, const ModelLoadingInfo& info, const ModelImport::Offset& offset, uint32_t option, const std::vector<std::vector<uint8_t>>& image);
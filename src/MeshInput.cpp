@@ -1,8 +1,12 @@
 #include "MeshInput.h"
 #include "MeshNode.h"
 #include "DebugHelper.hpp"
+#include "VertexPacking.h"
 #include "gtc/matrix_transform.hpp"
 #include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 
 MeshInput::MeshInput(const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scale)
 	: enabled(true)
@@ -17,7 +21,11 @@ MeshInput::MeshInput(const glm::vec3& pos, const glm::quat& rot, const glm::vec3
 MeshInput::MeshInput(MeshInput&& other) noexcept
 	: enabled(std::move(other.enabled))
 	, bufferList(std::move(other.bufferList))
+	, externalBuffer(std::move(other.externalBuffer))
+	, externalBufferSize(other.externalBufferSize)
+	, vertexFormat(other.vertexFormat)
 	, meshList(std::move(other.meshList))
+	, transform(std::move(other.transform))
 	, position(std::move(other.position))
 	, rotation(std::move(other.rotation))
 	, scale(std::move(other.scale))
@@ -37,7 +45,11 @@ bool MeshInput::isEnabled() const noexcept {
 }
 
 const uint8_t* MeshInput::bufferData(const int index) const {
-	return bufferList[index].data();
+	return externalBuffer ? externalBuffer.get() : bufferList[index].data();
+}
+
+size_t MeshInput::bufferSize(const int index) const {
+	return externalBuffer ? externalBufferSize : bufferList[index].size();
 }
 
 void MeshInput::setPosition(glm::vec3&& pos) noexcept {
@@ -74,14 +86,24 @@ const std::vector<MeshNode>& MeshInput::getMeshList() const {
 	return meshList;
 }
 
+const TransformHierarchy& MeshInput::getTransform() const noexcept {
+	return transform;
+}
+
+void MeshInput::setNodeTransform(uint32_t node, const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scaleIn) {
+	transform.setLocal(meshList[node].getTransformIndex(), pos, rot, scaleIn);
+}
+
 void MeshInput::reserve(size_t size) {
 	meshList.reserve(size);
+	transform.reserve(size);
 }
 
-void MeshInput::addMesh(MeshNode&& mesh) {
-	mesh.setRoot(this);
-	mesh.updateConstantData();
-	meshList.push_back(std::move(mesh));
+void MeshInput::addMesh(std::vector<BufferView>&& view, int parentIndex, const MatrixInput& matrix) {
+	//mesh list & transforms grow together, a node's parent index is valid in both
+	auto transformIndex = transform.add(parentIndex, matrix);
+	meshList.push_back({ std::move(view), transformIndex });
+	meshList.back().setRoot(this);
 }
 
 BufferView MeshInput::createView(const size_t offset, const VertexIndexed& data) const {
@@ -89,16 +111,68 @@ BufferView MeshInput::createView(const size_t offset, const VertexIndexed& data)
 	view.bufferIndex = 0;
 	view.vertexOffset = offset;
 	view.vertexCount = static_cast<uint32_t>(data.vertices.size());
-	view.vertexStride = sizeof(data.vertices[0]);
+	view.vertexFormat = vertexFormat;
+	view.vertexStride = vertexStride(vertexFormat);
 	view.vertexSize = view.vertexCount * view.vertexStride;
 	view.indexOffset = offset + view.vertexSize;
-	view.indexCount = static_cast<uint32_t>(data.indices.size());
-	view.indexStride = sizeof(data.indices[0]);
-	view.indexSize = view.indexCount * view.indexStride;
+	view.indexStride = narrowestIndexStride(data.vertices.size());
+	view.indexSize = static_cast<uint32_t>(data.indices.size()) * view.indexStride;
 	view.materialIndex = data.material;
+	//lod ranges are packed with the full detail one, they share the vertices
+	view.lodCount = data.lod.empty() ? 1 : static_cast<uint32_t>(std::min<size_t>(data.lod.size(), MaxLodCount));
+	for (uint32_t l = 0; l < MaxLodCount; ++l) {
+		if (l >= view.lodCount) {
+			view.lod[l] = LodRange{ 0, 0, 0.0f };
+		}
+		else {
+			view.lod[l] = data.lod.empty() ? LodRange{ 0, static_cast<uint32_t>(data.indices.size()), 0.0f } : data.lod[l];
+		}
+	}
+	view.indexCount = view.lod[0].indexCount;
+	//aabb, plus a sphere around its center, not minimal but cheap & stable
+	glm::vec3 minPos(std::numeric_limits<float>::max());
+	glm::vec3 maxPos(std::numeric_limits<float>::lowest());
+	for (const auto& vertex : data.vertices) {
+		minPos = glm::min(minPos, vertex.pos);
+		maxPos = glm::max(maxPos, vertex.pos);
+	}
+	if (data.vertices.empty()) {
+		minPos = glm::vec3(0.0f);
+		maxPos = glm::vec3(0.0f);
+	}
+	view.aabbMin = minPos;
+	view.aabbMax = maxPos;
+	auto center = (minPos + maxPos) * 0.5f;
+	float radius2 = 0.0f;
+	for (const auto& vertex : data.vertices) {
+		auto offset = vertex.pos - center;
+		radius2 = std::max(radius2, glm::dot(offset, offset));
+	}
+	view.bound = glm::vec4(center, std::sqrt(radius2));
 	return view;
 }
 
+void MeshInput::packView(const BufferView& view, const VertexIndexed& data, uint8_t* buffer) const {
+	writeVertexStream(data.vertices, view.vertexFormat, view.aabbMin, view.aabbMax, buffer + view.vertexOffset);
+	auto* index = buffer + view.indexOffset;
+	switch (view.indexStride) {
+	case 1:
+		for (auto i = 0; i < data.indices.size(); ++i) {
+			index[i] = static_cast<uint8_t>(data.indices[i]);
+		}
+		break;
+	case 2:
+		for (auto i = 0; i < data.indices.size(); ++i) {
+			auto value = static_cast<uint16_t>(data.indices[i]);
+			memcpy(index + i * sizeof(uint16_t), &value, sizeof(uint16_t));
+		}
+		break;
+	default:
+		memcpy(index, data.indices.data(), view.indexSize);
+		break;
+	}
+}
+
 void MeshInput::calculateNormal(VertexIndexed& data) const {
 	std::vector<glm::vec3> normal(data.vertices.size());
 	for (auto i = 0; i < data.indices.size(); i += 3) {
@@ -117,15 +191,22 @@ void MeshInput::calculateNormal(VertexIndexed& data) const {
 	}
 }
 
+void MeshInput::setVertexFormat(VertexFormat format) noexcept {
+	vertexFormat = format;
+}
+
+VertexFormat MeshInput::getVertexFormat() const noexcept {
+	return vertexFormat;
+}
+
 void MeshInput::setMesh(VertexIndexed&& meshData) {
 	std::vector<uint8_t> buffer;
-	auto verticesSize = meshData.vertices.size() * static_cast<uint32_t>(sizeof(Vertex));
-	auto indicesSize = meshData.indices.size() * static_cast<uint8_t>(sizeof(uint16_t));
-	buffer.resize(verticesSize + indicesSize);
 	BufferView view = createView(0, meshData);
-	memcpy(buffer.data() + view.vertexOffset, meshData.vertices.data(), view.vertexSize);
-	memcpy(buffer.data() + view.indexOffset, meshData.indices.data(), view.indexSize);
-	addMesh({ { std::move(view) }, nullptr, MatrixInput::identity() });
+	buffer.resize(view.vertexSize + view.indexSize);
+	packView(view, meshData, buffer.data());
+	addMesh({ std::move(view) }, -1, MatrixInput::identity());
+	transform.update();
+	externalBuffer.reset();
 	bufferList.clear();
 	bufferList.push_back(std::move(buffer));
 }
@@ -135,42 +216,76 @@ void MeshInput::setMesh(std::vector<MeshData>&& meshDataList) {
 	//TODO is there an occasion where multiple data source buffer is needed?
 	std::vector<uint8_t> buffer;
 	size_t offset = 0;
-	auto vertexStride = static_cast<uint32_t>(sizeof(Vertex));
-	auto indexStride = static_cast<uint8_t>(sizeof(uint16_t));
+	auto stride = vertexStride(vertexFormat);
+	//views start 4 byte aligned, 8/16 bit index ranges can end anywhere
+	auto align = [](size_t value) { return (value + 3) & ~static_cast<size_t>(3); };
 	for (const auto& meshData : meshDataList) {
 		for (const auto& data : meshData.data) {
-			auto verticesSize = data.vertices.size() * vertexStride;
-			auto indicesSize = data.indices.size() * indexStride;
-			offset += verticesSize + indicesSize;
+			auto verticesSize = data.vertices.size() * stride;
+			auto indicesSize = data.indices.size() * narrowestIndexStride(data.vertices.size());
+			offset = align(offset + verticesSize + indicesSize);
 		}
 	}
 	buffer.resize(offset);
 	offset = 0;
+	auto nodeBase = static_cast<int>(meshList.size());
 	for (const auto& meshData : meshDataList) {
+		if (meshData.instanceOf > -1) {
+			//same bytes in the buffer, only the transform is new
+			auto source = nodeBase + meshData.instanceOf;
+			auto viewList = meshList[source].getView();
+			addMesh(std::move(viewList), meshData.parentIndex, meshData.matrix);
+			meshList.back().setInstanceOf(source);
+			continue;
+		}
 		std::vector<BufferView> viewList;
 		viewList.reserve(meshData.data.size());
 		for (const auto& data : meshData.data) {
 			BufferView view = createView(offset, data);
-			offset += view.vertexSize + view.indexSize;
-			memcpy(buffer.data() + view.vertexOffset, data.vertices.data(), view.vertexSize);
-			memcpy(buffer.data() + view.indexOffset, data.indices.data(), view.indexSize);
+			offset = align(offset + view.vertexSize + view.indexSize);
+			packView(view, data, buffer.data());
 			viewList.push_back(std::move(view));
 		}
-		const auto* parent = (meshData.parentIndex > -1 && meshData.parentIndex < meshList.size()) ? &meshList[meshData.parentIndex] : nullptr;
-		addMesh({ std::move(viewList), parent, meshData.matrix });
+		addMesh(std::move(viewList), meshData.parentIndex, meshData.matrix);
 	}
+	transform.update();
+	externalBuffer.reset();
 	bufferList.clear();
 	bufferList.push_back(std::move(buffer));
 }
 
+void MeshInput::setMesh(std::shared_ptr<const uint8_t>&& buffer, size_t size, std::vector<MeshNodeData>&& nodeList) {
+	auto nodeBase = static_cast<int>(meshList.size());
+	for (auto& node : nodeList) {
+		addMesh(std::move(node.view), node.parentIndex < 0 ? -1 : nodeBase + node.parentIndex, node.matrix);
+		if (node.instanceOf > -1) {
+			meshList.back().setInstanceOf(nodeBase + node.instanceOf);
+		}
+	}
+	transform.update();
+	bufferList.clear();
+	externalBuffer = std::move(buffer);
+	externalBufferSize = size;
+}
+
+std::vector<MeshNodeData> MeshInput::getNodeData() const {
+	std::vector<MeshNodeData> nodeList;
+	nodeList.reserve(meshList.size());
+	for (const auto& mesh : meshList) {
+		auto index = mesh.getTransformIndex();
+		nodeList.push_back({ transform.getParent(index), mesh.getInstanceOf(), transform.getMatrix(index), mesh.getView() });
+	}
+	return nodeList;
+}
+
 void MeshInput::updateConstantData() {
 	const auto&& translated = glm::translate(glm::mat4(1.0f), position);
 	const auto&& rotated = glm::mat4_cast(rotation);
 	const auto&& scaled = glm::scale(glm::mat4(1.0f), scale);
 	modelMatrix = translated * rotated * scaled;
-	for (auto& mesh : meshList) {
-		mesh.updateConstantData();
-	}
+	//only subtrees under a changed node are recomputed, the root change marks every top level node
+	transform.setRoot(modelMatrix);
+	transform.update();
 }
 
 void MeshInput::animate(const float rotationSpeed) {
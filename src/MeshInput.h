@@ -1,21 +1,32 @@
 #pragma once
 #include "MeshStruct.h"
 #include "MeshNode.h"
+#include "TransformHierarchy.h"
 #include <vector>
+#include <memory>
 
 class MeshInput
 {
 private:
 	bool enabled;
 	std::vector<std::vector<uint8_t>> bufferList;
+	//set instead of bufferList when the packed buffer lives in memory owned elsewhere, e.g. a mapped cache file
+	std::shared_ptr<const uint8_t> externalBuffer;
+	size_t externalBufferSize = 0;
+	//layout the vertices of the next setMesh are packed in
+	VertexFormat vertexFormat = VertexFormat::Float;
 	glm::vec3 position;
 	glm::quat rotation;
 	glm::vec3 scale;
 	glm::mat4 modelMatrix;
 	int materialIndex = 0;
 	std::vector<MeshNode> meshList;
+	//node transforms, indexed by MeshNode::getTransformIndex
+	TransformHierarchy transform;
 	BufferView createView(const size_t offset, const VertexIndexed& data) const;
-	void addMesh(MeshNode&& mesh);
+	//writes the vertex streams in view.vertexFormat & the indices narrowed to view.indexStride
+	void packView(const BufferView& view, const VertexIndexed& data, uint8_t* buffer) const;
+	void addMesh(std::vector<BufferView>&& view, int parentIndex, const MatrixInput& matrix);
 public:
 	MeshInput(
 		const glm::vec3& pos = glm::vec3(0.0f),
@@ -26,6 +37,7 @@ public:
 	void setEnabled(bool value) noexcept;
 	bool isEnabled() const noexcept;
 	const uint8_t* bufferData(const int index) const;
+	size_t bufferSize(const int index) const;
 	void setPosition(glm::vec3&& pos) noexcept;
 	const glm::vec3& getPosition() const noexcept;
 	void setRotation(glm::quat&& rot) noexcept;
@@ -36,10 +48,18 @@ public:
 	void setMaterial(int index);
 	int getMaterialIndex() const;
 	const std::vector<MeshNode>& getMeshList() const;
+	const TransformHierarchy& getTransform() const noexcept;
+	//local trs of a node, applied with the next updateConstantData
+	void setNodeTransform(uint32_t node, const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scaleIn);
 	void reserve(size_t size);
 	void calculateNormal(VertexIndexed& data) const;
+	void setVertexFormat(VertexFormat format) noexcept;
+	VertexFormat getVertexFormat() const noexcept;
 	void setMesh(VertexIndexed&& meshData);
 	void setMesh(std::vector<MeshData>&& meshDataList);
+	//already packed buffer & nodes, no vertex is touched
+	void setMesh(std::shared_ptr<const uint8_t>&& buffer, size_t size, std::vector<MeshNodeData>&& nodeList);
+	std::vector<MeshNodeData> getNodeData() const;
 	void updateConstantData();
 	void animate(const float rotationSpeed);
 };
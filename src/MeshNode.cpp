@@ -1,6 +1,7 @@
 #include "MeshNode.h"
 #include "MeshInput.h"
 #include "DebugHelper.hpp"
+#include "VertexPacking.h"
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_LEFT_HANDED
 #include "glm.hpp"
@@ -11,50 +12,78 @@ bool Vertex::operator==(const Vertex& other) const {
 	return pos == other.pos && texCoord == other.texCoord && color == other.color;
 }
 
-VkVertexInputBindingDescription MeshNode::getBindingDescription() {
-	VkVertexInputBindingDescription binding;
-	binding.binding = 0;//index
-	binding.stride = sizeof(Vertex);
-	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+std::vector<VkVertexInputBindingDescription> MeshNode::getBindingDescription(VertexFormat format, bool positionOnly) {
+	//binding 0 is the position stream, binding 1 the other attributes
+	std::vector<VkVertexInputBindingDescription> binding(positionOnly ? 1 : 2);
+	binding[0].binding = 0;//index
+	binding[0].stride = positionStride(format);
+	binding[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	if (!positionOnly) {
+		binding[1].binding = 1;
+		binding[1].stride = attributeStride(format);
+		binding[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	}
 	return binding;
 }
 
-std::vector<VkVertexInputAttributeDescription> MeshNode::getAttributeDescription() {
-	std::vector<VkVertexInputAttributeDescription> attribute(4);
+std::vector<VkVertexInputAttributeDescription> MeshNode::getAttributeDescription(VertexFormat format, bool positionOnly) {
+	std::vector<VkVertexInputAttributeDescription> attribute(positionOnly ? 1 : 4);
+	//attribute stream offsets are the member offsets minus the position in front of them
+	auto positionSize = positionStride(format);
 	auto& attributePos = attribute[0];
 	attributePos.binding = 0;
 	attributePos.location = 0;
+	attributePos.offset = 0;
+	if (format == VertexFormat::Packed) {
+		//same locations, the shader dequantizes the position & decodes the normal
+		attributePos.format = VK_FORMAT_R16G16B16A16_UNORM;//vec4
+		if (positionOnly) {
+			return attribute;
+		}
+		auto& attributeNormal = attribute[1];
+		attributeNormal.binding = 1;
+		attributeNormal.location = 1;
+		attributeNormal.format = VK_FORMAT_R16G16_SNORM;//vec2
+		attributeNormal.offset = offsetof(PackedVertex, normal) - positionSize;
+		auto& attributeColor = attribute[2];
+		attributeColor.binding = 1;
+		attributeColor.location = 2;
+		attributeColor.format = VK_FORMAT_R8G8B8A8_UNORM;//vec4
+		attributeColor.offset = offsetof(PackedVertex, color) - positionSize;
+		auto& attributeTexCoord = attribute[3];
+		attributeTexCoord.binding = 1;
+		attributeTexCoord.location = 3;
+		attributeTexCoord.format = VK_FORMAT_R16G16_SFLOAT;//vec2
+		attributeTexCoord.offset = offsetof(PackedVertex, texCoord) - positionSize;
+		return attribute;
+	}
 	attributePos.format = VK_FORMAT_R32G32B32_SFLOAT;//vec3
-	attributePos.offset = offsetof(Vertex, pos);
+	if (positionOnly) {
+		return attribute;
+	}
 	auto& attributeNormal = attribute[1];
-	attributeNormal.binding = 0;
+	attributeNormal.binding = 1;
 	attributeNormal.location = 1;
 	attributeNormal.format = VK_FORMAT_R32G32B32_SFLOAT;//vec3
-	attributeNormal.offset = offsetof(Vertex, normal);
+	attributeNormal.offset = offsetof(Vertex, normal) - positionSize;
 	auto& attributeColor = attribute[2];
-	attributeColor.binding = 0;
+	attributeColor.binding = 1;
 	attributeColor.location = 2;
 	attributeColor.format = VK_FORMAT_R32G32B32_SFLOAT;//vec3
-	attributeColor.offset = offsetof(Vertex, color);
+	attributeColor.offset = offsetof(Vertex, color) - positionSize;
 	auto& attributeTexCoord = attribute[3];
-	attributeTexCoord.binding = 0;
+	attributeTexCoord.binding = 1;
 	attributeTexCoord.location = 3;
 	attributeTexCoord.format = VK_FORMAT_R32G32_SFLOAT;//vec2
-	attributeTexCoord.offset = offsetof(Vertex, texCoord);
+	attributeTexCoord.offset = offsetof(Vertex, texCoord) - positionSize;
 	return attribute;
 }
 
-MeshNode::MeshNode(std::vector<BufferView>&& viewIn, const MeshNode* parentIn, const MatrixInput& matrix)
+MeshNode::MeshNode(std::vector<BufferView>&& viewIn, uint32_t transformIndexIn)
 	: root(nullptr)
-	, parent(parentIn)
+	, transformIndex(transformIndexIn)
 	, view(viewIn)
-	, position(matrix.translation)
-	, rotation(matrix.rotation)
-	, scale(matrix.scale)
-{
-	//TODO use matrix.matrix
-	updateConstantDataAsLocal();
-}
+{}
 
 uint32_t MeshNode::getConstantSize() {
 	return sizeof(MeshConstant);
@@ -64,10 +93,6 @@ void MeshNode::setRoot(const MeshInput* rootIn) noexcept {
 	root = rootIn;
 }
 
-void MeshNode::setParent(const MeshNode* parentIn) noexcept {
-	parent = parentIn;
-}
-
 void MeshNode::setView(std::vector<BufferView>&& viewIn) noexcept {
 	view = viewIn;
 }
@@ -76,25 +101,18 @@ const std::vector<BufferView>& MeshNode::getView() const noexcept {
 	return view;
 }
 
-void MeshNode::updateConstantData() {
-	constantData.model = localModelMatrix;
-	if (parent != nullptr) {
-		//parent node is placed directly before first child in array
-		constantData.model = parent->constantData.model * constantData.model;
-	}
-	else if (root != nullptr) {
-		constantData.model = root->getModelMatrix() * constantData.model;
-	}
+uint32_t MeshNode::getTransformIndex() const noexcept {
+	return transformIndex;
+}
+
+int MeshNode::getInstanceOf() const noexcept {
+	return instanceOf;
 }
 
-void MeshNode::updateConstantDataAsLocal() {
-	const auto&& translated = glm::translate(glm::mat4(1.0f), position);
-	const auto&& rotated = glm::mat4_cast(rotation);
-	const auto&& scaled = glm::scale(glm::mat4(1.0f), scale);
-	localModelMatrix = translated * rotated * scaled;
-	updateConstantData();
+void MeshNode::setInstanceOf(int index) noexcept {
+	instanceOf = index;
 }
 
 const MeshConstant& MeshNode::getConstantData() const {
-	return constantData;
+	return root->getTransform().getWorld(transformIndex);
 }
\ No newline at end of file
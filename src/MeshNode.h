@@ -11,33 +11,25 @@ class MeshNode
 {
 private:
 	const MeshInput* root;
-	const MeshNode* parent;
+	uint32_t transformIndex;
+	int instanceOf = -1;
 	std::vector<BufferView> view;
-	glm::vec3 position;
-	glm::quat rotation;
-	glm::vec3 scale;
-	glm::mat4 localModelMatrix;
-	MeshConstant constantData{};
 public:
-	static VkVertexInputBindingDescription getBindingDescription();
-	static std::vector<VkVertexInputAttributeDescription> getAttributeDescription();
+	//positionOnly leaves out the attribute stream, for depth only passes
+	static std::vector<VkVertexInputBindingDescription> getBindingDescription(VertexFormat format, bool positionOnly = false);
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescription(VertexFormat format, bool positionOnly = false);
 	static uint32_t getConstantSize();
 public:
-	MeshNode(std::vector<BufferView>&& viewIn,
-		const MeshNode* parentIn,
-		const MatrixInput& matrix = {
-			glm::vec3(0.0f),
-			glm::identity<glm::quat>(),
-			glm::vec3(1.0f)
-		}
-	);
+	MeshNode(std::vector<BufferView>&& viewIn, uint32_t transformIndexIn);
 	MeshNode(const MeshInput&) = delete;
 	MeshNode(MeshNode&&) = default;
 	void setRoot(const MeshInput* root) noexcept;
-	void setParent(const MeshNode* parent) noexcept;
 	void setView(std::vector<BufferView>&& view) noexcept;
 	const std::vector<BufferView>& getView() const noexcept;
-	void updateConstantData();
-	void updateConstantDataAsLocal();
+	uint32_t getTransformIndex() const noexcept;
+	//index of the node in the same MeshInput owning the geometry, views are copies of its views, -1 when owning
+	int getInstanceOf() const noexcept;
+	void setInstanceOf(int index) noexcept;
+	//world matrix, owned by the root's TransformHierarchy
 	const MeshConstant& getConstantData() const;
 };
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+	//fifo simulation where the cache can be flushed, loadedAt is the 1 based miss that loaded the vertex
+	struct FlushedCache {
+		std::vector<uint32_t> loadedAt;
+		uint32_t missCount = 0;
+		uint32_t flushedAt = 0;
+		uint32_t cacheSize;
+
+		FlushedCache(size_t vertexCount, uint32_t size) : loadedAt(vertexCount, 0), cacheSize(size) {}
+		void flush() {
+			flushedAt = missCount;
+		}
+		//misses of the triangle
+		uint32_t add(const uint32_t* triangle) {
+			uint32_t miss = 0;
+			for (auto corner = 0; corner < 3; ++corner) {
+				auto& loaded = loadedAt[triangle[corner]];
+				if (loaded <= flushedAt || missCount - loaded >= cacheSize) {
+					loaded = ++missCount;
+					++miss;
+				}
+			}
+			return miss;
+		}
+	};
+
+	//splits every dead end cluster where the triangles so far reach the threshold acmr, the flush at a split is paid back there
+	void splitClusters(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>& clusterStart) {
+		auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		FlushedCache cache(vertexCount, cacheSize);
+		std::vector<uint32_t> result;
+		result.reserve(clusterStart.size());
+		for (size_t c = 0; c < clusterStart.size(); ++c) {
+			auto first = clusterStart[c];
+			auto last = c + 1 < clusterStart.size() ? clusterStart[c + 1] : triangleCount;
+			cache.flush();
+			uint32_t clusterMiss = 0;
+			for (auto t = first; t < last; ++t) {
+				clusterMiss += cache.add(indices.data() + t * 3);
+			}
+			auto threshold = static_cast<float>(clusterMiss) / (last - first) * OverdrawSplitThreshold;
+			result.push_back(first);
+			cache.flush();
+			uint32_t miss = 0;
+			uint32_t count = 0;
+			for (auto t = first; t < last; ++t) {
+				miss += cache.add(indices.data() + t * 3);
+				++count;
+				if (t + 1 < last && miss <= threshold * count) {
+					result.push_back(t + 1);
+					cache.flush();
+					miss = 0;
+					count = 0;
+				}
+			}
+		}
+		clusterStart = std::move(result);
+	}
+}
+
+float VertexCacheStat::acmr() const noexcept {
+	return triangleCount > 0 ? static_cast<float>(transformCount) / triangleCount : 0.0f;
+}
+
+float VertexCacheStat::atvr() const noexcept {
+	return vertexCount > 0 ? static_cast<float>(transformCount) / vertexCount : 0.0f;
+}
+
+VertexCacheStat& VertexCacheStat::operator+=(const VertexCacheStat& other) noexcept {
+	triangleCount += other.triangleCount;
+	vertexCount += other.vertexCount;
+	transformCount += other.transformCount;
+	return *this;
+}
+
+VertexCacheStat analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+	VertexCacheStat stat;
+	stat.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	//a vertex is in the fifo while fewer than cacheSize misses happened since it was loaded
+	std::vector<uint32_t> loadedAt(vertexCount, 0);
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	for (auto index : indices) {
+		if (index >= vertexCount) {
+			continue;
+		}
+		if (!referenced[index]) {
+			referenced[index] = 1;
+			++stat.vertexCount;
+		}
+		//loadedAt is the 1 based miss that loaded the vertex, 0 is never loaded
+		if (loadedAt[index] == 0 || stat.transformCount - loadedAt[index] >= cacheSize) {
+			++stat.transformCount;
+			loadedAt[index] = stat.transformCount;
+		}
+	}
+	return stat;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>& clusterStart) {
+	auto triangleCount = indices.size() / 3;
+	clusterStart.clear();
+	if (triangleCount == 0) {
+		return;
+	}
+	//vertex -> triangle adjacency, compressed rows
+	std::vector<uint32_t> liveCount(vertexCount, 0);
+	for (auto index : indices) {
+		++liveCount[index];
+	}
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + liveCount[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		auto fill = adjacencyOffset;
+		for (size_t i = 0; i < indices.size(); ++i) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidate;
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+	//next vertex still having triangles, from the dead end stack first then in input order
+	auto skipDeadEnd = [&]() -> int64_t {
+		while (!deadEnd.empty()) {
+			auto vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveCount[vertex] > 0) {
+				return vertex;
+			}
+		}
+		while (cursor < vertexCount) {
+			if (liveCount[cursor] > 0) {
+				return cursor;
+			}
+			++cursor;
+		}
+		return -1;
+	};
+
+	auto fanning = skipDeadEnd();
+	clusterStart.push_back(0);
+	while (fanning >= 0) {
+		candidate.clear();
+		for (auto a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a) {
+			auto triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = 1;
+			for (auto corner = 0; corner < 3; ++corner) {
+				auto vertex = indices[triangle * 3 + corner];
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidate.push_back(vertex);
+				--liveCount[vertex];
+				if (time - cacheTime[vertex] > cacheSize) {
+					cacheTime[vertex] = time;
+					++time;
+				}
+			}
+		}
+		//the candidate still in cache after its remaining triangles are emitted, the one loaded earliest wins
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (auto vertex : candidate) {
+			if (liveCount[vertex] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * liveCount[vertex] <= cacheSize) {
+				priority = time - cacheTime[vertex];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+		if (next < 0) {
+			next = skipDeadEnd();
+			if (next >= 0 && result.size() < indices.size()) {
+				clusterStart.push_back(static_cast<uint32_t>(result.size() / 3));
+			}
+		}
+		fanning = next;
+	}
+	indices = std::move(result);
+	splitClusters(indices, vertexCount, cacheSize, clusterStart);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusterStart) {
+	auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (clusterStart.size() < 2) {
+		return;
+	}
+	struct Cluster {
+		uint32_t first;
+		uint32_t last;
+		float sortKey;
+	};
+	std::vector<Cluster> clusterList(clusterStart.size());
+	glm::vec3 meshCenter(0.0f);
+	for (size_t c = 0; c < clusterList.size(); ++c) {
+		clusterList[c].first = clusterStart[c];
+		clusterList[c].last = c + 1 < clusterStart.size() ? clusterStart[c + 1] : triangleCount;
+	}
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		meshCenter += vertices[indices[t * 3]].pos + vertices[indices[t * 3 + 1]].pos + vertices[indices[t * 3 + 2]].pos;
+	}
+	meshCenter /= static_cast<float>(triangleCount * 3);
+	//facing away from the center first, those are likely to occlude the rest
+	for (auto& cluster : clusterList) {
+		glm::vec3 center(0.0f);
+		glm::vec3 normal(0.0f);
+		for (auto t = cluster.first; t < cluster.last; ++t) {
+			const auto& p0 = vertices[indices[t * 3]].pos;
+			const auto& p1 = vertices[indices[t * 3 + 1]].pos;
+			const auto& p2 = vertices[indices[t * 3 + 2]].pos;
+			center += p0 + p1 + p2;
+			//area weighted
+			normal += glm::cross(p1 - p0, p2 - p0);
+		}
+		center /= static_cast<float>((cluster.last - cluster.first) * 3);
+		auto length = glm::length(normal);
+		cluster.sortKey = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+	}
+	std::stable_sort(clusterList.begin(), clusterList.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (const auto& cluster : clusterList) {
+		result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+	}
+	indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	constexpr uint32_t Unused = UINT32_MAX;
+	std::vector<uint32_t> remap(vertices.size(), Unused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == Unused) {
+			remap[index] = static_cast<uint32_t>(result.size());
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(result);
+}
+
+MeshOptimizeStat optimizeMesh(VertexIndexed& data) {
+	MeshOptimizeStat stat;
+	stat.before = analyzeVertexCache(data.indices, data.vertices.size());
+	//out of range indices would break the adjacency, such a mesh is left as is
+	auto valid = data.indices.size() % 3 == 0 && std::all_of(data.indices.begin(), data.indices.end(), [&](uint32_t index) {
+		return index < data.vertices.size();
+	});
+	if (!valid) {
+		stat.after = stat.before;
+		return stat;
+	}
+	std::vector<uint32_t> clusterStart;
+	optimizeVertexCache(data.indices, data.vertices.size(), VertexCacheSize, clusterStart);
+	optimizeOverdraw(data.indices, data.vertices, clusterStart);
+	optimizeVertexFetch(data.vertices, data.indices);
+	stat.after = analyzeVertexCache(data.indices, data.vertices.size());
+	return stat;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "MeshStruct.h"
+#include <vector>
+#include <cstdint>
+
+//post import reordering of an indexed triangle list, geometry is unchanged
+//triangles are reordered for the post transform vertex cache (tipsify), the resulting clusters are sorted
+//so outward facing ones come first (less overdraw), then vertices are renumbered in first use order for fetch locality
+
+//fifo size the reordering targets & the statistics simulate
+constexpr uint32_t VertexCacheSize = 16;
+//tipsify overdraw split, a cluster ends once its running acmr (cold cache at its start) is within this factor
+//of the acmr of the whole dead end to dead end run, higher gives more & smaller clusters to sort
+constexpr float OverdrawSplitThreshold = 1.05f;
+
+struct VertexCacheStat {
+	uint32_t triangleCount = 0;
+	uint32_t vertexCount = 0;//vertices referenced by the indices
+	uint32_t transformCount = 0;//misses of the simulated fifo cache
+
+	//average cache miss ratio, transformed vertices per triangle, 0.5 is the ideal of a regular grid, 3 the worst
+	float acmr() const noexcept;
+	//average transform to vertex ratio, 1 is every vertex transformed once
+	float atvr() const noexcept;
+	VertexCacheStat& operator+=(const VertexCacheStat& other) noexcept;
+};
+
+struct MeshOptimizeStat {
+	VertexCacheStat before;
+	VertexCacheStat after;
+};
+
+VertexCacheStat analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = VertexCacheSize);
+//tipsify, clusterStart receives the first triangle of every cluster
+//a cluster ends where the walk hit a dead end, or earlier once it paid back the cache flush a split costs
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>& clusterStart);
+//stable sort of the clusters by how much they face away from the mesh center
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusterStart);
+//vertices in first use order, unreferenced ones are dropped
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+//the three passes above, in order
+MeshOptimizeStat optimizeMesh(VertexIndexed& data);
@@ -0,0 +1,283 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <cmath>
+
+namespace {
+	//sum of squared distances to a set of planes, the symmetric 4x4 matrix stored as its upper triangle
+	struct Quadric {
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+
+		//n unit normal, plane is dot(n, p) + d = 0
+		void addPlane(double nx, double ny, double nz, double d) noexcept {
+			a00 += nx * nx; a01 += nx * ny; a02 += nx * nz;
+			a11 += ny * ny; a12 += ny * nz; a22 += nz * nz;
+			b0 += nx * d; b1 += ny * d; b2 += nz * d;
+			c += d * d;
+		}
+		Quadric& operator+=(const Quadric& other) noexcept {
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12; a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			return *this;
+		}
+		double evaluate(const glm::vec3& p) const noexcept {
+			double x = p.x, y = p.y, z = p.z;
+			auto result = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			//rounding may leave it slightly negative
+			return std::max(result, 0.0);
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	//a level keeping more than this fraction of the previous one is not worth its index range
+	constexpr float MinLodReduction = 0.75f;
+	//levels below this many triangles are left out, the draw overhead dominates there
+	constexpr size_t MinLodTriangleCount = 32;
+
+	uint64_t edgeKey(uint32_t a, uint32_t b) {
+		if (a > b) {
+			std::swap(a, b);
+		}
+		return static_cast<uint64_t>(a) << 32 | b;
+	}
+
+	//vertices sharing a position with another vertex (attribute seam) or touching an edge not shared by exactly
+	//two triangles (open border, non manifold) are locked
+	std::vector<uint8_t> lockedVertex(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		auto vertexCount = static_cast<uint32_t>(vertices.size());
+		std::vector<uint32_t> order(vertexCount);
+		std::iota(order.begin(), order.end(), 0u);
+		auto less = [&vertices](uint32_t a, uint32_t b) {
+			const auto& pa = vertices[a].pos;
+			const auto& pb = vertices[b].pos;
+			return pa.x < pb.x || (pa.x == pb.x && (pa.y < pb.y || (pa.y == pb.y && pa.z < pb.z)));
+		};
+		std::sort(order.begin(), order.end(), less);
+		std::vector<uint32_t> positionId(vertexCount, 0);
+		std::vector<uint32_t> positionUse;
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			if (i == 0 || less(order[i - 1], order[i])) {
+				positionUse.push_back(0);
+			}
+			positionId[order[i]] = static_cast<uint32_t>(positionUse.size() - 1);
+			++positionUse.back();
+		}
+		std::vector<uint8_t> lockedPosition(positionUse.size(), 0);
+		for (size_t p = 0; p < positionUse.size(); ++p) {
+			lockedPosition[p] = positionUse[p] > 1;
+		}
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (auto corner = 0; corner < 3; ++corner) {
+				auto a = positionId[indices[i + corner]];
+				auto b = positionId[indices[i + (corner + 1) % 3]];
+				++edgeUse[edgeKey(a, b)];
+			}
+		}
+		for (const auto& edge : edgeUse) {
+			if (edge.second != 2) {
+				lockedPosition[edge.first >> 32] = 1;
+				lockedPosition[edge.first & 0xffffffffu] = 1;
+			}
+		}
+		std::vector<uint8_t> locked(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			locked[v] = lockedPosition[positionId[v]];
+		}
+		return locked;
+	}
+}
+
+MeshLodStat& MeshLodStat::operator+=(const MeshLodStat& other) noexcept {
+	for (uint32_t l = 0; l < MaxLodCount; ++l) {
+		triangleCount[l] += other.triangleCount[l];
+		viewCount[l] += other.viewCount[l];
+	}
+	return *this;
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error) {
+	error = 0.0f;
+	auto vertexCount = vertices.size();
+	std::vector<Quadric> quadric(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const auto& p0 = vertices[indices[i]].pos;
+		const auto& p1 = vertices[indices[i + 1]].pos;
+		const auto& p2 = vertices[indices[i + 2]].pos;
+		auto normal = glm::cross(p1 - p0, p2 - p0);
+		auto length = glm::length(normal);
+		if (length <= 0.0f) {
+			continue;
+		}
+		normal = normal / length;
+		auto d = -static_cast<double>(glm::dot(normal, p0));
+		for (auto corner = 0; corner < 3; ++corner) {
+			quadric[indices[i + corner]].addPlane(normal.x, normal.y, normal.z, d);
+		}
+	}
+	auto locked = lockedVertex(vertices, indices);
+
+	std::vector<uint32_t> result = indices;
+	std::vector<Collapse> collapse;
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> target(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+	double maxCost = 0.0;
+	//every pass applies the cheapest independent collapses, neighbourhoods of collapsed vertices wait for the next pass
+	while (result.size() > targetIndexCount) {
+		collapse.clear();
+		//an inner edge is seen from both of its triangles, once in each direction, only the a < b one is kept
+		//with the cheaper of its two collapse directions
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (auto corner = 0; corner < 3; ++corner) {
+				auto a = result[i + corner];
+				auto b = result[i + (corner + 1) % 3];
+				if (a > b || (locked[a] && locked[b])) {
+					continue;
+				}
+				auto merged = quadric[a];
+				merged += quadric[b];
+				Collapse toB{ a, b, merged.evaluate(vertices[b].pos) };
+				Collapse toA{ b, a, merged.evaluate(vertices[a].pos) };
+				if (locked[a] || (!locked[b] && toA.cost < toB.cost)) {
+					collapse.push_back(toA);
+				}
+				else {
+					collapse.push_back(toB);
+				}
+			}
+		}
+		if (collapse.empty()) {
+			break;
+		}
+		std::sort(collapse.begin(), collapse.end(), [](const Collapse& a, const Collapse& b) {
+			return a.cost < b.cost;
+		});
+		//vertex -> triangle adjacency of the current triangles
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (auto index : result) {
+			++adjacencyOffset[index + 1];
+		}
+		std::partial_sum(adjacencyOffset.begin(), adjacencyOffset.end(), adjacencyOffset.begin());
+		adjacency.resize(result.size());
+		{
+			auto fill = adjacencyOffset;
+			for (size_t i = 0; i < result.size(); ++i) {
+				adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+		std::iota(target.begin(), target.end(), 0u);
+		std::fill(touched.begin(), touched.end(), 0);
+		auto removeCount = (result.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		for (const auto& entry : collapse) {
+			if (removed >= removeCount) {
+				break;
+			}
+			if (touched[entry.from] || touched[entry.to]) {
+				continue;
+			}
+			//triangles around from keep roughly their facing once it moves to the other end
+			const auto& moved = vertices[entry.to].pos;
+			uint32_t degenerate = 0;
+			bool flipped = false;
+			for (auto a = adjacencyOffset[entry.from]; a < adjacencyOffset[entry.from + 1] && !flipped; ++a) {
+				const auto* corner = &result[adjacency[a] * 3];
+				if (corner[0] == entry.to || corner[1] == entry.to || corner[2] == entry.to) {
+					++degenerate;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (auto k = 0; k < 3; ++k) {
+					p[k] = vertices[corner[k]].pos;
+					q[k] = corner[k] == entry.from ? moved : p[k];
+				}
+				auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				auto after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flipped = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+			}
+			if (flipped || degenerate == 0) {
+				continue;
+			}
+			target[entry.from] = entry.to;
+			quadric[entry.to] += quadric[entry.from];
+			maxCost = std::max(maxCost, entry.cost);
+			removed += degenerate;
+			for (auto a = adjacencyOffset[entry.from]; a < adjacencyOffset[entry.from + 1]; ++a) {
+				const auto* corner = &result[adjacency[a] * 3];
+				touched[corner[0]] = touched[corner[1]] = touched[corner[2]] = 1;
+			}
+		}
+		if (removed == 0) {
+			break;
+		}
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			auto v0 = target[result[i]];
+			auto v1 = target[result[i + 1]];
+			auto v2 = target[result[i + 2]];
+			if (v0 == v1 || v1 == v2 || v2 == v0) {
+				continue;
+			}
+			result[write++] = v0;
+			result[write++] = v1;
+			result[write++] = v2;
+		}
+		result.resize(write);
+	}
+	error = static_cast<float>(std::sqrt(maxCost));
+	return result;
+}
+
+MeshLodStat generateLod(VertexIndexed& data) {
+	MeshLodStat stat;
+	data.lod.clear();
+	auto fullCount = data.indices.size();
+	stat.triangleCount[0] = static_cast<uint32_t>(fullCount / 3);
+	stat.viewCount[0] = 1;
+	auto valid = fullCount % 3 == 0 && std::all_of(data.indices.begin(), data.indices.end(), [&](uint32_t index) {
+		return index < data.vertices.size();
+	});
+	if (!valid) {
+		return stat;
+	}
+	//every level starts from the full mesh, so its error is measured against the original surface
+	std::vector<uint32_t> lodIndices;
+	std::vector<uint32_t> clusterStart;
+	auto lastCount = fullCount;
+	data.lod.push_back({ 0, static_cast<uint32_t>(fullCount), 0.0f });
+	for (uint32_t level = 1; level < MaxLodCount; ++level) {
+		auto targetCount = (fullCount >> level) / 3 * 3;
+		if (targetCount < MinLodTriangleCount * 3) {
+			break;
+		}
+		float error;
+		auto simplified = simplifyMesh(data.vertices, data.indices, targetCount, error);
+		if (simplified.empty() || simplified.size() > lastCount * MinLodReduction) {
+			break;
+		}
+		optimizeVertexCache(simplified, data.vertices.size(), VertexCacheSize, clusterStart);
+		data.lod.push_back({ static_cast<uint32_t>(fullCount + lodIndices.size()), static_cast<uint32_t>(simplified.size()), error });
+		stat.triangleCount[level] = static_cast<uint32_t>(simplified.size() / 3);
+		stat.viewCount[level] = 1;
+		lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+		lastCount = simplified.size();
+	}
+	data.indices.insert(data.indices.end(), lodIndices.begin(), lodIndices.end());
+	return stat;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "MeshStruct.h"
+#include <vector>
+#include <cstdint>
+
+//import time detail levels of an indexed triangle list, quadric error metric (garland & heckbert)
+//edges collapse onto one of their existing vertices, so every level is an index range over the same vertex buffer
+//vertices on a uv/normal seam or an open border never move, the silhouette & attribute seams are kept
+
+struct MeshLodStat {
+	uint32_t triangleCount[MaxLodCount]{};
+	uint32_t viewCount[MaxLodCount]{};//views having the level
+
+	MeshLodStat& operator+=(const MeshLodStat& other) noexcept;
+};
+
+//indices of the simplified mesh, collapses stop once at most targetIndexCount indices are left or nothing can collapse
+//error receives the largest error of an applied collapse, as a mesh space distance
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error);
+//appends up to MaxLodCount - 1 levels to the indices, each with half the triangles of the previous one
+//a level removing too little ends the chain, the levels are vertex cache ordered
+MeshLodStat generateLod(VertexIndexed& data);
@@ -4,7 +4,7 @@
 #include "gtx/hash.hpp"
 #include<vector>
 
-//TODO separate vertex position improves depth prepass/shadow mapping efficiency
+//interleaved form used while importing, buffers hold it split in a position & an attribute stream
 struct Vertex {
 	glm::vec3 pos;
 	glm::vec3 normal;
@@ -14,6 +14,20 @@ struct Vertex {
 	bool operator==(const Vertex& other) const;
 };
 
+//layout of the vertex bytes of a view, the pipeline's vertex input has to match, see VertexPacking.h
+enum class VertexFormat : uint8_t {
+	Float = 0,//Vertex as is, 44 bytes
+	Packed = 1,//PackedVertex, 20 bytes
+};
+
+//pos has to stay the first member of both, see VertexPacking.h
+struct PackedVertex {
+	uint16_t pos[4];//unorm over the view's aabb, w unused
+	int16_t normal[2];//octahedral, snorm
+	uint8_t color[4];//unorm, a is 1
+	uint16_t texCoord[2];//half
+};
+
 namespace std {
 	template<> struct hash<Vertex> {
 		size_t operator()(const Vertex& vertex) const {
@@ -40,16 +54,35 @@ struct MatrixInput {
 	}
 };
 
+//detail levels of one view, 0 is the full mesh
+constexpr uint32_t MaxLodCount = 4;
+
+//one detail level, a range of the view's indices over the same vertices
+struct LodRange {
+	uint32_t firstIndex;//from the start of the view's indices
+	uint32_t indexCount;
+	float error;//mesh space distance the simplified surface may be off by
+};
+
 struct VertexIndexed {
 	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	std::vector<uint32_t> indices;//full width while editing, packed to the narrowest type in MeshInput::setMesh
 	int material;
+	std::vector<LodRange> lod;//empty for the full mesh only, otherwise lod[0] is it & coarser ranges follow in indices
 };
 
+//narrowest index type able to address every vertex, 1/2/4 bytes
+inline uint8_t narrowestIndexStride(size_t vertexCount) {
+	if (vertexCount <= 0x100) return 1;
+	if (vertexCount <= 0x10000) return 2;
+	return 4;
+}
+
 struct MeshData {
 	int parentIndex;//-1 for none
 	MatrixInput matrix;
 	std::vector<VertexIndexed> data;
+	int instanceOf = -1;//earlier entry of the same list whose geometry is reused, data is left empty then
 };
 
 struct BufferView {
@@ -57,14 +90,36 @@ struct BufferView {
 	size_t vertexOffset;
 	uint32_t vertexSize;
 	uint32_t vertexStride;
+	VertexFormat vertexFormat;
 	uint32_t vertexCount;
 	size_t indexOffset;
-	uint32_t indexSize;
-	uint8_t indexStride;
-	uint32_t indexCount;
+	uint32_t indexSize;//every lod range
+	uint8_t indexStride;//1, 2 or 4, chosen per view
+	uint32_t indexCount;//full detail
 	int materialIndex;
+	glm::vec3 aabbMin;//mesh space
+	glm::vec3 aabbMax;
+	glm::vec4 bound;//bounding sphere in mesh space, xyz:center, w:radius
+	uint32_t lodCount;//at least 1
+	LodRange lod[MaxLodCount];
+};
+
+//one node of an already packed MeshInput, what the mesh cache stores
+struct MeshNodeData {
+	int parentIndex;
+	int instanceOf;
+	MatrixInput matrix;
+	std::vector<BufferView> view;
 };
 
 struct MeshConstant {
 	alignas(16)glm::mat4 model;
+};
+
+//per draw entry of the draw data storage buffer, indexed by the draw's firstInstance
+struct DrawData {
+	MeshConstant mesh;
+	alignas(16)uint32_t materialIndex;
+	alignas(16)glm::vec4 positionOffset;//mesh space position = offset + quantized position * scale
+	alignas(16)glm::vec4 positionScale;
 };
\ No newline at end of file
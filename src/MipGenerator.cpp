@@ -0,0 +1,361 @@
+#include "MipGenerator.h"
+#include "SimdSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <iostream>
+
+namespace {
+	//8 bit rgb to the filtering space & back, srgb curve or identity
+	struct ColorTable {
+		float toLinear[256];
+		uint8_t fromLinear[4096];
+		explicit ColorTable(bool srgb) {
+			for (auto i = 0; i < 256; ++i) {
+				auto c = i / 255.0f;
+				toLinear[i] = !srgb ? c : c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			//4096 steps, every 8 bit value survives the round trip
+			for (auto i = 0; i < 4096; ++i) {
+				auto c = i / 4095.0f;
+				auto s = !srgb ? c : c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i] = static_cast<uint8_t>(std::min(255.0f, s * 255.0f + 0.5f));
+			}
+		}
+	};
+	const ColorTable& colorTable(bool srgb) {
+		static const ColorTable srgbTable(true);
+		static const ColorTable linearTable(false);
+		return srgb ? srgbTable : linearTable;
+	}
+
+	//weights of a 2:1 reduction, target texel x reads source texels 2x-2 .. 2x+3
+	constexpr int KaiserTap = 6;
+	struct KaiserKernel {
+		float weight[KaiserTap];
+		KaiserKernel() {
+			//modified bessel function of the first kind, order 0
+			auto bessel = [](float x) {
+				auto sum = 1.0f;
+				auto term = 1.0f;
+				for (auto k = 1; k < 16; ++k) {
+					term *= (x / (2.0f * k)) * (x / (2.0f * k));
+					sum += term;
+				}
+				return sum;
+			};
+			constexpr float Pi = 3.14159265f;
+			constexpr float Beta = 4.0f;
+			//half width of the window in target texels
+			constexpr float Radius = 1.5f;
+			auto total = 0.0f;
+			for (auto i = 0; i < KaiserTap; ++i) {
+				//distance to the target texel center in target texels, never 0
+				auto t = (i - 2.5f) * 0.5f;
+				auto ratio = t / Radius;
+				weight[i] = std::sin(Pi * t) / (Pi * t) * bessel(Beta * std::sqrt(1.0f - ratio * ratio)) / bessel(Beta);
+				total += weight[i];
+			}
+			for (auto& w : weight) {
+				w /= total;
+			}
+		}
+	};
+	const KaiserKernel& kaiserKernel() {
+		static const KaiserKernel kernel;
+		return kernel;
+	}
+
+	//rows of the level being reduced, texels are 4 linear floats
+	//level 0 is decoded one row at a time when read, a float copy of the whole input costs more than the filtering
+	class SourceRow {
+	private:
+		const float* level = nullptr;
+		const uint8_t* rgba = nullptr;
+		const ColorTable* table = nullptr;
+		mutable std::vector<float> decoded[2];
+	public:
+		uint32_t width;
+		uint32_t height;
+		SourceRow(const float* levelIn, uint32_t widthIn, uint32_t heightIn) : level(levelIn), width(widthIn), height(heightIn) {}
+		SourceRow(const uint8_t* rgbaIn, const ColorTable& tableIn, uint32_t widthIn, uint32_t heightIn)
+			: rgba(rgbaIn), table(&tableIn), width(widthIn), height(heightIn) {
+			decoded[0].resize(static_cast<size_t>(width) * 4);
+			decoded[1].resize(static_cast<size_t>(width) * 4);
+		}
+		//slot picks the row buffer, rows used together need distinct slots
+		const float* row(uint32_t y, uint32_t slot) const {
+			if (level) {
+				return level + static_cast<size_t>(y) * width * 4;
+			}
+			const auto* in = rgba + static_cast<size_t>(y) * width * 4;
+			auto* out = decoded[slot].data();
+			for (uint32_t i = 0; i < width * 4; i += 4) {
+				out[i + 0] = table->toLinear[in[i + 0]];
+				out[i + 1] = table->toLinear[in[i + 1]];
+				out[i + 2] = table->toLinear[in[i + 2]];
+				out[i + 3] = in[i + 3] * (1.0f / 255.0f);
+			}
+			return out;
+		}
+	};
+
+	//one level to the next, odd sizes clamp the footprint to the edge
+	using DownsampleKernel = void (*)(const SourceRow& src, float* dst, uint32_t dstWidth, uint32_t dstHeight, std::vector<float>& scratch);
+	using EncodeKernel = void (*)(const float* linear, size_t count, const ColorTable& table, uint8_t* rgba);
+
+	uint32_t clampTexel(int64_t index, uint32_t size) {
+		return static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(index, 0), size - 1));
+	}
+
+	void boxScalar(const SourceRow& src, float* dst, uint32_t dstWidth, uint32_t dstHeight, std::vector<float>&) {
+		for (uint32_t y = 0; y < dstHeight; ++y) {
+			const auto* row0 = src.row(clampTexel(y * 2, src.height), 0);
+			const auto* row1 = src.row(clampTexel(y * 2 + 1, src.height), 1);
+			auto* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth; ++x) {
+				auto c0 = clampTexel(x * 2, src.width) * 4;
+				auto c1 = clampTexel(x * 2 + 1, src.width) * 4;
+				for (auto c = 0; c < 4; ++c) {
+					out[x * 4 + c] = ((row0[c0 + c] + row0[c1 + c]) + (row1[c0 + c] + row1[c1 + c])) * 0.25f;
+				}
+			}
+		}
+	}
+
+	void kaiserScalar(const SourceRow& src, float* dst, uint32_t dstWidth, uint32_t dstHeight, std::vector<float>& scratch) {
+		const auto& kernel = kaiserKernel();
+		//horizontal pass into dstWidth x srcHeight, then vertical
+		scratch.resize(static_cast<size_t>(dstWidth) * src.height * 4);
+		for (uint32_t y = 0; y < src.height; ++y) {
+			const auto* row = src.row(y, 0);
+			auto* out = scratch.data() + static_cast<size_t>(y) * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth; ++x) {
+				float sum[4] = {};
+				for (auto i = 0; i < KaiserTap; ++i) {
+					const auto* texel = row + clampTexel(static_cast<int64_t>(x) * 2 - 2 + i, src.width) * 4;
+					for (auto c = 0; c < 4; ++c) {
+						sum[c] += kernel.weight[i] * texel[c];
+					}
+				}
+				memcpy(out + x * 4, sum, sizeof(sum));
+			}
+		}
+		for (uint32_t y = 0; y < dstHeight; ++y) {
+			const float* row[KaiserTap];
+			for (auto i = 0; i < KaiserTap; ++i) {
+				row[i] = scratch.data() + static_cast<size_t>(clampTexel(static_cast<int64_t>(y) * 2 - 2 + i, src.height)) * dstWidth * 4;
+			}
+			auto* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth * 4; ++x) {
+				auto sum = 0.0f;
+				for (auto i = 0; i < KaiserTap; ++i) {
+					sum += kernel.weight[i] * row[i][x];
+				}
+				out[x] = sum;
+			}
+		}
+	}
+
+	void encodeScalar(const float* linear, size_t count, const ColorTable& table, uint8_t* rgba) {
+		for (size_t i = 0; i < count; ++i) {
+			const auto* texel = linear + i * 4;
+			for (auto c = 0; c < 3; ++c) {
+				rgba[i * 4 + c] = table.fromLinear[static_cast<int>(std::min(1.0f, std::max(0.0f, texel[c])) * 4095.0f + 0.5f)];
+			}
+			//alpha is linear already
+			rgba[i * 4 + 3] = static_cast<uint8_t>(std::min(1.0f, std::max(0.0f, texel[3])) * 255.0f + 0.5f);
+		}
+	}
+
+#ifdef SIMD_SSE2
+	//one texel per register, same operation order as the scalar kernels so both give the same bits
+	void boxSse(const SourceRow& src, float* dst, uint32_t dstWidth, uint32_t dstHeight, std::vector<float>&) {
+		const auto quarter = _mm_set1_ps(0.25f);
+		for (uint32_t y = 0; y < dstHeight; ++y) {
+			const auto* row0 = src.row(clampTexel(y * 2, src.height), 0);
+			const auto* row1 = src.row(clampTexel(y * 2 + 1, src.height), 1);
+			auto* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth; ++x) {
+				auto c0 = clampTexel(x * 2, src.width) * 4;
+				auto c1 = clampTexel(x * 2 + 1, src.width) * 4;
+				auto top = _mm_add_ps(_mm_loadu_ps(row0 + c0), _mm_loadu_ps(row0 + c1));
+				auto bottom = _mm_add_ps(_mm_loadu_ps(row1 + c0), _mm_loadu_ps(row1 + c1));
+				_mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+			}
+		}
+	}
+
+	void kaiserSse(const SourceRow& src, float* dst, uint32_t dstWidth, uint32_t dstHeight, std::vector<float>& scratch) {
+		const auto& kernel = kaiserKernel();
+		__m128 weight[KaiserTap];
+		for (auto i = 0; i < KaiserTap; ++i) {
+			weight[i] = _mm_set1_ps(kernel.weight[i]);
+		}
+		scratch.resize(static_cast<size_t>(dstWidth) * src.height * 4);
+		for (uint32_t y = 0; y < src.height; ++y) {
+			const auto* row = src.row(y, 0);
+			auto* out = scratch.data() + static_cast<size_t>(y) * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth; ++x) {
+				auto sum = _mm_setzero_ps();
+				//the footprint only needs clamping near the edges
+				if (x > 0 && x * 2 + 3 < src.width) {
+					const auto* texel = row + (x * 2 - 2) * 4;
+					for (auto i = 0; i < KaiserTap; ++i) {
+						sum = _mm_add_ps(sum, _mm_mul_ps(weight[i], _mm_loadu_ps(texel + i * 4)));
+					}
+				}
+				else {
+					for (auto i = 0; i < KaiserTap; ++i) {
+						const auto* texel = row + clampTexel(static_cast<int64_t>(x) * 2 - 2 + i, src.width) * 4;
+						sum = _mm_add_ps(sum, _mm_mul_ps(weight[i], _mm_loadu_ps(texel)));
+					}
+				}
+				_mm_storeu_ps(out + x * 4, sum);
+			}
+		}
+		//every texel of a row uses the same 6 source rows, 4 floats at a time
+		for (uint32_t y = 0; y < dstHeight; ++y) {
+			const float* row[KaiserTap];
+			for (auto i = 0; i < KaiserTap; ++i) {
+				row[i] = scratch.data() + static_cast<size_t>(clampTexel(static_cast<int64_t>(y) * 2 - 2 + i, src.height)) * dstWidth * 4;
+			}
+			auto* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth * 4; x += 4) {
+				auto sum = _mm_setzero_ps();
+				for (auto i = 0; i < KaiserTap; ++i) {
+					sum = _mm_add_ps(sum, _mm_mul_ps(weight[i], _mm_loadu_ps(row[i] + x)));
+				}
+				_mm_storeu_ps(out + x, sum);
+			}
+		}
+	}
+
+	void encodeSse(const float* linear, size_t count, const ColorTable& table, uint8_t* rgba) {
+		const auto zero = _mm_setzero_ps();
+		const auto one = _mm_set1_ps(1.0f);
+		//rgb index the 4096 entry table, alpha goes straight to 0..255
+		const auto scale = _mm_setr_ps(4095.0f, 4095.0f, 4095.0f, 255.0f);
+		const auto half = _mm_set1_ps(0.5f);
+		alignas(16) int32_t index[4];
+		for (size_t i = 0; i < count; ++i) {
+			auto texel = _mm_min_ps(one, _mm_max_ps(zero, _mm_loadu_ps(linear + i * 4)));
+			_mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(texel, scale), half)));
+			rgba[i * 4 + 0] = table.fromLinear[index[0]];
+			rgba[i * 4 + 1] = table.fromLinear[index[1]];
+			rgba[i * 4 + 2] = table.fromLinear[index[2]];
+			rgba[i * 4 + 3] = static_cast<uint8_t>(index[3]);
+		}
+	}
+#endif
+
+	void buildChain(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levelCount, MipFilter filter, bool srgb,
+		DownsampleKernel box, DownsampleKernel kaiser, EncodeKernel encode,
+		std::vector<ImageLevel>& level, std::vector<uint8_t>& data) {
+		auto fullCount = fullMipLevelCount(width, height);
+		levelCount = levelCount == 0 ? fullCount : std::min(levelCount, fullCount);
+		level.resize(levelCount);
+		uint32_t size = 0;
+		for (uint32_t i = 0; i < levelCount; ++i) {
+			auto& current = level[i];
+			current.width = std::max(1u, width >> i);
+			current.height = std::max(1u, height >> i);
+			current.offset = size;
+			current.size = current.width * current.height * 4;
+			size += current.size;
+		}
+		data.resize(size);
+		memcpy(data.data(), rgba, level[0].size);
+		if (levelCount == 1) {
+			return;
+		}
+		const auto& table = colorTable(srgb);
+		std::vector<float> source;
+		std::vector<float> target(static_cast<size_t>(level[1].width) * level[1].height * 4);
+		std::vector<float> scratch;
+		auto downsample = filter == MipFilter::Kaiser ? kaiser : box;
+		for (uint32_t i = 1; i < levelCount; ++i) {
+			const auto& src = level[i - 1];
+			const auto& dst = level[i];
+			auto row = i == 1 ? SourceRow(rgba, table, src.width, src.height) : SourceRow(source.data(), src.width, src.height);
+			downsample(row, target.data(), dst.width, dst.height, scratch);
+			encode(target.data(), static_cast<size_t>(dst.width) * dst.height, table, data.data() + dst.offset);
+			std::swap(source, target);
+			target.resize(source.size());
+		}
+	}
+}
+
+uint32_t fullMipLevelCount(uint32_t width, uint32_t height) {
+	auto count = 1u;
+	while ((std::max(width, height) >> count) > 0) {
+		++count;
+	}
+	return count;
+}
+
+void generateMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levelCount, MipFilter filter, bool srgb,
+	std::vector<ImageLevel>& level, std::vector<uint8_t>& data) {
+#ifdef SIMD_SSE2
+	buildChain(rgba, width, height, levelCount, filter, srgb, boxSse, kaiserSse, encodeSse, level, data);
+#else
+	buildChain(rgba, width, height, levelCount, filter, srgb, boxScalar, kaiserScalar, encodeScalar, level, data);
+#endif
+}
+
+void generateMipChainScalar(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levelCount, MipFilter filter, bool srgb,
+	std::vector<ImageLevel>& level, std::vector<uint8_t>& data) {
+	buildChain(rgba, width, height, levelCount, filter, srgb, boxScalar, kaiserScalar, encodeScalar, level, data);
+}
+
+bool bakeMipChain(ImageInput& image, uint32_t levelCount, MipFilter filter) {
+	if (!image.isValid() || image.isBaked()) {
+		return false;
+	}
+	std::vector<ImageLevel> level;
+	std::vector<uint8_t> data;
+	generateMipChain(image.pixel(), static_cast<uint32_t>(image.getWidth()), static_cast<uint32_t>(image.getHeight()), levelCount, filter, image.isSrgb(), level, data);
+	image.setBaked(ImageFormat::Rgba8, std::move(level), std::move(data));
+	return true;
+}
+
+void benchmarkMipChain(uint32_t size) {
+	//noise over a gradient, no constant areas for the filters to skip through
+	std::mt19937 random(size);
+	std::uniform_int_distribution<int> noise(-32, 32);
+	std::vector<uint8_t> rgba(static_cast<size_t>(size) * size * 4);
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			auto* texel = rgba.data() + (static_cast<size_t>(y) * size + x) * 4;
+			texel[0] = static_cast<uint8_t>(std::min(255, std::max(0, static_cast<int>(x * 255 / size) + noise(random))));
+			texel[1] = static_cast<uint8_t>(std::min(255, std::max(0, static_cast<int>(y * 255 / size) + noise(random))));
+			texel[2] = static_cast<uint8_t>(std::min(255, std::max(0, 128 + noise(random))));
+			texel[3] = static_cast<uint8_t>(std::min(255, std::max(0, 224 + noise(random))));
+		}
+	}
+	//megapixels of the source level per second
+	auto megapixel = static_cast<float>(size) * size / 1000000.0f;
+	using Generator = void (*)(const uint8_t*, uint32_t, uint32_t, uint32_t, MipFilter, bool, std::vector<ImageLevel>&, std::vector<uint8_t>&);
+	constexpr int Repeat = 4;
+	auto measure = [&](Generator generator, MipFilter filter, std::vector<uint8_t>& data) {
+		std::vector<ImageLevel> level;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto n = 0; n < Repeat; ++n) {
+			generator(rgba.data(), size, size, 0, filter, true, level, data);
+		}
+		auto time = std::chrono::high_resolution_clock::now();
+		return megapixel * Repeat / std::chrono::duration<float>(time - start).count();
+	};
+	const MipFilter filterList[] = { MipFilter::Box, MipFilter::Kaiser };
+	const char* filterName[] = { "box", "kaiser" };
+	for (auto filter : filterList) {
+		std::vector<uint8_t> simdData, scalarData;
+		auto simdRate = measure(generateMipChain, filter, simdData);
+		auto scalarRate = measure(generateMipChainScalar, filter, scalarData);
+		std::cout << "mip chain " << size << "x" << size << " " << filterName[static_cast<uint32_t>(filter)]
+			<< ": simd " << simdRate << "MP/s, scalar " << scalarRate << "MP/s"
+			<< (simdData == scalarData ? "" : " (MISMATCH)") << std::endl;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "ImageInput.h"
+#include <vector>
+#include <cstdint>
+
+//cpu mip chain of an rgba8 image, the alternative to the gpu blit chain
+//rgb of an srgb image is filtered in linear space, linear images & alpha as is, the chain is kept in float between levels
+//so every level is rounded to 8 bit once
+
+enum class MipFilter : uint32_t {
+	Box = 0,//2x2 average
+	Kaiser = 1,//separable kaiser windowed sinc, 6 taps per axis, sharper than box
+};
+
+//levels down to 1x1
+uint32_t fullMipLevelCount(uint32_t width, uint32_t height);
+//levelCount 0 is the full chain, level 0 is the input copied as is
+//sse when available, levels are 8 bit rgba in the input's colour space packed one after another in data
+void generateMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levelCount, MipFilter filter, bool srgb,
+	std::vector<ImageLevel>& level, std::vector<uint8_t>& data);
+void generateMipChainScalar(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levelCount, MipFilter filter, bool srgb,
+	std::vector<ImageLevel>& level, std::vector<uint8_t>& data);
+//replaces a decoded image by its baked rgba8 chain, levelCount as above, the gpu then skips the blits
+//the image's colour space picks how rgb is filtered
+bool bakeMipChain(ImageInput& image, uint32_t levelCount, MipFilter filter);
+//builds the chain of a size x size image with both filters & both kernels, logs megapixels per second & whether they agree
+void benchmarkMipChain(uint32_t size);
@@ -8,17 +8,33 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include "tiny_gltf.h"
 #include "stb_image.h"
+#include "ThreadPool.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include <unordered_map>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
+//one primitive to decode into mesh[mesh].data[slot]
+struct GltfPrimitiveJob {
+	const tinygltf::Primitive* primitive;
+	uint32_t mesh;
+	uint32_t slot;
+};
+
 struct LoadingGltfData {
 	ModelLoadingInfo& info;
-	ModelImport::Offset& offset;
+	const ModelImport::Offset& offset;
 	std::vector<MeshData>& mesh;
+	std::vector<GltfPrimitiveJob>& job;
+	std::unordered_map<int, int>& meshInstance;//glTF mesh index -> first MeshData decoded from it
+	std::vector<std::vector<uint8_t>>& image;
 };
 
-//this function processes image data embeded in glb/gltf files,
-//which are loaded during model loading
+//this function receives image data embeded in glb/gltf files or read from their uri,
+//only the bytes are kept here, decoding runs on the worker threads once parsing is done
 bool LoadImageData(tinygltf::Image* image, const int image_idx, std::string* err,
 	std::string* warn, int req_width, int req_height,
 	const unsigned char* bytes, int size, void* userData) {
@@ -31,14 +47,29 @@ bool LoadImageData(tinygltf::Image* image, const int image_idx, std::string* err
 		return false;
 	}
 	auto* data = static_cast<LoadingGltfData*>(userData);
-	ImageInput imageInput;
-	//TODO where is the mipmap level info
-	imageInput.setMipLevel(1);
-	imageInput.loadRaw(bytes, size);
-	data->info.texture.addTexture(std::move(imageInput));
+	//bytes may point into a temporary buffer of the loader
+	if (data->image.size() <= static_cast<size_t>(image_idx)) {
+		data->image.resize(image_idx + 1);
+	}
+	data->image[image_idx].assign(bytes, bytes + size);
 	return true;
 }
 
+//transformed vertices before & after reordering, simulated with a VertexCacheSize fifo
+void logOptimizeStat(const char* name, const MeshOptimizeStat& stat) {
+	std::cout << name << " vertex cache(" << VertexCacheSize << "): acmr " << stat.before.acmr() << " -> " << stat.after.acmr()
+		<< ", atvr " << stat.before.atvr() << " -> " << stat.after.atvr() << std::endl;
+}
+
+//triangles of every level summed over the views having it
+void logLodStat(const char* name, const MeshLodStat& stat) {
+	std::cout << name << " lod triangles:";
+	for (uint32_t l = 0; l < MaxLodCount && stat.viewCount[l] > 0; ++l) {
+		std::cout << " " << stat.triangleCount[l] << "(" << stat.viewCount[l] << ")";
+	}
+	std::cout << std::endl;
+}
+
 bool stringEndsWith(const std::string& value, const std::string& suffix) {
 	//TODO case insensitive compare
 	if (value.length() >= suffix.length()) {
@@ -50,7 +81,7 @@ bool stringEndsWith(const std::string& value, const std::string& suffix) {
 ///
 /// obj format files are loaded as a single buffer, single bufferView mesh
 ///
-bool ModelImport::loadObj(const char* path, ModelLoadingInfo&& info, Offset&& offset) const {
+bool ModelImport::loadObj(const char* path, ModelLoadingInfo& info, const Offset& offset) const {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapeList;
 	std::vector<tinyobj::material_t> materialList;
@@ -105,6 +136,12 @@ bool ModelImport::loadObj(const char* path, ModelLoadingInfo&& info, Offset&& of
 			}
 		}
 		std::cout << data.vertices.size() << "|" << data.indices.size() << std::endl;
+		if (optimize) {
+			logOptimizeStat(shape.name.c_str(), optimizeMesh(data));
+		}
+		if (lod) {
+			logLodStat(shape.name.c_str(), generateLod(data));
+		}
 		meshData.data.push_back(std::move(data));
 	}
 	info.mesh.setMesh({ std::move(meshData) });
@@ -112,103 +149,115 @@ bool ModelImport::loadObj(const char* path, ModelLoadingInfo&& info, Offset&& of
 	return true;
 }
 
+//reads the accessor data of one primitive, only touches its own slot so primitives decode concurrently
+void decodeGltfPrimitive(const tinygltf::Model& model, const GltfPrimitiveJob& job, const LoadingGltfData& loadingData, VertexIndexed& data) {
+	const auto& primitive = *job.primitive;
+	//glTF seems to pack the same attribute values in a contiguous bufferview
+	//which is not a valid vertex array
+	//thus we need to fill our Vertex array, this comes with the benefit of selectively choosing the vertex attributes/types to use
+	const auto& accessorPos = model.accessors[primitive.attributes.at("POSITION")];
+	const auto& bufferViewPos = model.bufferViews[accessorPos.bufferView];
+	const float* pos = reinterpret_cast<const float*>(&model.buffers[bufferViewPos.buffer].data[accessorPos.byteOffset + bufferViewPos.byteOffset]);
+
+	const auto& accessorIndices = model.accessors[primitive.indices];
+	const auto& bufferViewIndices = model.bufferViews[accessorIndices.bufferView];
+	const void* indices = &model.buffers[bufferViewIndices.buffer].data[accessorIndices.byteOffset + bufferViewIndices.byteOffset];
+
+	const auto& texcoord0Iter = primitive.attributes.find("TEXCOORD_0");
+	const float* texcoord0 = nullptr;
+	if (texcoord0Iter != primitive.attributes.end()) {
+		const auto& accessorTexcoord0 = model.accessors[texcoord0Iter->second];
+		const auto& bufferViewTexcoord0 = model.bufferViews[accessorTexcoord0.bufferView];
+		texcoord0 = reinterpret_cast<const float*>(&model.buffers[bufferViewTexcoord0.buffer].data[accessorTexcoord0.byteOffset + bufferViewTexcoord0.byteOffset]);
+	}
+
+	const auto& normalIter = primitive.attributes.find("NORMAL");
+	const float* normal = nullptr;
+	if (normalIter != primitive.attributes.end()) {
+		const auto& accessorNormal = model.accessors[normalIter->second];
+		const auto& bufferViewNormal = model.bufferViews[accessorNormal.bufferView];
+		normal = reinterpret_cast<const float*>(&model.buffers[bufferViewNormal.buffer].data[accessorNormal.byteOffset + bufferViewNormal.byteOffset]);
+	}
+
+	data.vertices.reserve(accessorPos.count);
+	for (auto i = 0; i < accessorPos.count; ++i) {
+		Vertex vertex;
+		vertex.pos = glm::make_vec3(reinterpret_cast<const float*>(pos + i * 3)) / loadingData.info.scale;
+		if (texcoord0) {
+			vertex.texCoord = glm::make_vec2(texcoord0 + i * 2);
+		}
+		if (normal) {
+			vertex.normal = glm::make_vec3(normal + i * 3);
+		}
+		data.vertices.push_back(std::move(vertex));
+	}
+
+	//index type was checked when the job was collected
+	switch (accessorIndices.componentType)
+	{
+	//widened here, MeshInput packs them back to the narrowest type the vertex count allows
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+		const auto* indices8 = static_cast<const uint8_t*>(indices);
+		data.indices.assign(indices8, indices8 + accessorIndices.count);
+		break;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+		const auto* indices16 = static_cast<const uint16_t*>(indices);
+		data.indices.assign(indices16, indices16 + accessorIndices.count);
+		break;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+		data.indices.resize(accessorIndices.count);
+		memcpy(data.indices.data(), indices, accessorIndices.count * sizeof(uint32_t));
+		break;
+	}
+	}
+	if (primitive.material > -1) {
+		data.material = primitive.material + loadingData.offset.material;
+	}
+	else {
+		data.material = -1;
+	}
+	if (normal == nullptr) {
+		loadingData.info.mesh.calculateNormal(data);
+	}
+}
+
+//first phase only reserves a slot per primitive, decoding happens once the whole tree is walked
 bool loadGltfNodeMesh(const tinygltf::Model& model, const tinygltf::Node& node, MatrixInput&& matrix, const int* parentIndex, LoadingGltfData& loadingData) {
 	const auto& mesh = model.meshes[node.mesh];
 	MeshData meshData;
-	meshData.data.reserve(mesh.primitives.size());
 	meshData.matrix = matrix;
 	meshData.parentIndex = parentIndex ? *parentIndex : -1;
+	auto meshIndex = static_cast<uint32_t>(loadingData.mesh.size());
+	auto instance = loadingData.meshInstance.find(node.mesh);
+	if (instance != loadingData.meshInstance.end()) {
+		//nodes sharing a mesh only differ by transform, decoded & uploaded once
+		meshData.instanceOf = instance->second;
+		std::cout << "instance of " << instance->second << "\n";
+		loadingData.mesh.push_back(std::move(meshData));
+		return true;
+	}
+	loadingData.meshInstance[node.mesh] = static_cast<int>(meshIndex);
+	uint32_t slot = 0;
 	for (const auto& primitive : mesh.primitives) {
 		//TODO support for mesh without indices
 		if (primitive.indices < 0) continue;
-		//glTF seems to pack the same attribute values in a contiguous bufferview
-		//which is not a valid vertex array
-		//thus we need to fill our Vertex array, this comes with the benefit of selectively choosing the vertex attributes/types to use
-		const auto& posIter = primitive.attributes.find("POSITION");
 		//position data is required
-		if (posIter == primitive.attributes.end()) {
+		if (primitive.attributes.find("POSITION") == primitive.attributes.end()) {
 			continue;
 		}
-		const auto& accessorPos = model.accessors[posIter->second];
-		const auto& bufferViewPos = model.bufferViews[accessorPos.bufferView];
-		const float* pos = reinterpret_cast<const float*>(&model.buffers[bufferViewPos.buffer].data[accessorPos.byteOffset + bufferViewPos.byteOffset]);
-		
-		const auto& accessorIndices = model.accessors[primitive.indices];
-		const auto& bufferViewIndices = model.bufferViews[accessorIndices.bufferView];
-		const void* indices = &model.buffers[bufferViewIndices.buffer].data[accessorIndices.byteOffset + bufferViewIndices.byteOffset];
-
-		const auto& texcoord0Iter = primitive.attributes.find("TEXCOORD_0");
-		const float* texcoord0 = nullptr;
-		if (texcoord0Iter != primitive.attributes.end()) {
-			const auto& accessorTexcoord0 = model.accessors[texcoord0Iter->second];
-			const auto& bufferViewTexcoord0 = model.bufferViews[accessorTexcoord0.bufferView];
-			texcoord0 = reinterpret_cast<const float*>(&model.buffers[bufferViewTexcoord0.buffer].data[accessorTexcoord0.byteOffset + bufferViewTexcoord0.byteOffset]);
-		}
-
-		const auto& normalIter = primitive.attributes.find("NORMAL");
-		const float* normal = nullptr;
-		if (normalIter != primitive.attributes.end()) {
-			const auto& accessorNormal = model.accessors[normalIter->second];
-			const auto& bufferViewNormal = model.bufferViews[accessorNormal.bufferView];
-			normal = reinterpret_cast<const float*>(&model.buffers[bufferViewNormal.buffer].data[accessorNormal.byteOffset + bufferViewNormal.byteOffset]);
-		}
-		
-		VertexIndexed data;
-		data.vertices.reserve(accessorPos.count);
-		for (auto i = 0; i < accessorPos.count; ++i) {
-			Vertex vertex;
-			vertex.pos = glm::make_vec3(reinterpret_cast<const float*>(pos + i * 3)) / loadingData.info.scale;
-			if (texcoord0) {
-				vertex.texCoord = glm::make_vec2(texcoord0 + i * 2);
-			}
-			if (normal) {
-				vertex.normal = glm::make_vec3(normal + i * 3);
-			}
-			data.vertices.push_back(std::move(vertex));
-		}
-
-		switch (accessorIndices.componentType)
-		{
-		case TINYGLTF_COMPONENT_TYPE_BYTE: {
-			const auto* indices8 = static_cast<const uint8_t*>(indices);
-			for (auto i = 0; i < accessorIndices.count; ++i) {
-				data.indices.push_back(indices8[i]);
-			}
-			break;
-		}
-		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
-			//we know vertex data now uses uint16_t, copy directly
-			//TODO adaptive?
-			data.indices.resize(accessorIndices.count);
-			memcpy(data.indices.data(), indices, accessorIndices.count * sizeof(uint16_t));
-			break;
-		}
-		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
-			//TODO check if 32bit index is really needed?
-			const auto* indices32 = static_cast<const uint32_t*>(indices);
-			for (auto i = 0; i < accessorIndices.count; ++i) {
-				data.indices.push_back(indices32[i]);
-			}
-			break;
-		}
-		default:
-			std::cout << "unsupported index type: " << accessorIndices.componentType << std::endl;
-			break;
-		}
-		if (primitive.material > -1) {
-			data.material = primitive.material + loadingData.offset.material;
-		}
-		else {
-			data.material = -1;
-		}
-		std::cout << data.vertices.size() << "|" << data.indices.size() << "|" << data.material;
-		if (normal == nullptr) {
-			std::cout << "|NoNormal";
-			loadingData.info.mesh.calculateNormal(data);
+		auto indexType = model.accessors[primitive.indices].componentType;
+		if (indexType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE &&
+			indexType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT &&
+			indexType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
+			std::cout << "unsupported index type: " << indexType << std::endl;
+			continue;
 		}
-		std::cout << "\n";
-		meshData.data.push_back(std::move(data));
+		loadingData.job.push_back({ &primitive, meshIndex, slot++ });
 	}
+	meshData.data.resize(slot);
+	std::cout << slot << " primitive(s)\n";
 	loadingData.mesh.push_back(std::move(meshData));
 	return true;
 }
@@ -243,7 +292,6 @@ bool loadGltfNode(const tinygltf::Model& model, const int nodeIndex, const int*
 	};
 	std::cout << nodeIndex << ":" << node.name << " ";
 	if (node.mesh > -1) {
-		//TODO point to existing mesh data
 		std::cout << node.mesh << "|";
 		loadGltfNodeMesh(model, node, std::move(matrix), parentIndex, loadingData);
 	}
@@ -266,7 +314,12 @@ bool loadGltfNode(const tinygltf::Model& model, const int nodeIndex, const int*
 	return true;
 }
 
-void loadGltfMaterial(const tinygltf::Material& mat, ModelLoadingInfo& info, ModelImport::Offset& offset) {
+void loadGltfMaterial(const tinygltf::Model& model, const tinygltf::Material& mat, ModelLoadingInfo& info, const ModelImport::Offset& offset) {
+	//materials reference textures, texture slots follow the image order
+	auto textureIndex = [&](int texture) {
+		auto source = model.textures[texture].source;
+		return static_cast<uint16_t>(std::max(0, source) + offset.texture);
+	};
 	MaterialInput material;
 	//PBR material
 	const auto& pbr = mat.pbrMetallicRoughness;
@@ -274,29 +327,31 @@ void loadGltfMaterial(const tinygltf::Material& mat, ModelLoadingInfo& info, Mod
 	material.addValueEntry(glm::vec4{ pbr.metallicFactor, 0.0f, 0.0f, 0.0f });
 	//TODO sampler states
 	if (pbr.baseColorTexture.index > -1) {
-		material.addTextureEntry(mat.pbrMetallicRoughness.baseColorTexture.index + offset.texture);
+		material.addTextureEntry(textureIndex(pbr.baseColorTexture.index), TextureSlot::BaseColor);
 	}
 	if (pbr.metallicRoughnessTexture.index > -1) {
 		//gltf spec specifies metalness in B channel & roughness in G channel
-		material.addTextureEntry(mat.pbrMetallicRoughness.metallicRoughnessTexture.index + offset.texture);
+		material.addTextureEntry(textureIndex(pbr.metallicRoughnessTexture.index), TextureSlot::MetallicRoughness);
 	}
 	if (mat.normalTexture.index > -1) {
-		material.addTextureEntry(mat.normalTexture.index + offset.texture);
+		material.addTextureEntry(textureIndex(mat.normalTexture.index), TextureSlot::Normal);
 	}
 	if (mat.emissiveTexture.index > -1) {
-		material.addTextureEntry(mat.emissiveTexture.index + offset.texture);
+		material.addTextureEntry(textureIndex(mat.emissiveTexture.index), TextureSlot::Emissive);
 	}
 	if (mat.occlusionTexture.index > -1) {
-		material.addTextureEntry(mat.occlusionTexture.index + offset.texture);
+		material.addTextureEntry(textureIndex(mat.occlusionTexture.index), TextureSlot::Occlusion);
 	}
 	info.material.addMaterial(std::move(material));
 }
 
-bool ModelImport::loadGltf(const std::string& path, const bool isBinary, ModelLoadingInfo&& info, Offset&& offset) const {
+bool ModelImport::loadGltf(const std::string& path, const bool isBinary, ModelLoadingInfo& info, const Offset& offset, std::vector<std::vector<uint8_t>>& image) const {
 	tinygltf::Model model;
 	tinygltf::TinyGLTF loader;//TODO should this be reused?
 	std::vector<MeshData> meshDataList;
-	LoadingGltfData loadingData{ info, offset, meshDataList };
+	std::vector<GltfPrimitiveJob> jobList;
+	std::unordered_map<int, int> meshInstance;
+	LoadingGltfData loadingData{ info, offset, meshDataList, jobList, meshInstance, image };
 	loader.SetImageLoader(LoadImageData, &loadingData);
 	std::string warning, error;
 	bool loadResult;
@@ -313,9 +368,15 @@ bool ModelImport::loadGltf(const std::string& path, const bool isBinary, ModelLo
 	if (!warning.empty()) {
 		std::cout << warning << std::endl;
 	}
+	//every image gets its slot now, in image order, so material indices hold whatever order the decoding finishes in
+	image.resize(model.images.size());
+	auto firstTexture = info.texture.reserve(image.size());
 	for (const auto& mat : model.materials) {
-		loadGltfMaterial(mat, info, offset);
+		loadGltfMaterial(model, mat, info, offset);
 	}
+	//normal, metallic roughness & occlusion maps are baked & sampled as linear data
+	auto imageSrgb = textureSrgb(info.material.getMaterialList().data() + offset.material, info.material.count() - offset.material,
+		firstTexture, image.size());
 	std::cout << "scene count = " << model.scenes.size() << " default = " << model.defaultScene << std::endl;
 	auto sceneIndex = model.defaultScene > -1 ? model.defaultScene : 0;
 	tinygltf::Scene scene = model.scenes[sceneIndex];
@@ -326,27 +387,116 @@ bool ModelImport::loadGltf(const std::string& path, const bool isBinary, ModelLo
 			return false;
 		}
 	}
+	std::cout << std::endl;
+
+	//slots were reserved in traversal order, the result does not depend on which worker decodes what
+	//images go first in the same job, they are the longest tasks
+	ThreadPool decodeThread;
+	decodeThread.create(threadCount);
+	auto imageCount = static_cast<uint32_t>(image.size());
+	std::vector<uint8_t> imageLoaded(imageCount, 0);
+	std::vector<MeshOptimizeStat> jobStat(jobList.size());
+	std::vector<MeshLodStat> jobLodStat(jobList.size());
+	auto start = std::chrono::high_resolution_clock::now();
+	decodeThread.run(imageCount + static_cast<uint32_t>(jobList.size()), [&](uint32_t, uint32_t task) {
+		if (task < imageCount) {
+			const auto& bytes = image[task];
+			imageLoaded[task] = !bytes.empty() && info.texture.loadEncoded(firstTexture + task, bytes.data(), bytes.size(), imageSrgb[task] != 0);
+			return;
+		}
+		const auto& job = jobList[task - imageCount];
+		auto& data = meshDataList[job.mesh].data[job.slot];
+		decodeGltfPrimitive(model, job, loadingData, data);
+		if (optimize) {
+			jobStat[task - imageCount] = optimizeMesh(data);
+		}
+		//levels come after the reordering, they index the reordered vertices
+		if (lod) {
+			jobLodStat[task - imageCount] = generateLod(data);
+		}
+	});
+	auto time = std::chrono::high_resolution_clock::now();
+	decodeThread.destroy();
+	for (uint32_t i = 0; i < imageCount; ++i) {
+		if (!imageLoaded[i]) {
+			std::cout << "image " << i << " of " << path << " not decoded" << std::endl;
+		}
+	}
+	MeshOptimizeStat total;
+	MeshLodStat lodTotal;
+	for (size_t i = 0; i < jobList.size(); ++i) {
+		const auto& job = jobList[i];
+		const auto& data = meshDataList[job.mesh].data[job.slot];
+		std::cout << job.mesh << ":" << job.slot << "|" << data.vertices.size() << "|" << data.indices.size() << "|" << data.material << "\n";
+		total.before += jobStat[i].before;
+		total.after += jobStat[i].after;
+		lodTotal += jobLodStat[i];
+	}
+	if (optimize) {
+		logOptimizeStat(path.c_str(), total);
+	}
+	if (lod) {
+		logLodStat(path.c_str(), lodTotal);
+	}
+	std::cout << imageCount << " images & " << jobList.size() << " primitives decoded on " << std::max(1u, threadCount) << " thread(s) in "
+		<< std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count() << "ms" << std::endl;
 	info.mesh.setMesh(std::move(meshDataList));
 	std::cout << std::endl;
 	return true;
 }
 
+void ModelImport::setThreadCount(uint32_t count) noexcept {
+	threadCount = count;
+}
+
+void ModelImport::setCacheEnabled(bool value) noexcept {
+	useCache = value;
+}
+
+void ModelImport::setOptimizeEnabled(bool value) noexcept {
+	optimize = value;
+}
+
+void ModelImport::setLodEnabled(bool value) noexcept {
+	lod = value;
+}
+
+void ModelImport::setVertexFormat(VertexFormat format) noexcept {
+	vertexFormat = format;
+}
+
+uint32_t ModelImport::option() const noexcept {
+	return (optimize ? OptimizeOption : 0) | (lod ? LodOption : 0) | (vertexFormat == VertexFormat::Packed ? PackedVertexOption : 0);
+}
+
 bool ModelImport::load(const std::string& path, ModelLoadingInfo&& info) const {
 	//index offset for texture & material
 	Offset offset{
 		info.texture.count(),
 		info.material.count()
 	};
+	info.mesh.setVertexFormat(vertexFormat);
+	if (useCache && loadMeshCache(path, info, offset, option(), threadCount)) {
+		return true;
+	}
 	//load dispatch by extension
+	std::vector<std::vector<uint8_t>> image;
+	bool loaded;
 	if (stringEndsWith(path, ".obj")) {
-		return loadObj(path.c_str(), std::move(info), std::move(offset));
+		loaded = loadObj(path.c_str(), info, offset);
 	}
-	if (stringEndsWith(path, ".gltf")) {
-		return loadGltf(path, false, std::move(info), std::move(offset));
+	else if (stringEndsWith(path, ".gltf")) {
+		loaded = loadGltf(path, false, info, offset, image);
 	}
-	if (stringEndsWith(path, ".glb")) {
-		return loadGltf(path, true, std::move(info), std::move(offset));
+	else if (stringEndsWith(path, ".glb")) {
+		loaded = loadGltf(path, true, info, offset, image);
 	}
-	std::cout << "unknown format" << std::endl;
-	return false;
+	else {
+		std::cout << "unknown format" << std::endl;
+		return false;
+	}
+	if (loaded && useCache && !saveMeshCache(path, info, offset, option(), image)) {
+		std::cout << "mesh cache of " << path << " not written" << std::endl;
+	}
+	return loaded;
 }
\ No newline at end of file
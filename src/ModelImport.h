@@ -3,6 +3,8 @@
 #include "MaterialManager.h"
 #include "TextureManager.h"
 #include <string>
+#include <cstdint>
+#include <vector>
 
 struct ModelLoadingInfo{
 	const float scale;
@@ -14,14 +16,40 @@ struct ModelLoadingInfo{
 class ModelImport
 {
 public:
+	//bump whenever the imported result changes, cached imports of older versions are rebuilt
+	static constexpr uint32_t Version = 2;
 	struct Offset {
 		const int texture;
 		const int material;
 	};
+	//import options changing the result, part of the mesh cache key
+	enum Option : uint32_t {
+		OptimizeOption = 1,
+		LodOption = 2,
+		PackedVertexOption = 4,
+	};
 private:
-	bool loadObj(const char* path, ModelLoadingInfo&& info, Offset&& offset) const;
-	bool loadGltf(const std::string& path, const bool isBinary, ModelLoadingInfo&& info, Offset&& offset) const;
+	//0 decodes on the calling thread
+	uint32_t threadCount = 0;
+	bool useCache = true;
+	bool optimize = true;
+	bool lod = true;
+	VertexFormat vertexFormat = VertexFormat::Float;
+	uint32_t option() const noexcept;
+	bool loadObj(const char* path, ModelLoadingInfo& info, const Offset& offset) const;
+	//image receives the encoded images, kept for the mesh cache
+	bool loadGltf(const std::string& path, const bool isBinary, ModelLoadingInfo& info, const Offset& offset, std::vector<std::vector<uint8_t>>& image) const;
 public:
+	//workers decoding glTF images & primitives
+	void setThreadCount(uint32_t count) noexcept;
+	//reads & writes <path>.vpmesh, see MeshCache.h
+	void setCacheEnabled(bool value) noexcept;
+	//vertex cache, overdraw & vertex fetch reordering of every primitive, see MeshOptimizer.h
+	void setOptimizeEnabled(bool value) noexcept;
+	//simplified index ranges of every primitive for distant draws, see MeshSimplifier.h
+	void setLodEnabled(bool value) noexcept;
+	//layout the vertices are stored in, the pipeline drawing them has to use the same, see VertexPacking.h
+	void setVertexFormat(VertexFormat format) noexcept;
 	bool load(const std::string& path, ModelLoadingInfo&& info) const;
 };
 
@@ -8,6 +8,7 @@
 #include "ImageInput.h"
 #include "MaterialManager.h"
 #include "TextureManager.h"
+#include <cmath>
 
 void RenderingData::updateProjection() {
 	matrixData.proj = glm::perspective(glm::radians(cameraFov), windowAspectRatio, 0.05f, 10.0f);
@@ -72,7 +73,8 @@ const LightUniformBufferData& RenderingData::getLightUniform() const {
 void RenderingData::setRenderListFiltered(std::vector<MeshRenderData>&& list, const MaterialManager& materialManager, const TextureManager& textureManager) {
 	renderList.clear();
 	renderList.reserve(list.size());
-	//TODO filter/culling
+	++renderListVersion;
+	//frustum culling runs per frame, on the cpu in updateVisibleDraw (cpu_culling) or on the gpu (gpu_culling)
 	for (const auto& input : list) {
 		if (!input.mesh->isEnabled()) continue;
 		renderList.push_back(input.mesh);
@@ -91,6 +93,93 @@ const std::vector<const MeshInput*>& RenderingData::getRenderList() const {
 	return renderList;
 }
 
+uint32_t RenderingData::getRenderListVersion() const {
+	return renderListVersion;
+}
+
+void RenderingData::updateVisibleDraw() {
+	size_t drawCount = 0;
+	for (const auto* input : renderList) {
+		for (const auto& mesh : input->getMeshList()) {
+			drawCount += mesh.getView().size();
+		}
+	}
+	cullBox.resize(drawCount);
+	size_t index = 0;
+	for (const auto* input : renderList) {
+		for (const auto& mesh : input->getMeshList()) {
+			const auto& model = mesh.getConstantData().model;
+			for (const auto& view : mesh.getView()) {
+				glm::vec3 min, max;
+				transformAabb(model, view.aabbMin, view.aabbMax, min, max);
+				cullBox.set(index++, min, max);
+			}
+		}
+	}
+	std::swap(visibleDraw, visibleDrawLast);
+	visibleDraw.clear();
+	cullAabb(makeFrustum(matrixData.proj * matrixData.view), cullBox, visibleDraw);
+	if (visibleDraw != visibleDrawLast) {
+		++visibleVersion;
+	}
+}
+
+const std::vector<uint32_t>& RenderingData::getVisibleDraw() const {
+	return visibleDraw;
+}
+
+uint32_t RenderingData::getVisibleVersion() const {
+	return visibleVersion;
+}
+
+void RenderingData::setViewportHeight(const float height) {
+	viewportHeight = height;
+}
+
+void RenderingData::setLodThreshold(const float pixel) {
+	lodThreshold = pixel;
+}
+
+void RenderingData::updateDrawLod() {
+	std::swap(drawLod, drawLodLast);
+	drawLod.clear();
+	//pixels covered by one unit at distance one
+	auto pixelScale = std::abs(matrixData.proj[1][1]) * 0.5f * viewportHeight;
+	for (const auto* input : renderList) {
+		for (const auto& mesh : input->getMeshList()) {
+			const auto& model = mesh.getConstantData().model;
+			for (const auto& view : mesh.getView()) {
+				uint8_t lod = 0;
+				if (lodThreshold > 0.0f && view.lodCount > 1) {
+					auto sphere = transformSphere(model, view.bound);
+					//nearest point of the bound, a camera inside it keeps the full mesh
+					auto distance = glm::length(glm::vec3(sphere) - cameraPos) - sphere.w;
+					if (distance > 0.0f) {
+						//the mesh space error scales like the bound's radius
+						auto scale = view.bound.w > 0.0f ? sphere.w / view.bound.w : 1.0f;
+						auto pixelPerError = scale * pixelScale / distance;
+						while (lod + 1u < view.lodCount && view.lod[lod + 1].error * pixelPerError <= lodThreshold) {
+							++lod;
+						}
+					}
+				}
+				drawLod.push_back(lod);
+			}
+		}
+	}
+	if (drawLod != drawLodLast) {
+		++lodVersion;
+	}
+}
+
+const std::vector<uint8_t>& RenderingData::getDrawLod() const {
+	return drawLod;
+}
+
+uint32_t RenderingData::getLodVersion() const {
+	return lodVersion;
+}
+
 const std::unordered_set<const MaterialPrototype*>& RenderingData::getPrototypeList() const {
 	return prototypeList;
 }
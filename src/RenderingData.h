@@ -1,5 +1,6 @@
 #pragma once
 #include "glm.hpp"
+#include "Culling.h"
 #include <vector>
 #include <unordered_set>
 
@@ -53,6 +54,18 @@ private:
 	std::unordered_set<const MaterialPrototype*> prototypeList;
 	std::unordered_set<const ImageInput*> textureList;
 	std::vector<Light> lightList;
+	uint32_t renderListVersion = 0;
+	//cpu culling, draws are flattened in render list -> mesh -> view order like the vertex/index buffers
+	AabbSoA cullBox;
+	std::vector<uint32_t> visibleDraw;
+	std::vector<uint32_t> visibleDrawLast;
+	uint32_t visibleVersion = 0;
+	//lod per draw in the same order, picked from the projected error of each level
+	float viewportHeight = 1.0f;
+	float lodThreshold = 0.0f;
+	std::vector<uint8_t> drawLod;
+	std::vector<uint8_t> drawLodLast;
+	uint32_t lodVersion = 0;
 		
 	void updateProjection();
 	void updateView();
@@ -70,6 +83,22 @@ public:
 	const LightUniformBufferData& getLightUniform() const;
 	void setRenderListFiltered(std::vector<MeshRenderData>&& list, const MaterialManager& materialManager, const TextureManager& textureManager);
 	const std::vector<const MeshInput*>& getRenderList() const;
+	//changes whenever the render list is rebuilt, recorded draws are stale after that
+	uint32_t getRenderListVersion() const;
+	//culls every draw of the render list against the current camera, called once per frame
+	void updateVisibleDraw();
+	const std::vector<uint32_t>& getVisibleDraw() const;
+	//changes only when the visible set does
+	uint32_t getVisibleVersion() const;
+	void setViewportHeight(const float height);
+	//on screen error in pixels a coarser level may have, 0 keeps every draw at full detail
+	void setLodThreshold(const float pixel);
+	//picks the coarsest level of every draw whose error stays under the threshold, called once per frame
+	void updateDrawLod();
+	//per draw in render list order, empty before the first update
+	const std::vector<uint8_t>& getDrawLod() const;
+	//changes only when a draw switches level
+	uint32_t getLodVersion() const;
 	const std::unordered_set<const MaterialPrototype*>& getPrototypeList() const;
 	const std::unordered_set<const ImageInput*>& getTextureList() const;
 };
@@ -3,6 +3,8 @@
 #include "ShaderInput.h"
 #include "DebugHelper.hpp"
 #include "MeshNode.h"
+#include "Culling.h"
+#include "MipGenerator.h"
 #include <iostream>
 #include <fstream>
 #include <chrono>
@@ -18,6 +20,7 @@ void onFramebufferResize(GLFWwindow* window, int width, int height) {
 	renderContext->vulkanEnv->getSwapchain().onFramebufferResize();
 	if (height > 0) {
 		renderContext->renderingData->setAspectRatio(width / (float)height);
+		renderContext->renderingData->setViewportHeight(static_cast<float>(height));
 	}
 }
 
@@ -60,6 +63,18 @@ void onKeyPressed(GLFWwindow* window, int key, int scancode, int action, int mod
 			option.z = std::min(1.0f, option.z + 0.1f);
 			std::cout << "roughness=" << option.z << std::endl;
 		}
+		//cpu culling microbenchmark
+		if (key == GLFW_KEY_B) {
+			benchmarkCull(100000);
+		}
+		//cpu mip chain microbenchmark
+		if (key == GLFW_KEY_V) {
+			benchmarkMipChain(2048);
+		}
+		//gpu culling of the next frame against the cpu reference
+		if (key == GLFW_KEY_C) {
+			renderContext->vulkanEnv->requestCullCheck();
+		}
 		//debug only, alway update
 		renderContext->vulkanEnv->updateUniformBuffer();
 	}
@@ -114,6 +129,15 @@ void onKeyPressed(GLFWwindow* window, int key, int scancode, int action, int mod
 	 inputCube.setMesh(std::move(cube));
 	 MeshInput inputLoadedModel{ { 0.0f, 0.0f, 0.0f }, glm::quat({0.0f, glm::radians(-45.0f), glm::radians(180.0f)}), {1.0f, 1.0f, 1.0f} };
 	 ModelImport modelImport;
+	 modelImport.setThreadCount(std::max(0, input.importThreadCount));
+	 modelImport.setCacheEnabled(input.meshCache);
+	 modelImport.setOptimizeEnabled(input.meshOptimize);
+	 modelImport.setLodEnabled(input.meshLod);
+	 modelImport.setVertexFormat(input.packedVertex ? VertexFormat::Packed : VertexFormat::Float);
+	 textureManager.getCache().setEnabled(input.textureCache);
+	 textureManager.getCache().setCompression(input.textureCompression);
+	 textureManager.getCache().setCpuMipmap(input.cpuMipmap);
+	 textureManager.getCache().setMipFilter(input.kaiserMipFilter ? MipFilter::Kaiser : MipFilter::Box);
 	 logResult("model loading", modelImport.load(input.modelPath, { 1.5, inputLoadedModel, textureManager, materialManager }));
 	 //meshManager.addMesh(std::move(inputTetrahedron));
 	 //meshManager.addMesh(std::move(inputCube));
@@ -147,20 +171,37 @@ int RenderingTest::mainLoop() {
 	//create a test texture, with runtime generated mipmap
 	ImageInput defaultTexture;
 	defaultTexture.setPreserved(true);
-	defaultTexture.setMipLevel(3);
 	//texture loading test
 	logResult("texture loading", defaultTexture.load(setting.misc.texturePath));
+	//level count depends on the loaded size
+	defaultTexture.setMipLevel(3);
+	if (setting.misc.cpuMipmap) {
+		bakeMipChain(defaultTexture, defaultTexture.getMipLevel(), setting.misc.kaiserMipFilter ? MipFilter::Kaiser : MipFilter::Box);
+	}
 	textureManager.addTexture(std::move(defaultTexture));
 	//defaut shaders
-	ShaderInput defaultShader(setting.misc.vertexShaderPath, setting.misc.fragmentShaderPath);
+	ShaderInput defaultShader(setting.misc.packedVertex ? setting.misc.packedVertexShaderPath : setting.misc.vertexShaderPath, setting.misc.fragmentShaderPath);
 	shaderManager.addShader(std::move(defaultShader));
+	int cullShaderIndex = -1;
+	if (graphicsSetting.GpuCulling) {
+		cullShaderIndex = static_cast<int>(shaderManager.count());
+		shaderManager.addShader(ShaderInput(setting.misc.cullShaderPath));
+	}
+	int depthShaderIndex = -1;
+	if (graphicsSetting.DepthPrepass) {
+		//vertex only
+		depthShaderIndex = static_cast<int>(shaderManager.count());
+		shaderManager.addShader(ShaderInput(setting.misc.packedVertex ? setting.misc.packedDepthShaderPath : setting.misc.depthShaderPath, std::string()));
+	}
 	//default material(s)
 	MaterialInput defaultMaterial;
-	defaultMaterial.addTextureEntry(0);
+	defaultMaterial.addTextureEntry(0, TextureSlot::BaseColor);
 	materialManager.addMaterial(std::move(defaultMaterial));
 
 	prepareModel(setting.misc);
 	renderingData.updateCamera(45.0f, WIDTH / (float)HEIGHT, glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+	renderingData.setViewportHeight(static_cast<float>(HEIGHT));
+	renderingData.setLodThreshold(graphicsSetting.LodThreshold);
 	renderingData.addLight({ LightType::Point, 1.0f, 5.0f, glm::vec3(4.0f, -4.0f, 4.0f) });
 	renderingData.updateLight();
 	renderingData.setDebugOption({ 0.0f, 1.0f, 0.1f, 0.0f });
@@ -173,6 +214,14 @@ int RenderingTest::mainLoop() {
 
 	vulkanEnv.setRenderingData(renderingData);
 	vulkanEnv.setRenderingManager(materialManager, shaderManager);
+	vulkanEnv.setRecordThreadCount(std::max(0, graphicsSetting.RecordThreadCount));
+	vulkanEnv.setIndirectDraw(graphicsSetting.IndirectDraw);
+	vulkanEnv.setGpuCulling(graphicsSetting.GpuCulling, cullShaderIndex);
+	vulkanEnv.setCpuCulling(graphicsSetting.CpuCulling);
+	vulkanEnv.setVertexFormat(setting.misc.packedVertex ? VertexFormat::Packed : VertexFormat::Float);
+	vulkanEnv.setDepthPrepass(graphicsSetting.DepthPrepass, depthShaderIndex);
+	vulkanEnv.setGpuTimestamp(graphicsSetting.GpuTimestamp);
+	vulkanEnv.setPipelineCachePath(setting.misc.pipelineCachePath);
 	if (setting.misc.enableValidationLayer) {
 		vulkanEnv.enableValidationLayer({ "VK_LAYER_KHRONOS_validation" });
 	}
@@ -193,10 +242,12 @@ int RenderingTest::mainLoop() {
 	logResult("create msaa color buffer", swapchain.createMsaaColorBuffer());
 	logResult("create depth buffer", swapchain.createDepthBuffer());
 	logResult("create render pass", vulkanEnv.createRenderPass());
+	logResult("create pipeline cache", vulkanEnv.createPipelineCache());
 	logResult("create descriptor set layout", vulkanEnv.createDescriptorSetLayout());
 	logResult("create graphics pipeline layout", vulkanEnv.createGraphicsPipelineLayout());
 	logResult("loading shader", shaderManager.preload());
 	logResult("create graphics pipeline", vulkanEnv.createGraphicsPipeline());
+	logResult("create cull pipeline", vulkanEnv.createCullPipeline());
 	shaderManager.unload();
 	logResult("create frame buffer", swapchain.createFramebuffer());
 	logResult("setup fence", vulkanEnv.setupFence());
@@ -227,6 +278,10 @@ int RenderingTest::mainLoop() {
 		//meshManager.getMeshAt(0).animate(90);
 		//meshManager.getMeshAt(1).animate(45);
 		meshManager.getMeshAt(0).animate(15);
+		if (graphicsSetting.CpuCulling) {
+			renderingData.updateVisibleDraw();
+		}
+		renderingData.updateDrawLod();
 
 		if (!vulkanEnv.drawFrame(renderingData)) {
 			//draw frame failed, only consecutive failure causes loop exit
@@ -234,9 +289,9 @@ int RenderingTest::mainLoop() {
 				std::cout << "Consecutive frame draw failure! (" << drawFailure << ")"  << std::endl;
 				break;
 			}
-			else {
-				drawFailure = 0;
-			}
+		}
+		else {
+			drawFailure = 0;
 		}
 	}
 
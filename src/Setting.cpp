@@ -26,10 +26,94 @@ bool Setting::loadFrom(const std::string& path) {
 			miscData.vertexShaderPath = std::move(line.substr(delimIndex));
 			continue;
 		}
+		if (key == "packed_vertex_shader") {
+			miscData.packedVertexShaderPath = std::move(line.substr(delimIndex));
+			continue;
+		}
 		if (key == "fragment_shader") {
 			miscData.fragmentShaderPath = std::move(line.substr(delimIndex));
 			continue;
 		}
+		if (key == "cull_shader") {
+			miscData.cullShaderPath = std::move(line.substr(delimIndex));
+			continue;
+		}
+		if (key == "depth_shader") {
+			miscData.depthShaderPath = std::move(line.substr(delimIndex));
+			continue;
+		}
+		if (key == "packed_depth_shader") {
+			miscData.packedDepthShaderPath = std::move(line.substr(delimIndex));
+			continue;
+		}
+		if (key == "pipeline_cache") {
+			miscData.pipelineCachePath = std::move(line.substr(delimIndex));
+			continue;
+		}
+		if (key == "record_thread") {
+			std::istringstream(line.substr(delimIndex)) >> graphicsData.RecordThreadCount;
+			continue;
+		}
+		if (key == "indirect_draw") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> graphicsData.IndirectDraw;
+			continue;
+		}
+		if (key == "gpu_culling") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> graphicsData.GpuCulling;
+			continue;
+		}
+		if (key == "cpu_culling") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> graphicsData.CpuCulling;
+			continue;
+		}
+		if (key == "lod_threshold") {
+			std::istringstream(line.substr(delimIndex)) >> graphicsData.LodThreshold;
+			continue;
+		}
+		if (key == "depth_prepass") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> graphicsData.DepthPrepass;
+			continue;
+		}
+		if (key == "gpu_timestamp") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> graphicsData.GpuTimestamp;
+			continue;
+		}
+		if (key == "import_thread") {
+			std::istringstream(line.substr(delimIndex)) >> miscData.importThreadCount;
+			continue;
+		}
+		if (key == "mesh_cache") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.meshCache;
+			continue;
+		}
+		if (key == "mesh_optimize") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.meshOptimize;
+			continue;
+		}
+		if (key == "mesh_lod") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.meshLod;
+			continue;
+		}
+		if (key == "vertex_format") {
+			miscData.packedVertex = line.substr(delimIndex) == "packed";
+			continue;
+		}
+		if (key == "texture_cache") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.textureCache;
+			continue;
+		}
+		if (key == "texture_compression") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.textureCompression;
+			continue;
+		}
+		if (key == "cpu_mipmap") {
+			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.cpuMipmap;
+			continue;
+		}
+		if (key == "mip_filter") {
+			miscData.kaiserMipFilter = line.substr(delimIndex) != "box";
+			continue;
+		}
 		if (key == "enable_validation_layer") {
 			std::istringstream(line.substr(delimIndex)) >> std::boolalpha >> miscData.enableValidationLayer;
 			continue;
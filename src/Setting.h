@@ -7,12 +7,33 @@ public:
 	struct Graphics {
 		int MSAASample = 1;
 		int MaxFrameInFlight = 3;
+		int RecordThreadCount = 0;
+		bool IndirectDraw = false;
+		bool GpuCulling = false;
+		bool CpuCulling = false;
+		float LodThreshold = 1.0f;
+		bool DepthPrepass = false;
+		bool GpuTimestamp = false;
 	};
 	struct Misc {
 		std::string modelPath;
 		std::string texturePath;
 		std::string vertexShaderPath;
+		std::string packedVertexShaderPath;//used instead of vertexShaderPath with packedVertex
 		std::string fragmentShaderPath;
+		std::string cullShaderPath;
+		std::string depthShaderPath;
+		std::string packedDepthShaderPath;//used instead of depthShaderPath with packedVertex
+		std::string pipelineCachePath;//empty keeps the pipeline cache in memory only
+		int importThreadCount = 0;
+		bool meshCache = true;
+		bool meshOptimize = true;
+		bool meshLod = true;
+		bool packedVertex = false;
+		bool textureCache = true;
+		bool textureCompression = true;
+		bool cpuMipmap = true;
+		bool kaiserMipFilter = true;
 		bool enableValidationLayer;
 	};
 private:
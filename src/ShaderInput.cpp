@@ -7,6 +7,10 @@ ShaderInput::ShaderInput(const std::string& vertexPath, const std::string& fragm
 	, fragPath(fragmentPath)
 {}
 
+ShaderInput::ShaderInput(const std::string& computePath)
+	: compPath(computePath)
+{}
+
 bool ShaderInput::loadFile(const std::string& path, std::vector<char>& buffer) const {
 	std::ifstream file(path, std::ios::ate | std::ios::binary);
 	if (!file.is_open()) {
@@ -33,6 +37,14 @@ const std::vector<char>& ShaderInput::getFragData() const {
 	return fragData;
 }
 
+const std::vector<char>& ShaderInput::getCompData() const {
+	return compData;
+}
+
+bool ShaderInput::isCompute() const noexcept {
+	return !compPath.empty();
+}
+
 bool ShaderInput::preloadVert() {
 	return !vertPath.empty() && loadFile(vertPath, vertData);
 }
@@ -41,11 +53,16 @@ bool ShaderInput::preloadFrag() {
 	return !fragPath.empty() && loadFile(fragPath, fragData);
 }
 
+bool ShaderInput::preloadComp() {
+	return !compPath.empty() && loadFile(compPath, compData);
+}
+
 bool ShaderInput::preload() {
-	return (vertPath.empty() || preloadVert()) && (fragPath.empty() || preloadFrag());
+	return (vertPath.empty() || preloadVert()) && (fragPath.empty() || preloadFrag()) && (compPath.empty() || preloadComp());
 }
 
 void ShaderInput::unload() {
 	vertData.resize(0);
 	fragData.resize(0);
+	compData.resize(0);
 }
\ No newline at end of file
@@ -8,15 +8,22 @@ class ShaderInput
 private:
 	std::string vertPath;
 	std::string fragPath;
+	std::string compPath;
 	std::vector<char> vertData;
 	std::vector<char> fragData;
+	std::vector<char> compData;
 	bool loadFile(const std::string& path, std::vector<char>& buffer) const;
 public:
 	ShaderInput(const std::string& vertexPath, const std::string& fragmentPath);
+	//compute only shader
+	explicit ShaderInput(const std::string& computePath);
 	const std::vector<char>& getVertData() const;
 	const std::vector<char>& getFragData() const;
+	const std::vector<char>& getCompData() const;
+	bool isCompute() const noexcept;
 	bool preloadVert();
 	bool preloadFrag();
+	bool preloadComp();
 	bool preload();
 	void unload();
 };
@@ -0,0 +1,6 @@
+#pragma once
+//sse2 is baseline on x64, x86 only with /arch:SSE2 or -msse2, everything else takes the scalar paths
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
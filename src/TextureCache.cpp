@@ -0,0 +1,406 @@
+#include "TextureCache.h"
+#include "FileHelper.h"
+#include <sys/stat.h>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace {
+	struct TextureCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		ImageFormat format;
+		uint32_t srgb;
+		uint32_t levelCount;
+		uint64_t dataSize;
+	};
+	constexpr char TextureCacheMagic[4] = { 'V', 'P', 'T', 'X' };
+
+	//4x4 texels of a level, edge texels repeated for partial blocks
+	void loadBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t x, uint32_t y, uint8_t block[64]) {
+		for (uint32_t j = 0; j < 4; ++j) {
+			auto row = std::min(y + j, height - 1);
+			for (uint32_t i = 0; i < 4; ++i) {
+				auto column = std::min(x + i, width - 1);
+				memcpy(block + (j * 4 + i) * 4, rgba + (row * width + column) * 4, 4);
+			}
+		}
+	}
+
+	uint16_t packRgb565(int r, int g, int b) {
+		return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+	}
+
+	void unpackRgb565(uint16_t color, int rgb[3]) {
+		auto r = (color >> 11) & 31;
+		auto g = (color >> 5) & 63;
+		auto b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	//bounding box endpoints inset by 1/16, then nearest palette entry per texel
+	void encodeColorBlock(const uint8_t block[64], uint8_t out[8]) {
+		int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+		for (auto i = 0; i < 16; ++i) {
+			for (auto c = 0; c < 3; ++c) {
+				low[c] = std::min<int>(low[c], block[i * 4 + c]);
+				high[c] = std::max<int>(high[c], block[i * 4 + c]);
+			}
+		}
+		for (auto c = 0; c < 3; ++c) {
+			auto inset = (high[c] - low[c]) >> 4;
+			low[c] += inset;
+			high[c] -= inset;
+		}
+		auto color0 = packRgb565(high[0], high[1], high[2]);
+		auto color1 = packRgb565(low[0], low[1], low[2]);
+		uint32_t index = 0;
+		if (color0 < color1) {
+			std::swap(color0, color1);
+		}
+		if (color0 != color1) {
+			int palette[4][3];
+			unpackRgb565(color0, palette[0]);
+			unpackRgb565(color1, palette[1]);
+			for (auto c = 0; c < 3; ++c) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (auto i = 0; i < 16; ++i) {
+				auto best = 0;
+				auto bestDistance = INT32_MAX;
+				for (auto p = 0; p < 4; ++p) {
+					auto distance = 0;
+					for (auto c = 0; c < 3; ++c) {
+						auto d = block[i * 4 + c] - palette[p][c];
+						distance += d * d;
+					}
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				index |= static_cast<uint32_t>(best) << (i * 2);
+			}
+		}
+		memcpy(out, &color0, 2);
+		memcpy(out + 2, &color1, 2);
+		memcpy(out + 4, &index, 4);
+	}
+
+	void encodeAlphaBlock(const uint8_t block[64], uint8_t out[8]) {
+		int alpha0 = 0, alpha1 = 255;
+		for (auto i = 0; i < 16; ++i) {
+			alpha0 = std::max<int>(alpha0, block[i * 4 + 3]);
+			alpha1 = std::min<int>(alpha1, block[i * 4 + 3]);
+		}
+		uint64_t index = 0;
+		if (alpha0 != alpha1) {
+			//8 value mode, alpha0 > alpha1
+			int palette[8] = { alpha0, alpha1 };
+			for (auto p = 1; p < 7; ++p) {
+				palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+			}
+			for (auto i = 0; i < 16; ++i) {
+				auto best = 0;
+				auto bestDistance = INT32_MAX;
+				for (auto p = 0; p < 8; ++p) {
+					auto distance = std::abs(block[i * 4 + 3] - palette[p]);
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				index |= static_cast<uint64_t>(best) << (i * 3);
+			}
+		}
+		out[0] = static_cast<uint8_t>(alpha0);
+		out[1] = static_cast<uint8_t>(alpha1);
+		for (auto i = 0; i < 6; ++i) {
+			out[2 + i] = static_cast<uint8_t>(index >> (i * 8));
+		}
+	}
+
+	//bc1 reads 3 color + transparent when color0 <= color1, bc3 colors are always 4 color
+	void decodeColorBlock(const uint8_t in[8], bool allowTransparent, uint8_t block[64]) {
+		uint16_t color0, color1;
+		uint32_t index;
+		memcpy(&color0, in, 2);
+		memcpy(&color1, in + 2, 2);
+		memcpy(&index, in + 4, 4);
+		int palette[4][4];
+		unpackRgb565(color0, palette[0]);
+		unpackRgb565(color1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+		for (auto c = 0; c < 3; ++c) {
+			if (color0 > color1 || !allowTransparent) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		if (color0 <= color1 && allowTransparent) {
+			palette[3][3] = 0;
+		}
+		for (auto i = 0; i < 16; ++i) {
+			const auto* entry = palette[(index >> (i * 2)) & 3];
+			for (auto c = 0; c < 4; ++c) {
+				block[i * 4 + c] = static_cast<uint8_t>(entry[c]);
+			}
+		}
+	}
+
+	void decodeAlphaBlock(const uint8_t in[8], uint8_t block[64]) {
+		int palette[8] = { in[0], in[1] };
+		if (palette[0] > palette[1]) {
+			for (auto p = 1; p < 7; ++p) {
+				palette[p + 1] = ((7 - p) * palette[0] + p * palette[1]) / 7;
+			}
+		}
+		else {
+			for (auto p = 1; p < 5; ++p) {
+				palette[p + 1] = ((5 - p) * palette[0] + p * palette[1]) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		uint64_t index = 0;
+		for (auto i = 0; i < 6; ++i) {
+			index |= static_cast<uint64_t>(in[2 + i]) << (i * 8);
+		}
+		for (auto i = 0; i < 16; ++i) {
+			block[i * 4 + 3] = static_cast<uint8_t>(palette[(index >> (i * 3)) & 7]);
+		}
+	}
+
+	bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+		return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+}
+
+ImageFormat pickBlockFormat(const uint8_t* rgba, uint32_t width, uint32_t height) {
+	auto count = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < count; ++i) {
+		if (rgba[i * 4 + 3] != 255) {
+			return ImageFormat::Bc3;
+		}
+	}
+	return ImageFormat::Bc1;
+}
+
+void compressMipChain(ImageFormat format, const std::vector<ImageLevel>& rgbaLevel, const std::vector<uint8_t>& rgbaData, std::vector<ImageLevel>& level, std::vector<uint8_t>& data) {
+	auto bytes = blockSize(format);
+	level.resize(rgbaLevel.size());
+	uint32_t size = 0;
+	for (size_t i = 0; i < level.size(); ++i) {
+		level[i].width = rgbaLevel[i].width;
+		level[i].height = rgbaLevel[i].height;
+		level[i].offset = size;
+		level[i].size = ((level[i].width + 3) / 4) * ((level[i].height + 3) / 4) * bytes;
+		size += level[i].size;
+	}
+	data.resize(size);
+	uint8_t block[64];
+	for (size_t i = 0; i < level.size(); ++i) {
+		const auto* rgba = rgbaData.data() + rgbaLevel[i].offset;
+		auto* out = data.data() + level[i].offset;
+		for (uint32_t y = 0; y < level[i].height; y += 4) {
+			for (uint32_t x = 0; x < level[i].width; x += 4) {
+				loadBlock(rgba, level[i].width, level[i].height, x, y, block);
+				if (format == ImageFormat::Bc3) {
+					encodeAlphaBlock(block, out);
+					out += 8;
+				}
+				encodeColorBlock(block, out);
+				out += 8;
+			}
+		}
+	}
+}
+
+void decompressMipChain(ImageFormat format, const std::vector<ImageLevel>& blockLevel, const uint8_t* blockData, std::vector<ImageLevel>& level, std::vector<uint8_t>& data) {
+	level.resize(blockLevel.size());
+	uint32_t size = 0;
+	for (size_t i = 0; i < level.size(); ++i) {
+		level[i].width = blockLevel[i].width;
+		level[i].height = blockLevel[i].height;
+		level[i].offset = size;
+		level[i].size = level[i].width * level[i].height * 4;
+		size += level[i].size;
+	}
+	data.resize(size);
+	uint8_t block[64];
+	for (size_t i = 0; i < level.size(); ++i) {
+		const auto* in = blockData + blockLevel[i].offset;
+		auto* rgba = data.data() + level[i].offset;
+		auto width = level[i].width;
+		auto height = level[i].height;
+		for (uint32_t y = 0; y < height; y += 4) {
+			for (uint32_t x = 0; x < width; x += 4) {
+				if (format == ImageFormat::Bc3) {
+					decodeColorBlock(in + 8, false, block);
+					decodeAlphaBlock(in, block);
+					in += 16;
+				}
+				else {
+					decodeColorBlock(in, true, block);
+					in += 8;
+				}
+				for (uint32_t j = 0; j < 4 && y + j < height; ++j) {
+					auto columnCount = std::min(4u, width - x);
+					memcpy(rgba + ((y + j) * width + x) * 4, block + j * 16, columnCount * 4);
+				}
+			}
+		}
+	}
+}
+
+void TextureCache::setDirectory(const std::string& path) {
+	directory = path;
+}
+
+void TextureCache::setEnabled(bool value) noexcept {
+	enabled = value;
+}
+
+void TextureCache::setCompression(bool value) noexcept {
+	compression = value;
+}
+
+void TextureCache::setMipFilter(MipFilter filter) noexcept {
+	mipFilter = filter;
+}
+
+void TextureCache::setCpuMipmap(bool value) noexcept {
+	cpuMipmap = value;
+}
+
+std::string TextureCache::cachePath(uint64_t hash, bool srgb) const {
+	char name[40];
+	snprintf(name, sizeof(name), "%016llx%s%s%s.vptex", static_cast<unsigned long long>(hash),
+		mipFilter == MipFilter::Kaiser ? "_k" : "", compression ? "_bc" : "", srgb ? "" : "_l");
+	return directory + "/" + name;
+}
+
+bool TextureCache::read(const std::string& path, uint64_t hash, bool srgb, ImageInput& image) const {
+	std::ifstream input(path, std::ios::binary);
+	if (!input.is_open()) {
+		return false;
+	}
+	TextureCacheHeader header;
+	if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		memcmp(header.magic, TextureCacheMagic, sizeof(TextureCacheMagic)) != 0 ||
+		header.version != TextureCacheVersion ||
+		header.sourceHash != hash ||
+		(header.srgb != 0) != srgb ||
+		header.levelCount == 0 ||
+		(header.format != ImageFormat::Rgba8 && header.format != ImageFormat::Bc1 && header.format != ImageFormat::Bc3) ||
+		(header.format == ImageFormat::Rgba8) == compression) {
+		return false;
+	}
+	//a truncated or corrupt file is discarded before its sizes are allocated
+	auto remaining = remainingBytes(input);
+	if (header.dataSize > remaining || static_cast<uint64_t>(header.levelCount) * sizeof(ImageLevel) != remaining - header.dataSize) {
+		return false;
+	}
+	std::vector<ImageLevel> level(header.levelCount);
+	std::vector<uint8_t> data(header.dataSize);
+	if (!input.read(reinterpret_cast<char*>(level.data()), level.size() * sizeof(ImageLevel)) ||
+		!input.read(reinterpret_cast<char*>(data.data()), data.size())) {
+		return false;
+	}
+	for (const auto& entry : level) {
+		if (entry.offset + static_cast<uint64_t>(entry.size) > data.size()) {
+			return false;
+		}
+	}
+	image.setBaked(header.format, std::move(level), std::move(data));
+	return true;
+}
+
+bool TextureCache::write(const std::string& path, uint64_t hash, const ImageInput& image) const {
+	if (!makeDirectory(directory)) {
+		return false;
+	}
+	TextureCacheHeader header{};
+	memcpy(header.magic, TextureCacheMagic, sizeof(TextureCacheMagic));
+	header.version = TextureCacheVersion;
+	header.sourceHash = hash;
+	header.format = image.getFormat();
+	header.srgb = image.isSrgb() ? 1 : 0;
+	header.levelCount = static_cast<uint32_t>(image.getLevel().size());
+	header.dataSize = image.getByteSize();
+	//the same image baked on two threads never leaves a torn file
+	return writeFileAtomic(path, [&](std::ofstream& output) {
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output.write(reinterpret_cast<const char*>(image.getLevel().data()), image.getLevel().size() * sizeof(ImageLevel));
+		output.write(reinterpret_cast<const char*>(image.pixel()), image.getByteSize());
+	});
+}
+
+bool TextureCache::load(const uint8_t* encoded, size_t size, bool srgb, ImageInput& image) const {
+	image.setSrgb(srgb);
+	if (!enabled) {
+		//nothing is kept, the chain is still built on the cpu when asked for
+		return image.loadRaw(encoded, static_cast<int>(size)) && (!cpuMipmap || bakeMipChain(image, 0, mipFilter));
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	auto hash = hashBytes(encoded, size);
+	auto path = cachePath(hash, srgb);
+	if (read(path, hash, srgb, image)) {
+		auto time = std::chrono::high_resolution_clock::now();
+		std::ostringstream log;
+		log << "texture cache hit " << path << " "
+			<< std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count() << "ms\n";
+		std::cout << log.str();
+		return true;
+	}
+	ImageInput decoded;
+	if (!decoded.loadRaw(encoded, static_cast<int>(size))) {
+		return false;
+	}
+	auto width = static_cast<uint32_t>(decoded.getWidth());
+	auto height = static_cast<uint32_t>(decoded.getHeight());
+	std::vector<ImageLevel> level;
+	std::vector<uint8_t> data;
+	generateMipChain(decoded.pixel(), width, height, 0, mipFilter, srgb, level, data);
+	auto format = ImageFormat::Rgba8;
+	if (compression) {
+		format = pickBlockFormat(decoded.pixel(), width, height);
+		std::vector<ImageLevel> blockLevel;
+		std::vector<uint8_t> blockData;
+		compressMipChain(format, level, data, blockLevel, blockData);
+		level = std::move(blockLevel);
+		data = std::move(blockData);
+	}
+	image.setBaked(format, std::move(level), std::move(data));
+	//one write per line, several images may be loaded concurrently
+	std::ostringstream log;
+	if (!write(path, hash, image)) {
+		log << "texture cache " << path << " not written\n";
+	}
+	auto time = std::chrono::high_resolution_clock::now();
+	log << "texture baked " << path << " " << width << "x" << height << " "
+		<< std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count() << "ms\n";
+	std::cout << log.str();
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "ImageInput.h"
+#include "MipGenerator.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//baked textures, one <directory>/<hash>.vptex per encoded source image (jpg/png bytes)
+//a baked texture has its whole mip chain precomputed, optionally block compressed,
+//so a cache hit skips both the image decode & the gpu mip generation
+
+//bump whenever baking changes its output
+constexpr uint32_t TextureCacheVersion = 3;
+
+class TextureCache
+{
+private:
+	std::string directory = "texture_cache";
+	bool enabled = true;
+	bool compression = true;
+	bool cpuMipmap = true;
+	MipFilter mipFilter = MipFilter::Kaiser;
+	std::string cachePath(uint64_t hash, bool srgb) const;
+	bool read(const std::string& path, uint64_t hash, bool srgb, ImageInput& image) const;
+	bool write(const std::string& path, uint64_t hash, const ImageInput& image) const;
+public:
+	void setDirectory(const std::string& path);
+	void setEnabled(bool value) noexcept;
+	//bc1/bc3 instead of rgba8
+	void setCompression(bool value) noexcept;
+	//filter of the baked chains, part of the cache file name
+	void setMipFilter(MipFilter filter) noexcept;
+	//with the cache disabled, builds the chain at load time instead of leaving it to gpu blits
+	void setCpuMipmap(bool value) noexcept;
+	//decodes & bakes on a miss, the baked result is written back for the next run
+	//srgb false bakes the chain without the srgb curve, an image used both ways has an entry per colour space
+	bool load(const uint8_t* encoded, size_t size, bool srgb, ImageInput& image) const;
+};
+
+//bc3 when any pixel is not opaque, bc1 otherwise
+ImageFormat pickBlockFormat(const uint8_t* rgba, uint32_t width, uint32_t height);
+//each rgba8 level of the chain encoded to format
+void compressMipChain(ImageFormat format, const std::vector<ImageLevel>& rgbaLevel, const std::vector<uint8_t>& rgbaData, std::vector<ImageLevel>& level, std::vector<uint8_t>& data);
+//rgba8 chain of a block compressed image, for devices without bc support
+void decompressMipChain(ImageFormat format, const std::vector<ImageLevel>& blockLevel, const uint8_t* blockData, std::vector<ImageLevel>& level, std::vector<uint8_t>& data);
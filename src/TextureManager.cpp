@@ -8,6 +8,21 @@ size_t TextureManager::addTexture(ImageInput&& texture) {
 	return index;
 }
 
+size_t TextureManager::reserve(size_t count) {
+	auto index = textureList.size();
+	textureList.resize(index + count);
+	return index;
+}
+
+bool TextureManager::loadEncoded(size_t index, const uint8_t* data, size_t size, bool srgb) {
+	assert(index < textureList.size());
+	return cache.load(data, size, srgb, textureList[index]);
+}
+
+TextureCache& TextureManager::getCache() noexcept {
+	return cache;
+}
+
 ImageInput& TextureManager::getTexture(const int index) {
 	assert(index >= 0 && index < textureList.size());
 	return textureList[index];
@@ -1,13 +1,22 @@
 #pragma once
 #include "ImageInput.h"
+#include "TextureCache.h"
 #include <vector>
 
 class TextureManager
 {
 private:
 	std::vector<ImageInput> textureList;
+	TextureCache cache;
 public:
 	size_t addTexture(ImageInput&& texture);
+	//appends count empty slots to be filled by loadEncoded, returns the first index
+	size_t reserve(size_t count);
+	//encoded jpg/png into a reserved slot through the texture cache, the slot stays empty when decoding fails
+	//distinct slots can be loaded concurrently, the list is never resized here
+	//srgb false for data textures, see textureSrgb
+	bool loadEncoded(size_t index, const uint8_t* data, size_t size, bool srgb);
+	TextureCache& getCache() noexcept;
 	ImageInput& getTexture(const int index);
 	const ImageInput& getTexture(const int index) const;
 	std::vector<ImageInput>& getTextureList();
@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+ThreadPool::~ThreadPool() {
+	destroy();
+}
+
+bool ThreadPool::create(uint32_t count) {
+	if (!worker.empty()) {
+		return false;
+	}
+	stopping = false;
+	worker.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		worker.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+	return true;
+}
+
+uint32_t ThreadPool::size() const noexcept {
+	return static_cast<uint32_t>(worker.size());
+}
+
+void ThreadPool::run(uint32_t count, const Task& task) {
+	if (count == 0) {
+		return;
+	}
+	//no worker, run inline as worker 0
+	if (worker.empty()) {
+		for (uint32_t i = 0; i < count; ++i) {
+			task(0, i);
+		}
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	job = &task;
+	taskCount = count;
+	nextTask = 0;
+	busyWorker = size();
+	++generation;
+	wake.notify_all();
+	finished.wait(lock, [this]() { return busyWorker == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::workerLoop(uint32_t index) {
+	uint64_t seen = 0;
+	while (true) {
+		const Task* current;
+		uint32_t count;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping) {
+				return;
+			}
+			seen = generation;
+			current = job;
+			count = taskCount;
+		}
+		//tasks are pulled one by one so uneven tasks still balance across workers
+		for (auto i = nextTask++; i < count; i = nextTask++) {
+			(*current)(index, i);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorker == 0) {
+			finished.notify_one();
+		}
+	}
+}
+
+void ThreadPool::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& thread : worker) {
+		thread.join();
+	}
+	worker.clear();
+}
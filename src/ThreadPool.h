@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+//fixed set of workers running fork-join jobs, the caller blocks until every task of a job is done
+class ThreadPool
+{
+public:
+	//worker index is stable per thread, usable to pick per-thread resources
+	using Task = std::function<void(uint32_t worker, uint32_t task)>;
+private:
+	std::vector<std::thread> worker;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	const Task* job = nullptr;
+	uint32_t taskCount = 0;
+	std::atomic<uint32_t> nextTask{ 0 };
+	uint32_t busyWorker = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+
+	void workerLoop(uint32_t index);
+public:
+	ThreadPool() = default;
+	ThreadPool(const ThreadPool&) = delete;
+	~ThreadPool();
+	bool create(uint32_t count);
+	uint32_t size() const noexcept;
+	void run(uint32_t count, const Task& task);
+	void destroy();
+};
@@ -0,0 +1,84 @@
+#include "TransformHierarchy.h"
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_LEFT_HANDED
+#include "glm.hpp"
+#include "gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <iostream>
+
+void TransformHierarchy::reserve(size_t count) {
+	parent.reserve(count);
+	position.reserve(count);
+	rotation.reserve(count);
+	scale.reserve(count);
+	local.reserve(count);
+	world.reserve(count);
+	dirty.reserve(count);
+}
+
+size_t TransformHierarchy::size() const noexcept {
+	return parent.size();
+}
+
+uint32_t TransformHierarchy::add(int parentIndex, const MatrixInput& matrix) {
+	auto index = static_cast<uint32_t>(parent.size());
+	if (parentIndex >= static_cast<int>(index)) {
+		std::cout << "transform parent " << parentIndex << " not added before " << index << ", attached to root" << std::endl;
+		parentIndex = -1;
+	}
+	//TODO use matrix.matrix
+	parent.push_back(std::max(-1, parentIndex));
+	position.push_back(matrix.translation);
+	rotation.push_back(matrix.rotation);
+	scale.push_back(matrix.scale);
+	local.push_back(glm::mat4(1.0f));
+	world.push_back({ glm::mat4(1.0f) });
+	dirty.push_back(LocalDirty | WorldDirty);
+	return index;
+}
+
+void TransformHierarchy::setLocal(uint32_t index, const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scaleIn) {
+	position[index] = pos;
+	rotation[index] = rot;
+	scale[index] = scaleIn;
+	dirty[index] |= LocalDirty | WorldDirty;
+}
+
+void TransformHierarchy::setRoot(const glm::mat4& matrix) {
+	root = matrix;
+	rootDirty = true;
+}
+
+void TransformHierarchy::update() {
+	auto count = parent.size();
+	for (size_t i = 0; i < count; ++i) {
+		auto p = parent[i];
+		//parents come first, their flag is final by the time children read it
+		if (p < 0 ? rootDirty : (dirty[p] & WorldDirty) != 0) {
+			dirty[i] |= WorldDirty;
+		}
+		if (dirty[i] & LocalDirty) {
+			const auto&& translated = glm::translate(glm::mat4(1.0f), position[i]);
+			const auto&& rotated = glm::mat4_cast(rotation[i]);
+			const auto&& scaled = glm::scale(glm::mat4(1.0f), scale[i]);
+			local[i] = translated * rotated * scaled;
+		}
+		if (dirty[i] & WorldDirty) {
+			world[i].model = (p < 0 ? root : world[p].model) * local[i];
+		}
+	}
+	std::fill(dirty.begin(), dirty.end(), static_cast<uint8_t>(Clean));
+	rootDirty = false;
+}
+
+const MeshConstant& TransformHierarchy::getWorld(uint32_t index) const {
+	return world[index];
+}
+
+int TransformHierarchy::getParent(uint32_t index) const {
+	return parent[index];
+}
+
+MatrixInput TransformHierarchy::getMatrix(uint32_t index) const {
+	return { position[index], rotation[index], scale[index], glm::mat4(1.0f) };
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "MeshStruct.h"
+#include <vector>
+#include <cstdint>
+
+//flat transform store of one MeshInput, nodes are kept in topological order (parent index < own index)
+//so world matrices are resolved in a single forward pass touching only dirty subtrees
+class TransformHierarchy
+{
+private:
+	enum Dirty : uint8_t {
+		Clean = 0,
+		LocalDirty = 1,//trs changed, local matrix has to be rebuilt
+		WorldDirty = 2,//own or an ancestor's matrix changed
+	};
+	std::vector<int> parent;//-1 for nodes attached to the root matrix
+	std::vector<glm::vec3> position;
+	std::vector<glm::quat> rotation;
+	std::vector<glm::vec3> scale;
+	std::vector<glm::mat4> local;
+	std::vector<MeshConstant> world;
+	std::vector<uint8_t> dirty;
+	glm::mat4 root = glm::mat4(1.0f);
+	bool rootDirty = false;
+public:
+	void reserve(size_t count);
+	size_t size() const noexcept;
+	//parent has to be added before, otherwise the node is attached to the root
+	uint32_t add(int parentIndex, const MatrixInput& matrix);
+	void setLocal(uint32_t index, const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scaleIn);
+	void setRoot(const glm::mat4& matrix);
+	//world matrices are only valid after this, references returned by getWorld stay valid until the next add
+	void update();
+	const MeshConstant& getWorld(uint32_t index) const;
+	int getParent(uint32_t index) const;
+	//local trs, matrix member left as identity
+	MatrixInput getMatrix(uint32_t index) const;
+};
@@ -0,0 +1,146 @@
+#include "VertexPacking.h"
+#include "gtc/packing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+
+namespace {
+	float signNotZero(float value) {
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	//unit vector onto the [-1, 1] square, the lower hemisphere folded over the diagonals
+	glm::vec2 octahedronEncode(const glm::vec3& normal) {
+		auto sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (sum <= 0.0f) {
+			return glm::vec2(0.0f, 0.0f);
+		}
+		glm::vec2 encoded(normal.x / sum, normal.y / sum);
+		if (normal.z < 0.0f) {
+			encoded = glm::vec2((1.0f - std::abs(encoded.y)) * signNotZero(encoded.x), (1.0f - std::abs(encoded.x)) * signNotZero(encoded.y));
+		}
+		return encoded;
+	}
+
+	//same as octDecode in shader/vert_lighting_packed.glsl
+	glm::vec3 octahedronDecode(const glm::vec2& encoded) {
+		glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+		auto fold = std::max(-normal.z, 0.0f);
+		normal.x += normal.x >= 0.0f ? -fold : fold;
+		normal.y += normal.y >= 0.0f ? -fold : fold;
+		auto length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		return length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+
+	float unitRange(float value, float min, float extent) {
+		return extent > 0.0f ? std::min(std::max((value - min) / extent, 0.0f), 1.0f) : 0.0f;
+	}
+
+	//vertex index of count vertices stored as two streams
+	void storeVertex(uint8_t* output, VertexFormat format, uint32_t count, uint32_t index, const Vertex& vertex, const glm::vec3& aabbMin, const glm::vec3& aabbMax) {
+		uint8_t record[sizeof(Vertex)];
+		if (format == VertexFormat::Packed) {
+			auto packed = packVertex(vertex, aabbMin, aabbMax);
+			memcpy(record, &packed, sizeof(PackedVertex));
+		}
+		else {
+			memcpy(record, &vertex, sizeof(Vertex));
+		}
+		auto position = positionStride(format);
+		auto attribute = attributeStride(format);
+		memcpy(output + index * position, record, position);
+		memcpy(output + count * position + index * attribute, record + position, attribute);
+	}
+
+	//the input may come straight from a mapped file, copied out before use
+	Vertex loadVertex(const uint8_t* input, VertexFormat format, uint32_t count, uint32_t index, const glm::vec3& aabbMin, const glm::vec3& aabbMax) {
+		uint8_t record[sizeof(Vertex)];
+		auto position = positionStride(format);
+		auto attribute = attributeStride(format);
+		memcpy(record, input + index * position, position);
+		memcpy(record + position, input + count * position + index * attribute, attribute);
+		if (format == VertexFormat::Packed) {
+			PackedVertex packed;
+			memcpy(&packed, record, sizeof(PackedVertex));
+			return unpackVertex(packed, aabbMin, aabbMax);
+		}
+		Vertex vertex;
+		memcpy(&vertex, record, sizeof(Vertex));
+		return vertex;
+	}
+}
+
+uint32_t vertexStride(VertexFormat format) {
+	return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+uint32_t positionStride(VertexFormat format) {
+	//pos is the first member of both layouts
+	return format == VertexFormat::Packed ? offsetof(PackedVertex, normal) : offsetof(Vertex, normal);
+}
+
+uint32_t attributeStride(VertexFormat format) {
+	return vertexStride(format) - positionStride(format);
+}
+
+void positionDequantize(VertexFormat format, const glm::vec3& aabbMin, const glm::vec3& aabbMax, glm::vec4& offset, glm::vec4& scale) {
+	if (format == VertexFormat::Packed) {
+		offset = glm::vec4(aabbMin, 0.0f);
+		scale = glm::vec4(aabbMax - aabbMin, 1.0f);
+	}
+	else {
+		offset = glm::vec4(0.0f);
+		scale = glm::vec4(1.0f);
+	}
+}
+
+PackedVertex packVertex(const Vertex& vertex, const glm::vec3& aabbMin, const glm::vec3& aabbMax) {
+	PackedVertex packed;
+	auto extent = aabbMax - aabbMin;
+	for (auto i = 0; i < 3; ++i) {
+		packed.pos[i] = glm::packUnorm1x16(unitRange(vertex.pos[i], aabbMin[i], extent[i]));
+		packed.color[i] = glm::packUnorm1x8(vertex.color[i]);
+	}
+	packed.pos[3] = 0;
+	packed.color[3] = 0xff;
+	auto normal = octahedronEncode(vertex.normal);
+	packed.normal[0] = static_cast<int16_t>(glm::packSnorm1x16(normal.x));
+	packed.normal[1] = static_cast<int16_t>(glm::packSnorm1x16(normal.y));
+	packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+	packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+	return packed;
+}
+
+Vertex unpackVertex(const PackedVertex& packed, const glm::vec3& aabbMin, const glm::vec3& aabbMax) {
+	Vertex vertex;
+	auto extent = aabbMax - aabbMin;
+	for (auto i = 0; i < 3; ++i) {
+		vertex.pos[i] = aabbMin[i] + glm::unpackUnorm1x16(packed.pos[i]) * extent[i];
+		vertex.color[i] = glm::unpackUnorm1x8(packed.color[i]);
+	}
+	vertex.normal = octahedronDecode(glm::vec2(
+		glm::unpackSnorm1x16(static_cast<uint16_t>(packed.normal[0])),
+		glm::unpackSnorm1x16(static_cast<uint16_t>(packed.normal[1]))));
+	vertex.texCoord = glm::vec2(glm::unpackHalf1x16(packed.texCoord[0]), glm::unpackHalf1x16(packed.texCoord[1]));
+	return vertex;
+}
+
+void convertVertices(const uint8_t* input, VertexFormat inputFormat, uint32_t count, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+	VertexFormat outputFormat, std::vector<uint8_t>& output) {
+	output.resize(static_cast<size_t>(count) * vertexStride(outputFormat));
+	if (inputFormat == outputFormat) {
+		memcpy(output.data(), input, output.size());
+		return;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		storeVertex(output.data(), outputFormat, count, i, loadVertex(input, inputFormat, count, i, aabbMin, aabbMax), aabbMin, aabbMax);
+	}
+}
+
+void writeVertexStream(const std::vector<Vertex>& vertices, VertexFormat format, const glm::vec3& aabbMin, const glm::vec3& aabbMax, uint8_t* output) {
+	auto count = static_cast<uint32_t>(vertices.size());
+	for (uint32_t i = 0; i < count; ++i) {
+		storeVertex(output, format, count, i, vertices[i], aabbMin, aabbMax);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "MeshStruct.h"
+#include <vector>
+#include <cstdint>
+
+//conversions between the float & packed vertex layouts
+//packed positions are quantized over the view's aabb, the vertex shader gets offset & scale per draw to undo it
+//a view stores its vertices as two streams, every position first then every other attribute, so position only
+//passes fetch the first one alone, a stream record is the Vertex/PackedVertex bytes split after pos
+
+//both streams
+uint32_t vertexStride(VertexFormat format);
+uint32_t positionStride(VertexFormat format);
+uint32_t attributeStride(VertexFormat format);
+//mesh space position = offset + unorm position * scale
+void positionDequantize(VertexFormat format, const glm::vec3& aabbMin, const glm::vec3& aabbMax, glm::vec4& offset, glm::vec4& scale);
+PackedVertex packVertex(const Vertex& vertex, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+Vertex unpackVertex(const PackedVertex& vertex, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+//both streams of the vertices, vertexStride(format) * size bytes
+void writeVertexStream(const std::vector<Vertex>& vertices, VertexFormat format, const glm::vec3& aabbMin, const glm::vec3& aabbMax, uint8_t* output);
+//count vertices from one layout to the other, streams stay split, output is resized to the converted bytes
+void convertVertices(const uint8_t* input, VertexFormat inputFormat, uint32_t count, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+	VertexFormat outputFormat, std::vector<uint8_t>& output);
@@ -3,13 +3,24 @@
 #include "MeshInput.h"
 #include "DebugHelper.hpp"
 #include "VulkanHelper.h"
+#include "Culling.h"
+#include "TextureCache.h"
+#include "VertexPacking.h"
 #include <unordered_set>
 #include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <array>
+#include <chrono>
+#include <algorithm>
 
-constexpr int TestMaxTextureCount = 5;
+//one binding per texture slot
+constexpr int TestMaxTextureCount = static_cast<int>(TextureSlot::Count);
+constexpr VkDeviceSize StagingRingSize = 64 * 1024 * 1024;
+constexpr uint32_t CullGroupSize = 64;//local_size_x of comp_cull
+//render pass begin, render pass end, depth prepass end
+constexpr uint32_t TimestampCount = 3;
+constexpr uint32_t TimestampLogInterval = 300;
 
 VulkanSwapchain& VulkanEnv::getSwapchain() noexcept {
 	return swapchain;
@@ -19,6 +30,44 @@ void VulkanEnv::setRenderingData(const RenderingData& data) noexcept {
 	renderingData = &data;
 }
 
+void VulkanEnv::setRecordThreadCount(uint32_t count) noexcept {
+	recordThreadCount = count;
+}
+
+void VulkanEnv::setIndirectDraw(bool enable) noexcept {
+	indirectDraw = enable;
+}
+
+void VulkanEnv::setGpuCulling(bool enable, int shaderIndex) noexcept {
+	gpuCulling = enable;
+	cullShaderIndex = shaderIndex;
+}
+
+void VulkanEnv::setCpuCulling(bool enable) noexcept {
+	cpuCulling = enable;
+}
+
+void VulkanEnv::requestCullCheck() noexcept {
+	cullCheckPending = true;
+}
+
+void VulkanEnv::setVertexFormat(VertexFormat format) noexcept {
+	vertexFormat = format;
+}
+
+void VulkanEnv::setDepthPrepass(bool enable, int shaderIndex) noexcept {
+	depthPrepass = enable;
+	depthShaderIndex = shaderIndex;
+}
+
+void VulkanEnv::setGpuTimestamp(bool enable) noexcept {
+	gpuTimestamp = enable;
+}
+
+void VulkanEnv::setPipelineCachePath(const std::string& path) {
+	pipelineCachePath = path;
+}
+
 void VulkanEnv::setRenderingManager(const MaterialManager& material, ShaderManager& shader) noexcept {
 	materialManager = &material;
 	shaderManager = &shader;
@@ -33,11 +82,8 @@ void VulkanEnv::checkExtensionRequirement() {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 	optionalExtensionOffset = static_cast<uint32_t>(extension.size());
-	//TODO add optional
-	/*
-	extension.reserve(extension.size() + count);
-	extension.push_back(...);
-	*/
+	//optional ones are only enabled when the device has them
+	extension.push_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
 }
 
 void VulkanEnv::waitUntilIdle() {
@@ -99,6 +145,24 @@ bool VulkanEnv::queueFamilyValid(const VkPhysicalDevice device, uint32_t& score)
 		}
 		++i;
 	}
+	//a transfer family without graphics maps to the DMA engine(s), prefer one without compute as well
+	//the staging ring copies image bands at any row, so only a family with texel granularity is usable
+	queueFamily.transfer = queueFamily.graphics;
+	bool transferOnly = false;
+	i = 0;
+	for (const auto& queue : properties) {
+		const auto& granularity = queue.minImageTransferGranularity;
+		bool texelGranularity = granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
+		if ((queue.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queue.queueFlags & VK_QUEUE_GRAPHICS_BIT) && texelGranularity && !transferOnly) {
+			queueFamily.transfer = i;
+			transferOnly = !(queue.queueFlags & VK_QUEUE_COMPUTE_BIT);
+		}
+		++i;
+	}
+	if (queueFamily.transfer != queueFamily.graphics) {
+		std::cout << "transfer queue family " << queueFamily.transfer << std::endl;
+		score += static_cast<uint32_t>(PhysicalDeviceScore::DedicatedTransferQueue);
+	}
 	score += static_cast<uint32_t>(PhysicalDeviceScore::QueueFamilyValid);
 	return result;
 }
@@ -139,10 +203,11 @@ bool VulkanEnv::createPhysicalDevice() {
 void VulkanEnv::selectPhysicalDevice(const PhysicalDeviceCandidate& candidate) {
 	swapchain.selectPhysicalDevice(candidate);
 	physicalDevice = candidate.device;
+	uploader.setPhysicalDevice(physicalDevice);
 }
 
 bool VulkanEnv::createDevice() {
-	std::unordered_set<uint32_t> uniqueQueueFamily{ queueFamily.graphics, queueFamily.present };
+	std::unordered_set<uint32_t> uniqueQueueFamily{ queueFamily.graphics, queueFamily.present, queueFamily.transfer };
 	std::vector<VkDeviceQueueCreateInfo> queueCreate;
 	queueCreate.reserve(uniqueQueueFamily.size());
 
@@ -157,18 +222,77 @@ bool VulkanEnv::createDevice() {
 		queueCreate.push_back(queueInfo);
 	}
 
+	VkPhysicalDeviceFeatures supported;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supported);
 	VkPhysicalDeviceFeatures features{};
 	features.samplerAnisotropy = VK_TRUE;
+	//baked textures may be bc compressed, decompressed at upload otherwise
+	features.textureCompressionBC = supported.textureCompressionBC;
+	textureCompressionBCSupported = supported.textureCompressionBC;
+	//draw index is passed as firstInstance, many draws per indirect call
+	features.multiDrawIndirect = supported.multiDrawIndirect;
+	features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+	indirectDrawSupported = supported.multiDrawIndirect && supported.drawIndirectFirstInstance;
+	if (indirectDraw && !indirectDrawSupported) {
+		std::cout << "indirect draw not supported, using direct draw" << std::endl;
+	}
+	VkPhysicalDeviceVulkan12Features supported12{};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supported2{};
+	supported2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported2.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supported2);
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+	//culled buckets are drawn with a gpu written count
+	features12.drawIndirectCount = supported12.drawIndirectCount;
+	drawIndirectCountSupported = supported12.drawIndirectCount;
+	if (gpuCulling && !useGpuCulling()) {
+		std::cout << "gpu culling not supported, drawing without culling" << std::endl;
+	}
+	if (cpuCulling && useIndirectDraw()) {
+		std::cout << "cpu culling only applies to direct draws, ignored" << std::endl;
+	}
+	auto enabledExtension = filterDeviceExtension(physicalDevice, extension, optionalExtensionOffset);
+	//8 bit indices, otherwise they are widened to 16 bit at upload
+	VkPhysicalDeviceIndexTypeUint8FeaturesEXT featuresUint8{};
+	featuresUint8.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+	if (hasExtension(enabledExtension, VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME)) {
+		VkPhysicalDeviceIndexTypeUint8FeaturesEXT supportedUint8{};
+		supportedUint8.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+		supported2.pNext = &supportedUint8;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supported2);
+		featuresUint8.indexTypeUint8 = supportedUint8.indexTypeUint8;
+		features12.pNext = &featuresUint8;
+	}
+	indexTypeUint8Supported = featuresUint8.indexTypeUint8;
+	//timestamps are written on the graphics queue, its valid bits tell whether it has them at all
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	uint32_t familyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> familyProperties(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, familyProperties.data());
+	auto validBits = familyProperties[queueFamily.graphics].timestampValidBits;
+	if (validBits > 0) {
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+	}
+	if (gpuTimestamp && !useGpuTimestamp()) {
+		std::cout << "gpu timestamp not supported on the graphics queue" << std::endl;
+	}
 
 	VkDeviceCreateInfo info{};
 	info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	info.pNext = &features12;
 	info.pQueueCreateInfos = queueCreate.data();
 	info.queueCreateInfoCount = static_cast<uint32_t>(queueCreate.size());
 	info.pEnabledFeatures = &features;
 	info.enabledLayerCount = static_cast<uint32_t>(validationLayer.size());
 	info.ppEnabledLayerNames = validationLayer.data();
-	info.enabledExtensionCount = static_cast<uint32_t>(extension.size());
-	info.ppEnabledExtensionNames = extension.data();
+	info.enabledExtensionCount = static_cast<uint32_t>(enabledExtension.size());
+	info.ppEnabledExtensionNames = enabledExtension.data();
 
 	if (vkCreateDevice(physicalDevice, &info, nullptr, &device) != VK_SUCCESS) {
 		return false;
@@ -177,6 +301,8 @@ bool VulkanEnv::createDevice() {
 	pipelineGroup.setDevice(device);
 	vkGetDeviceQueue(device, queueFamily.graphics, 0, &graphicsQueue);
 	vkGetDeviceQueue(device, queueFamily.present, 0, &presentQueue);
+	vkGetDeviceQueue(device, queueFamily.transfer, 0, &transferQueue);
+	uploader.setQueue(transferQueue, queueFamily.transfer, graphicsQueue, queueFamily.graphics);
 	return true;
 }
 
@@ -191,6 +317,7 @@ bool VulkanEnv::createAllocator() {
 		return false;
 	}
 	swapchain.setAllocator(vmaAllocator);
+	uploader.setDevice(device, vmaAllocator);
 	return true;
 }
 
@@ -239,23 +366,46 @@ bool VulkanEnv::createRenderPass() {
 	subpass.preserveAttachmentCount = 0;
 	subpass.pPreserveAttachments = nullptr;
 
+	//with the prepass the depth is final before any colour is shaded, the colour subpass only tests it
+	VkSubpassDescription depthSubpass = subpass;
+	depthSubpass.colorAttachmentCount = 0;
+	depthSubpass.pColorAttachments = nullptr;
+	VkAttachmentReference depthReadOnlyRef;
+	depthReadOnlyRef.attachment = 1;
+	depthReadOnlyRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	if (depthPrepass) {
+		subpass.pDepthStencilAttachment = &depthReadOnlyRef;
+	}
+	auto colorSubpass = subpassCount() - 1;
+
 	VkSubpassDependency dependency;
 	dependency.dependencyFlags = 0;
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
+	dependency.dstSubpass = colorSubpass;
 	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependency.srcAccessMask = 0;
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+	//prepass depth writes are visible to the colour subpass's depth test, per pixel
+	VkSubpassDependency prepassDependency;
+	prepassDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	prepassDependency.srcSubpass = 0;
+	prepassDependency.dstSubpass = 1;
+	prepassDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	prepassDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	prepassDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	prepassDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	VkSubpassDependency dependencyList[]{ dependency, prepassDependency };
+
 	VkRenderPassCreateInfo renderPassInfo;
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.flags = 0;
 	renderPassInfo.pNext = nullptr;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = subpassCount();
+	renderPassInfo.pDependencies = dependencyList;
 
 	VkAttachmentDescription attachments[3];
 	renderPassInfo.pAttachments = attachments;
@@ -287,6 +437,12 @@ bool VulkanEnv::createRenderPass() {
 		attachments[1] = depthAttachment;
 		renderPassInfo.attachmentCount = 2;
 	}
+	//copied after the resolve attachment is set
+	VkSubpassDescription subpassList[]{ depthSubpass, subpass };
+	if (depthPrepass) {
+		renderPassInfo.subpassCount = 2;
+		renderPassInfo.pSubpasses = subpassList;
+	}
 
 	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 		return false;
@@ -295,6 +451,10 @@ bool VulkanEnv::createRenderPass() {
 	return true;
 }
 
+bool VulkanEnv::createPipelineCache() {
+	return pipelineGroup.createPipelineCache(physicalDevice, pipelineCachePath);
+}
+
 bool VulkanEnv::createDescriptorSetLayout() {
 	auto& prototypeList = renderingData->getPrototypeList();
 	//TODO create descriptor set for each prototype
@@ -320,17 +480,46 @@ bool VulkanEnv::createDescriptorSetLayout() {
 	sampler.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	sampler.pImmutableSamplers = nullptr;
 
-	VkDescriptorSetLayoutBinding binding[]{ uniformMatrix, uniformLight, sampler };
+	VkDescriptorSetLayoutBinding storageDraw;
+	storageDraw.binding = 3;
+	storageDraw.descriptorCount = 1;
+	storageDraw.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	storageDraw.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	storageDraw.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding binding[]{ uniformMatrix, uniformLight, sampler, storageDraw };
 	VkDescriptorSetLayoutCreateInfo uniformInfo;
 	uniformInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	uniformInfo.flags = 0;
 	uniformInfo.pNext = nullptr;
-	uniformInfo.bindingCount = 3;
+	uniformInfo.bindingCount = 4;
 	uniformInfo.pBindings = binding;
 	if (vkCreateDescriptorSetLayout(device, &uniformInfo, nullptr, &descriptorSetLayoutUniform) != VK_SUCCESS) {
 		return false;
 	}
 
+	if (useGpuCulling()) {
+		//matrix, draw data, input commands, cull data, output commands, bucket counts
+		std::array<VkDescriptorSetLayoutBinding, 6> cullBinding;
+		for (uint32_t n = 0; n < cullBinding.size(); ++n) {
+			auto& value = cullBinding[n];
+			value.binding = n;
+			value.descriptorType = n == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			value.descriptorCount = 1;
+			value.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			value.pImmutableSamplers = nullptr;
+		}
+		VkDescriptorSetLayoutCreateInfo cullInfo;
+		cullInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		cullInfo.flags = 0;
+		cullInfo.pNext = nullptr;
+		cullInfo.bindingCount = static_cast<uint32_t>(cullBinding.size());
+		cullInfo.pBindings = cullBinding.data();
+		if (vkCreateDescriptorSetLayout(device, &cullInfo, nullptr, &descriptorSetLayoutCull) != VK_SUCCESS) {
+			return false;
+		}
+	}
+
 	const auto& matPrototypeList = materialManager->getPrototypeList();
 	descriptorSetLayoutMaterial.resize(matPrototypeList.size());
 	for (auto k = 0; k < matPrototypeList.size(); ++k) {
@@ -370,42 +559,99 @@ bool VulkanEnv::createDescriptorSetLayout() {
 bool VulkanEnv::createGraphicsPipelineLayout() {
 	//TODO multiple layout
 	VkDescriptorSetLayout layout[]{ descriptorSetLayoutUniform, descriptorSetLayoutMaterial[0] };
-	if (!createGraphicsPipelineLayoutWithVertexConst(device, layout, 2, &graphicsPipelineLayout)) {
+	if (!createPipelineLayout(device, layout, 2, &graphicsPipelineLayout)) {
 		return false;
 	}
-	swapchain.setGraphicsPipelineLayout(graphicsPipelineLayout);
 	return true;
 }
 
 bool VulkanEnv::createGraphicsPipeline() {
-	//TODO
-	auto& shader = shaderManager->getShaderAt(0);
-	if (!pipelineGroup.createGraphicsPipeline(shader, graphicsPipelineLayout, renderPass, swapchain)) {
+	//materials sharing a shader & a texture set share a pipeline, absent maps are compiled out by specialization
+	std::vector<PipelineVariant> variant;
+	std::vector<std::pair<int, int>> variantKey;//shader, prototype
+	const auto& matList = materialManager->getMaterialList();
+	const auto& prototypeList = materialManager->getPrototypeList();
+	materialVariant.assign(matList.size(), 0);
+	for (size_t k = 0; k < matList.size(); ++k) {
+		const auto& mat = matList[k];
+		auto shaderIndex = mat.getShaderIndex();
+		if (shaderIndex < 0 || static_cast<size_t>(shaderIndex) >= shaderManager->count()
+			|| shaderManager->getShaderAt(shaderIndex).isCompute() || shaderManager->getShaderAt(shaderIndex).getFragData().empty()) {
+			std::cout << "material " << k << " shader " << shaderIndex << " is not a graphics shader, shader 0 is used" << std::endl;
+			shaderIndex = 0;
+		}
+		std::pair<int, int> key{ shaderIndex, mat.getPrototypeIndex() };
+		auto found = std::find(variantKey.begin(), variantKey.end(), key);
+		materialVariant[k] = static_cast<uint32_t>(found - variantKey.begin());
+		if (found == variantKey.end()) {
+			variantKey.push_back(key);
+			variant.push_back({ &shaderManager->getShaderAt(shaderIndex), prototypeList[key.second].textureMask });
+		}
+	}
+	if (variant.empty()) {
+		variant.push_back({ &shaderManager->getShaderAt(0), 0 });
+	}
+	auto threadCount = std::max(1u, std::thread::hardware_concurrency());
+	if (!pipelineGroup.createGraphicsPipeline(variant, graphicsPipelineLayout, renderPass, swapchain, vertexFormat,
+		depthPrepass ? DepthMode::Equal : DepthMode::Write, threadCount)) {
+		return false;
+	}
+	if (!depthPrepass) {
+		return true;
+	}
+	if (depthShaderIndex < 0 || static_cast<size_t>(depthShaderIndex) >= shaderManager->count() || shaderManager->getShaderAt(depthShaderIndex).isCompute()) {
+		std::cout << "depth shader is not a vertex shader" << std::endl;
+		return false;
+	}
+	if (!pipelineGroup.createDepthPipeline(shaderManager->getShaderAt(depthShaderIndex), graphicsPipelineLayout, renderPass, swapchain, vertexFormat)) {
 		return false;
 	}
-	swapchain.setGraphicsPipeline(pipelineGroup.getGraphicsPipeline());
 	return true;
 }
 
+bool VulkanEnv::createCullPipeline() {
+	if (!useGpuCulling()) {
+		return true;
+	}
+	if (cullShaderIndex < 0 || static_cast<size_t>(cullShaderIndex) >= shaderManager->count() || !shaderManager->getShaderAt(cullShaderIndex).isCompute()) {
+		std::cout << "cull shader is not a compute shader" << std::endl;
+		return false;
+	}
+	VkPushConstantRange pushConstant;
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(uint32_t);//command count
+	if (!createPipelineLayout(device, &descriptorSetLayoutCull, 1, &cullPipelineLayout, &pushConstant, 1)) {
+		return false;
+	}
+	return pipelineGroup.createComputePipeline(shaderManager->getShaderAt(cullShaderIndex), cullPipelineLayout);
+}
+
 bool VulkanEnv::createTextureImage(const std::vector<ImageInput>& textureList) {
-	//TODO batch submit
-	for (auto& texture : textureList) {
-		if (!texture.isValid()) {
-			continue;
-		}
-		auto size = texture.getByteSize();
-		VkBuffer stagingBuffer;
-		VmaAllocation stagingBufferAllocation;
-		if (!createStagingBuffer(vmaAllocator, size, stagingBuffer, stagingBufferAllocation)) {
-			return false;
+	//the uploader flushes on its own whenever the staging ring fills up
+	if (!uploader.begin()) {
+		return false;
+	}
+	//a slot that failed to load still gets an image, material texture indices address imageSet directly
+	ImageInput placeholder;
+	{
+		std::vector<ImageLevel> level{ { 0, 4, 1, 1 } };
+		std::vector<uint8_t> data{ 255, 255, 255, 255 };
+		placeholder.setBaked(ImageFormat::Rgba8, std::move(level), std::move(data));
+	}
+	for (const auto& input : textureList) {
+		const auto* textureRef = input.isValid() ? &input : &placeholder;
+		ImageInput decompressed;
+		if (blockSize(textureRef->getFormat()) > 0 && !textureCompressionBCSupported) {
+			std::vector<ImageLevel> level;
+			std::vector<uint8_t> data;
+			decompressMipChain(input.getFormat(), input.getLevel(), input.pixel(), level, data);
+			decompressed.setBaked(ImageFormat::Rgba8, std::move(level), std::move(data));
+			decompressed.setSrgb(input.isSrgb());
+			textureRef = &decompressed;
 		}
-
-		void* buffer;
-		vmaMapMemory(vmaAllocator, stagingBufferAllocation, &buffer);
-		memcpy(buffer, texture.pixel(), size);
-		vmaUnmapMemory(vmaAllocator, stagingBufferAllocation);
-
-		ImageOption option = { texture.getMipLevel(), VK_FORMAT_R8G8B8A8_SRGB };
+		const auto& texture = *textureRef;
+		ImageOption option = { texture.getMipLevel(), imageFormat(texture.getFormat(), texture.isSrgb()) };
 		VkImage image;
 		VmaAllocation imageAllocation;
 		VkImageCreateInfo info;
@@ -435,35 +681,27 @@ bool VulkanEnv::createTextureImage(const std::vector<ImageInput>& textureList) {
 		info.samples = VK_SAMPLE_COUNT_1_BIT;
 		info.queueFamilyIndexCount = 0;
 		info.pQueueFamilyIndices = nullptr;
-		createImage(vmaAllocator, info, image, imageAllocation);
-		imageSet.image.push_back(image);
-		imageSet.option.push_back(std::move(option));
-		imageSet.allocation.push_back(imageAllocation);
-
-		VkCommandBuffer cmd;
-		allocateCommandBuffer(commandPool, 1, &cmd);
-		if (!beginCommand(cmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT)) {
+		if (!createImage(vmaAllocator, info, image, imageAllocation)) {
 			return false;
 		}
-		cmdTransitionImageLayout(cmd, physicalDevice, image, option, info.initialLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-		cmdCopyImage(cmd, stagingBuffer, image, texture.getWidth(), texture.getHeight(), 0);
-		if (texture.shouldGenerateMipmap()) {
-			cmdGenerateTextureMipmap(cmd, image, option, texture.getWidth(), texture.getHeight());
-		}
-		else {
-			cmdTransitionImageLayout(cmd, physicalDevice, image, option, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		}
+		imageSet.image.push_back(image);
+		imageSet.option.push_back(option);
+		imageSet.allocation.push_back(imageAllocation);
 
-		if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+		if (!uploader.stageImage(texture, image, option, info.initialLayout)) {
 			return false;
 		}
-
-		vkResetFences(device, 1, &fenceImageCopy);
-		submitCommand(&cmd, 1, graphicsQueue, fenceImageCopy);
-		vkWaitForFences(device, 1, &fenceImageCopy, VK_TRUE, UINT64_MAX);
-
-		vmaDestroyBuffer(vmaAllocator, stagingBuffer, stagingBufferAllocation);
 	}
+	//all copies/transitions/mip blits go out in as few submits per queue as the ring allows
+	if (!uploader.submit()) {
+		return false;
+	}
+	//startup only, runtime uploads are waited on by frame submission instead
+	if (!uploader.wait()) {
+		return false;
+	}
+	logUploadStat("texture upload", uploader.getTotalStat());
+	logStagingRingStat(uploader.getRingStat());
 	return true;
 }
 
@@ -473,11 +711,13 @@ bool VulkanEnv::createTextureImageView() {
 		const auto& image = imageSet.image[i];
 		const auto& option = imageSet.option[i];
 		VkImageView view;
-		if (!createImageView(device, image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, option.mipLevel, view)) {
+		//same format as the image, it has no mutable format flag
+		if (!createImageView(device, image, option.format, VK_IMAGE_ASPECT_COLOR_BIT, option.mipLevel, view)) {
 			return false;
 		}
 		imageSet.view.push_back(view);
 	}
+	++materialDescriptorVersion;
 	return true;
 }
 
@@ -500,7 +740,12 @@ bool VulkanEnv::createTextureSampler() {
 	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	info.mipLodBias = 0.0f;
 	info.minLod = 0.0f;
-	info.maxLod = static_cast<float>(imageSet.option[0].mipLevel);
+	//one sampler for every texture, placeholders have a single level
+	uint32_t maxLevel = 1;
+	for (const auto& option : imageSet.option) {
+		maxLevel = std::max(maxLevel, option.mipLevel);
+	}
+	info.maxLod = static_cast<float>(maxLevel);
 	VkSampler sampler;
 	if (vkCreateSampler(device, &info, nullptr, &sampler) != VK_SUCCESS) {
 		return false;
@@ -510,113 +755,160 @@ bool VulkanEnv::createTextureSampler() {
 }
 
 bool VulkanEnv::setupFence() {
-	VkFenceCreateInfo fenceInfo;
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = 0;
-	fenceInfo.pNext = nullptr;
-	return vkCreateFence(device, &fenceInfo, nullptr, &fenceVertexIndexCopy) == VK_SUCCESS &&
-		vkCreateFence(device, &fenceInfo, nullptr, &fenceImageCopy) == VK_SUCCESS;
+	return uploader.create(StagingRingSize);
 }
 
 bool VulkanEnv::createVertexBufferIndice() {
 	auto& input = renderingData->getRenderList();
-	uint32_t vCount = 0, vSize = 0, iSize = 0;
+	uint32_t vCount = 0, iSize = 0;
+	//draws in render list order, instance nodes point at the geometry of their source node
+	std::vector<uint32_t> drawGeometry;
+	std::vector<DrawInfo> drawInfo;
+	std::vector<glm::vec4> bound;
 	for (const auto& vertexInput : input) {
-		for (const auto& mesh : vertexInput->getMeshList()) {
+		const auto& meshList = vertexInput->getMeshList();
+		std::vector<uint32_t> nodeGeometry(meshList.size());
+		for (size_t n = 0; n < meshList.size(); ++n) {
+			const auto& mesh = meshList[n];
+			if (mesh.getInstanceOf() > -1) {
+				nodeGeometry[n] = nodeGeometry[mesh.getInstanceOf()];
+			}
+			else {
+				nodeGeometry[n] = static_cast<uint32_t>(indexBuffer.offset.size());
+				for (const auto& view : mesh.getView()) {
+					auto indexType = uploadIndexType(view.indexStride);
+					//binding offsets must be a multiple of the index size, 4 covers every type
+					iSize = (iSize + 3) & ~3u;
+					indexBuffer.offset.push_back(iSize);
+					indexBuffer.vOffset.push_back(vCount);
+					indexBuffer.indexType.push_back(indexType);
+					indexBuffer.lodBase.push_back(static_cast<uint32_t>(indexBuffer.lodFirstIndex.size()));
+					indexBuffer.lodCount.push_back(view.lodCount);
+					for (uint32_t l = 0; l < view.lodCount; ++l) {
+						indexBuffer.lodFirstIndex.push_back(view.lod[l].firstIndex);
+						indexBuffer.lodIndexCount.push_back(view.lod[l].indexCount);
+					}
+					vCount += view.vertexCount;
+					//every lod range goes in, they follow the full mesh
+					iSize += view.indexSize / view.indexStride * indexTypeSize(indexType);
+				}
+			}
+			uint32_t k = 0;
 			for (const auto& view : mesh.getView()) {
-				indexBuffer.offset.push_back(iSize);
-				indexBuffer.vOffset.push_back(vCount);
-				indexBuffer.iCount.push_back(view.indexCount);
-				indexBuffer.drawInfo.push_back(DrawInfo{ view.materialIndex, &mesh.getConstantData() });
-				vSize += view.vertexSize;
-				vCount += view.vertexCount;
-				iSize += view.indexSize;
+				drawGeometry.push_back(nodeGeometry[n] + k++);
+				DrawInfo info{ view.materialIndex, &mesh.getConstantData() };
+				positionDequantize(vertexFormat, view.aabbMin, view.aabbMax, info.positionOffset, info.positionScale);
+				drawInfo.push_back(info);
+				bound.push_back(view.bound);
 			}
 		}
 	}
-
-	//TODO merge memory block alloc
-	VkBuffer stagingVBuffer;
-	VmaAllocation stagingVBufferAllocation;
-	auto vBufferSuccess = createStagingBuffer(vmaAllocator, vSize, stagingVBuffer, stagingVBufferAllocation);
-	VkBuffer stagingIBuffer;
-	VmaAllocation stagingIBufferAllocation;
-	auto iBufferSuccess = createStagingBuffer(vmaAllocator, vSize, stagingIBuffer, stagingIBufferAllocation);
-	if(!vBufferSuccess || !iBufferSuccess) {
-		return false;
+	//draws are ordered by pipeline, then material, then geometry, so every pipeline & set is bound once per run of draws
+	//instances of a geometry end up adjacent, so their draw data is one firstInstance range
+	auto drawCount = static_cast<uint32_t>(drawGeometry.size());
+	std::vector<uint32_t> order(drawCount);
+	for (uint32_t i = 0; i < drawCount; ++i) {
+		order[i] = i;
 	}
-
-	void* vData;
-	void* iData;
-	vSize = 0;
-	iSize = 0;
-	vmaMapMemory(vmaAllocator, stagingVBufferAllocation, &vData);
-	vmaMapMemory(vmaAllocator, stagingIBufferAllocation, &iData);
-	for (const auto& vertexInput : input) {
-		for (const auto& mesh : vertexInput->getMeshList()) {
-			for (const auto& view : mesh.getView()) {
-				memcpy((uint8_t*)vData + vSize, vertexInput->bufferData(view.bufferIndex) + view.vertexOffset, view.vertexSize);
-				memcpy((uint8_t*)iData + iSize, vertexInput->bufferData(view.bufferIndex) + view.indexOffset, view.indexSize);
-				vSize += view.vertexSize;
-				iSize += view.indexSize;
-			}
+	std::stable_sort(order.begin(), order.end(), [this, &drawGeometry, &drawInfo](uint32_t a, uint32_t b) {
+		auto variantA = drawVariant(drawInfo[a].setIndex);
+		auto variantB = drawVariant(drawInfo[b].setIndex);
+		if (variantA != variantB) {
+			return variantA < variantB;
 		}
+		if (drawInfo[a].setIndex != drawInfo[b].setIndex) {
+			return drawInfo[a].setIndex < drawInfo[b].setIndex;
+		}
+		return drawGeometry[a] < drawGeometry[b];
+	});
+	indexBuffer.drawSlot.resize(drawCount);
+	for (uint32_t slot = 0; slot < drawCount; ++slot) {
+		auto i = order[slot];
+		indexBuffer.drawInfo.push_back(drawInfo[i]);
+		indexBuffer.geometry.push_back(drawGeometry[i]);
+		indexBuffer.drawSlot[i] = slot;
+		drawBound.push_back(bound[i]);
 	}
-	vmaUnmapMemory(vmaAllocator, stagingVBufferAllocation);
-	vmaUnmapMemory(vmaAllocator, stagingIBufferAllocation);
+	std::cout << indexBuffer.offset.size() << " geometry, " << drawCount << " draw" << std::endl;
 
-	VkBuffer vBuffer;
-	VmaAllocation vAllocation;
-	vBufferSuccess = createBuffer(vmaAllocator, vSize,
+	//one buffer per stream, vertexOffset of a draw indexes both
+	VkBuffer pBuffer, aBuffer;
+	VmaAllocation pAllocation, aAllocation;
+	auto pBufferSuccess = createBuffer(vmaAllocator, static_cast<VkDeviceSize>(vCount) * positionStride(vertexFormat),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VMA_MEMORY_USAGE_GPU_ONLY, pBuffer, pAllocation);
+	auto aBufferSuccess = createBuffer(vmaAllocator, static_cast<VkDeviceSize>(vCount) * attributeStride(vertexFormat),
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY, vBuffer, vAllocation);
+		VMA_MEMORY_USAGE_GPU_ONLY, aBuffer, aAllocation);
 	VkBuffer iBuffer;
 	VmaAllocation iAllocation;
-	iBufferSuccess = createBuffer(vmaAllocator, iSize,
+	auto iBufferSuccess = createBuffer(vmaAllocator, iSize,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 		VMA_MEMORY_USAGE_GPU_ONLY, iBuffer, iAllocation);
-	if (!vBufferSuccess || !iBufferSuccess) {
+	if (!pBufferSuccess || !aBufferSuccess || !iBufferSuccess) {
 		return false;
 	}
 
-	VkCommandBuffer copyCmd;
-	if (!allocateCommandBuffer(commandPool, 1, &copyCmd)) {
+	if (!uploader.begin()) {
 		return false;
 	}
-	if (!beginCommand(copyCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT)) {
-		return false;
-	}
-
-	VkBufferCopy vCopy;
-	vCopy.srcOffset = 0;
-	vCopy.dstOffset = 0;
-	vCopy.size = vSize;
-	vkCmdCopyBuffer(copyCmd, stagingVBuffer, vBuffer, 1, &vCopy);
-	VkBufferCopy iCopy;
-	iCopy.srcOffset = 0;
-	iCopy.dstOffset = 0;
-	iCopy.size = iSize;
-	vkCmdCopyBuffer(copyCmd, stagingIBuffer, iBuffer, 1, &iCopy);
-
-	if (vkEndCommandBuffer(copyCmd) != VK_SUCCESS) {
-		return false;
+	vCount = 0;
+	size_t geometry = 0;
+	std::vector<uint16_t> widened;
+	std::vector<uint8_t> converted;
+	for (const auto& vertexInput : input) {
+		for (const auto& mesh : vertexInput->getMeshList()) {
+			if (mesh.getInstanceOf() > -1) {
+				continue;
+			}
+			for (const auto& view : mesh.getView()) {
+				const auto* data = vertexInput->bufferData(view.bufferIndex);
+				const void* index = data + view.indexOffset;
+				VkDeviceSize indexSize = view.indexSize;
+				if (indexTypeSize(indexBuffer.indexType[geometry]) != view.indexStride) {
+					//8 bit indices on a device without VK_EXT_index_type_uint8
+					widened.assign(data + view.indexOffset, data + view.indexOffset + view.indexSize);
+					index = widened.data();
+					indexSize = widened.size() * sizeof(uint16_t);
+				}
+				const auto* vertex = data + view.vertexOffset;
+				if (view.vertexFormat != vertexFormat) {
+					//set up in the other layout, e.g. the built in test meshes
+					convertVertices(data + view.vertexOffset, view.vertexFormat, view.vertexCount, view.aabbMin, view.aabbMax, vertexFormat, converted);
+					vertex = converted.data();
+				}
+				//the view holds the position stream then the attribute stream
+				VkDeviceSize positionSize = static_cast<VkDeviceSize>(view.vertexCount) * positionStride(vertexFormat);
+				VkDeviceSize attributeSize = static_cast<VkDeviceSize>(view.vertexCount) * attributeStride(vertexFormat);
+				if (!uploader.stageBuffer(vertex, positionSize, pBuffer, static_cast<VkDeviceSize>(vCount) * positionStride(vertexFormat), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT) ||
+					!uploader.stageBuffer(vertex + positionSize, attributeSize, aBuffer, static_cast<VkDeviceSize>(vCount) * attributeStride(vertexFormat), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT) ||
+					!uploader.stageBuffer(index, indexSize, iBuffer, indexBuffer.offset[geometry], VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)) {
+					return false;
+				}
+				vCount += view.vertexCount;
+				++geometry;
+			}
+		}
 	}
-
-	if (!submitCommand(&copyCmd, 1, graphicsQueue, fenceVertexIndexCopy)) {
+	updateDrawRun();
+	if (!createIndirectBuffer()) {
 		return false;
 	}
-	if (vkWaitForFences(device, 1, &fenceVertexIndexCopy, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+	//not waited on here, frame submission waits on the upload timeline
+	if (!uploader.submit()) {
 		return false;
 	}
 
-	vkFreeCommandBuffers(device, commandPool, 1, &copyCmd);
-	vmaDestroyBuffer(vmaAllocator, stagingVBuffer, stagingVBufferAllocation);
-	vmaDestroyBuffer(vmaAllocator, stagingIBuffer, stagingIBufferAllocation);
-
-	vertexBuffer.buffer.push_back(vBuffer);
+	//binding order of MeshNode::getBindingDescription
+	vertexBuffer.buffer.push_back(pBuffer);
+	vertexBuffer.offset.push_back(0);
+	vertexBuffer.allocation.push_back(pAllocation);
+	vertexBuffer.buffer.push_back(aBuffer);
 	vertexBuffer.offset.push_back(0);
-	vertexBuffer.allocation.push_back(vAllocation);
+	vertexBuffer.allocation.push_back(aAllocation);
 	indexBuffer.buffer = iBuffer;
+	renderListVersion = renderingData->getRenderListVersion();
+	invalidateCommandBuffer();
 	indexBuffer.allocation = iAllocation;
 	return true;
 }
@@ -624,25 +916,67 @@ bool VulkanEnv::createVertexBufferIndice() {
 bool VulkanEnv::createUniformBuffer() {
 	uniformBufferMatrix.resize(swapchain.size());
 	uniformBufferLight.resize(swapchain.size());
-	swapchain.reserveForBufferCreate(swapchain.size() * 2);
+	storageBufferDraw.resize(swapchain.size());
+	cullCommandBuffer.resize(useGpuCulling() ? swapchain.size() : 0);
+	cullCountBuffer.resize(useGpuCulling() ? swapchain.size() : 0);
+	perImageBuffer.reserve(perImageBuffer.size() + swapchain.size() * (useGpuCulling() ? 5 : 3));
+	//one entry per draw, indexed with the draw's firstInstance
+	auto drawDataSize = std::max<VkDeviceSize>(1, indexBuffer.drawInfo.size()) * sizeof(DrawData);
+	auto commandSize = std::max<VkDeviceSize>(1, indexBuffer.drawInfo.size()) * sizeof(VkDrawIndexedIndirectCommand);
+	auto countSize = std::max<VkDeviceSize>(1, indirectBuffer.bucket.size()) * sizeof(uint32_t);
+	//cached uniform descriptor sets point at the old buffers
+	++uniformDescriptorVersion;
 	for (uint32_t i = 0; i < swapchain.size(); ++i) {
-		if (!swapchain.createBuffer(sizeof(MatrixUniformBufferData),
+		if (!createPerImageBuffer(sizeof(MatrixUniformBufferData),
 				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 				VMA_MEMORY_USAGE_CPU_TO_GPU, uniformBufferMatrix[i]) || 
-			!swapchain.createBuffer(sizeof(LightUniformBufferData),
+			!createPerImageBuffer(sizeof(LightUniformBufferData),
 				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VMA_MEMORY_USAGE_CPU_TO_GPU, uniformBufferLight[i])) {
+				VMA_MEMORY_USAGE_CPU_TO_GPU, uniformBufferLight[i]) ||
+			!createPerImageBuffer(drawDataSize,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VMA_MEMORY_USAGE_CPU_TO_GPU, storageBufferDraw[i])) {
+			return false;
+		}
+		//culling output is per image, a frame in flight keeps reading its own commands
+		if (useGpuCulling() && (
+			!createPerImageBuffer(commandSize,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY, cullCommandBuffer[i]) ||
+			!createPerImageBuffer(countSize,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY, cullCountBuffer[i]))) {
 			return false;
 		}
 	}
 	return true;
 }
 
+bool VulkanEnv::createPerImageBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage allocUsage, const Buffer*& buffer) {
+	Buffer created;
+	if (!createBuffer(vmaAllocator, size, usage, allocUsage, created.buffer, created.allocation)) {
+		return false;
+	}
+	perImageBuffer.push_back(std::move(created));
+	buffer = &perImageBuffer.back();
+	return true;
+}
+
 bool VulkanEnv::prepareDescriptor() {
-	descriptorPoolFree.reserve(swapchain.size());
-	descriptorSet.resize(swapchain.size());
-	for (auto& pool : descriptorPoolFree) {
-		if (!createDescriptorPool(0, pool)) {
+	descriptorCache.resize(swapchain.size());
+	//one pool per image, missing ones are created up front into the free list
+	auto required = std::count_if(descriptorCache.begin(), descriptorCache.end(), [](const DescriptorCache& cache) {
+		return cache.pool == VK_NULL_HANDLE;
+	});
+	auto offset = descriptorPoolFree.size();
+	descriptorPoolFree.resize(offset + static_cast<size_t>(required));
+	for (auto i = offset; i < descriptorPoolFree.size(); ++i) {
+		if (!createDescriptorPool(0, descriptorPoolFree[i])) {
+			return false;
+		}
+	}
+	for (auto& cache : descriptorCache) {
+		if (cache.pool == VK_NULL_HANDLE && !requestDescriptorPool(0, cache.pool)) {
 			return false;
 		}
 	}
@@ -651,16 +985,19 @@ bool VulkanEnv::prepareDescriptor() {
 
 bool VulkanEnv::createDescriptorPool(int requirement, VkDescriptorPool& pool) {
 	uint32_t imageCount = static_cast<uint32_t>(imageSet.image.size());//TODO this assumes no empty/unset material texture
-	uint32_t materialCount = static_cast<uint32_t>(descriptorSetLayoutMaterial.size());
+	uint32_t materialCount = static_cast<uint32_t>(materialManager->count());
 	uint32_t imageSetCount = materialCount * TestMaxTextureCount;//TODO
+	uint32_t cullSetCount = useGpuCulling() ? 1 : 0;
 	//these determines the pool capacity
-	std::array<VkDescriptorPoolSize, 3> poolSize;
+	std::array<VkDescriptorPoolSize, 4> poolSize;
 	poolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[0].descriptorCount = 2 + materialCount;//matrix + light + per material
+	poolSize[0].descriptorCount = 2 + materialCount + cullSetCount;//matrix + light + per material + cull matrix
 	poolSize[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
 	poolSize[1].descriptorCount = 1;
 	poolSize[2].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
 	poolSize[2].descriptorCount = imageSetCount;
+	poolSize[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize[3].descriptorCount = 1 + cullSetCount * 5;
 
 	VkDescriptorPoolCreateInfo info;
 	info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -669,119 +1006,215 @@ bool VulkanEnv::createDescriptorPool(int requirement, VkDescriptorPool& pool) {
 	info.poolSizeCount = static_cast<uint32_t>(poolSize.size());
 	info.pPoolSizes = poolSize.data();
 	//this limits the set count can be allocated
-	info.maxSets = imageSetCount + 2;
+	info.maxSets = materialCount + 1 + cullSetCount;
 
 	return vkCreateDescriptorPool(device, &info, nullptr, &pool) == VK_SUCCESS;
 }	 
 
-bool VulkanEnv::setupDescriptorSet(int imageIndex, VkDescriptorPool pool) {
-	uint32_t materialLayoutCount = static_cast<uint32_t>(descriptorSetLayoutMaterial.size());
+bool VulkanEnv::allocateDescriptorSet(DescriptorCache& cache) {
+	//sets are allocated per material, with the layout of its prototype
+	const auto& matList = materialManager->getMaterialList();
+	std::vector<VkDescriptorSetLayout> layout;
+	layout.reserve(matList.size());
+	for (const auto& mat : matList) {
+		layout.push_back(descriptorSetLayoutMaterial[mat.getPrototypeIndex()]);
+	}
+
+	vkResetDescriptorPool(device, cache.pool, 0);
+	cache.materialSet.resize(matList.size());
+	cache.uniformVersion = 0;
+	cache.materialVersion = 0;
+
 	VkDescriptorSetAllocateInfo info1;
 	info1.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	info1.pNext = nullptr;
-	info1.descriptorPool = pool;
+	info1.descriptorPool = cache.pool;
 	info1.descriptorSetCount = 1;
 	info1.pSetLayouts = &descriptorSetLayoutUniform;
 
 	VkDescriptorSetAllocateInfo info2;
 	info2.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	info2.pNext = nullptr;
-	info2.descriptorPool = pool;
-	info2.descriptorSetCount = materialLayoutCount;
-	info2.pSetLayouts = descriptorSetLayoutMaterial.data();
-
-	auto& descriptorSetPerSwapchain = descriptorSet[imageIndex];
-	descriptorSetPerSwapchain.resize(materialLayoutCount + 1);//TODO reserve? then where to shrink it
-	auto result1 = vkAllocateDescriptorSets(device, &info1, descriptorSetPerSwapchain.data() + materialLayoutCount);
-	auto result2 = vkAllocateDescriptorSets(device, &info2, descriptorSetPerSwapchain.data());
-	if (result1 != VK_SUCCESS || result2 != VK_SUCCESS) {
+	info2.descriptorPool = cache.pool;
+	info2.descriptorSetCount = static_cast<uint32_t>(layout.size());
+	info2.pSetLayouts = layout.data();
+
+	auto result1 = vkAllocateDescriptorSets(device, &info1, &cache.uniformSet);
+	auto result2 = layout.empty() ? VK_SUCCESS : vkAllocateDescriptorSets(device, &info2, cache.materialSet.data());
+	auto result3 = VK_SUCCESS;
+	if (useGpuCulling()) {
+		VkDescriptorSetAllocateInfo info3 = info1;
+		info3.pSetLayouts = &descriptorSetLayoutCull;
+		result3 = vkAllocateDescriptorSets(device, &info3, &cache.cullSet);
+	}
+	if (result1 != VK_SUCCESS || result2 != VK_SUCCESS || result3 != VK_SUCCESS) {
+		cache.uniformSet = VK_NULL_HANDLE;
 		return false;
 	}
+	return true;
+}
+
+bool VulkanEnv::setupDescriptorSet(int imageIndex, bool& rewritten) {
+	rewritten = false;
+	auto& cache = descriptorCache[imageIndex];
+	if (materialManager->getVersion() != materialVersion) {
+		materialVersion = materialManager->getVersion();
+		++materialDescriptorVersion;
+	}
+	//handles only change when the material count does, otherwise sets are rewritten in place
+	if (cache.uniformSet == VK_NULL_HANDLE || cache.materialSet.size() != static_cast<size_t>(materialManager->count())) {
+		if (!allocateDescriptorSet(cache)) {
+			return false;
+		}
+	}
+	bool uniformStale = cache.uniformVersion != uniformDescriptorVersion;
+	bool materialStale = cache.materialVersion != materialDescriptorVersion;
+	if (!uniformStale && !materialStale) {
+		return true;
+	}
 
-	auto maxTextureCountPerMaterial = 3;
+	const auto& matList = materialManager->getMaterialList();
 	std::vector<VkWriteDescriptorSet> writeArr;
-	writeArr.reserve(3 + materialLayoutCount * maxTextureCountPerMaterial);
+	writeArr.reserve(10 + matList.size() * TestMaxTextureCount);
 
 	VkDescriptorBufferInfo matrixBufferInfo;
 	matrixBufferInfo.buffer = uniformBufferMatrix[imageIndex]->buffer;
 	matrixBufferInfo.offset = 0;
 	matrixBufferInfo.range = sizeof(MatrixUniformBufferData);
-	VkWriteDescriptorSet uniformMatrixWrite;
-	uniformMatrixWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	uniformMatrixWrite.pNext = nullptr;
-	uniformMatrixWrite.dstSet = descriptorSetPerSwapchain.back();
-	uniformMatrixWrite.dstBinding = 0;
-	uniformMatrixWrite.dstArrayElement = 0;
-	uniformMatrixWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uniformMatrixWrite.descriptorCount = 1;
-	uniformMatrixWrite.pBufferInfo = &matrixBufferInfo;
-	uniformMatrixWrite.pImageInfo = nullptr;
-	uniformMatrixWrite.pTexelBufferView = nullptr;
-	writeArr.push_back(std::move(uniformMatrixWrite));
-
 	VkDescriptorBufferInfo lightBufferInfo;
 	lightBufferInfo.buffer = uniformBufferLight[imageIndex]->buffer;
 	lightBufferInfo.offset = 0;
 	lightBufferInfo.range = sizeof(LightUniformBufferData);
-	VkWriteDescriptorSet uniformLightWrite;
-	uniformLightWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	uniformLightWrite.pNext = nullptr;
-	uniformLightWrite.dstSet = descriptorSetPerSwapchain.back();
-	uniformLightWrite.dstBinding = 1;
-	uniformLightWrite.dstArrayElement = 0;
-	uniformLightWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uniformLightWrite.descriptorCount = 1;
-	uniformLightWrite.pBufferInfo = &lightBufferInfo;
-	uniformLightWrite.pImageInfo = nullptr;
-	uniformLightWrite.pTexelBufferView = nullptr;
-	writeArr.push_back(std::move(uniformLightWrite));
-
 	VkDescriptorImageInfo samplerInfo;
 	samplerInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	samplerInfo.imageView = 0;
 	samplerInfo.sampler = imageSet.sampler[0];
-	VkWriteDescriptorSet samplerWrite;
-	samplerWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	samplerWrite.pNext = nullptr;
-	samplerWrite.dstSet = descriptorSetPerSwapchain.back();
-	samplerWrite.dstBinding = 2;
-	samplerWrite.dstArrayElement = 0;
-	samplerWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-	samplerWrite.descriptorCount = 1;
-	samplerWrite.pBufferInfo = nullptr;
-	samplerWrite.pImageInfo = &samplerInfo;
-	samplerWrite.pTexelBufferView = nullptr;
-	writeArr.push_back(std::move(samplerWrite));
-
-	std::vector<VkDescriptorImageInfo> imageInfoList(imageSet.image.size());
-	for (auto k = 0; k < imageSet.image.size(); ++k) {
-		VkDescriptorImageInfo& imageInfo = imageInfoList[k];
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = imageSet.view[k];
-		imageInfo.sampler = 0;
+	VkDescriptorBufferInfo drawBufferInfo;
+	drawBufferInfo.buffer = storageBufferDraw[imageIndex]->buffer;
+	drawBufferInfo.offset = 0;
+	drawBufferInfo.range = VK_WHOLE_SIZE;
+	std::array<VkDescriptorBufferInfo, 6> cullBufferInfo;
+	if (useGpuCulling()) {
+		VkBuffer cullBuffer[]{ uniformBufferMatrix[imageIndex]->buffer, storageBufferDraw[imageIndex]->buffer, indirectBuffer.buffer,
+			cullDataBuffer.buffer, cullCommandBuffer[imageIndex]->buffer, cullCountBuffer[imageIndex]->buffer };
+		for (auto n = 0; n < cullBufferInfo.size(); ++n) {
+			cullBufferInfo[n].buffer = cullBuffer[n];
+			cullBufferInfo[n].offset = 0;
+			cullBufferInfo[n].range = VK_WHOLE_SIZE;
+		}
 	}
 
-	const auto& matList = materialManager->getMaterialList();
-	for (auto k = 0; k < matList.size(); ++k) {
-		const auto& mat = matList[k];
-		const auto& texEntry = mat.getTextureEntry();
-		for (auto t = 0; t < texEntry.size(); ++t) {
-			VkWriteDescriptorSet textureWrite;
-			textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			textureWrite.pNext = nullptr;
-			textureWrite.dstSet = descriptorSetPerSwapchain[k];
-			textureWrite.dstBinding = t + 1;
-			textureWrite.dstArrayElement = 0;
-			textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-			textureWrite.descriptorCount = 1;
-			textureWrite.pBufferInfo = nullptr;
-			textureWrite.pImageInfo = &imageInfoList[texEntry[t].textureIndex];
-			textureWrite.pTexelBufferView = nullptr;
-			writeArr.push_back(std::move(textureWrite));
-		}
-	}
-
-	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeArr.size()), writeArr.data(), 0, nullptr);
+	if (uniformStale) {
+		VkWriteDescriptorSet uniformMatrixWrite;
+		uniformMatrixWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		uniformMatrixWrite.pNext = nullptr;
+		uniformMatrixWrite.dstSet = cache.uniformSet;
+		uniformMatrixWrite.dstBinding = 0;
+		uniformMatrixWrite.dstArrayElement = 0;
+		uniformMatrixWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uniformMatrixWrite.descriptorCount = 1;
+		uniformMatrixWrite.pBufferInfo = &matrixBufferInfo;
+		uniformMatrixWrite.pImageInfo = nullptr;
+		uniformMatrixWrite.pTexelBufferView = nullptr;
+		writeArr.push_back(std::move(uniformMatrixWrite));
+
+		VkWriteDescriptorSet uniformLightWrite;
+		uniformLightWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		uniformLightWrite.pNext = nullptr;
+		uniformLightWrite.dstSet = cache.uniformSet;
+		uniformLightWrite.dstBinding = 1;
+		uniformLightWrite.dstArrayElement = 0;
+		uniformLightWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uniformLightWrite.descriptorCount = 1;
+		uniformLightWrite.pBufferInfo = &lightBufferInfo;
+		uniformLightWrite.pImageInfo = nullptr;
+		uniformLightWrite.pTexelBufferView = nullptr;
+		writeArr.push_back(std::move(uniformLightWrite));
+
+		VkWriteDescriptorSet samplerWrite;
+		samplerWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		samplerWrite.pNext = nullptr;
+		samplerWrite.dstSet = cache.uniformSet;
+		samplerWrite.dstBinding = 2;
+		samplerWrite.dstArrayElement = 0;
+		samplerWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		samplerWrite.descriptorCount = 1;
+		samplerWrite.pBufferInfo = nullptr;
+		samplerWrite.pImageInfo = &samplerInfo;
+		samplerWrite.pTexelBufferView = nullptr;
+		writeArr.push_back(std::move(samplerWrite));
+
+		VkWriteDescriptorSet storageDrawWrite;
+		storageDrawWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		storageDrawWrite.pNext = nullptr;
+		storageDrawWrite.dstSet = cache.uniformSet;
+		storageDrawWrite.dstBinding = 3;
+		storageDrawWrite.dstArrayElement = 0;
+		storageDrawWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		storageDrawWrite.descriptorCount = 1;
+		storageDrawWrite.pBufferInfo = &drawBufferInfo;
+		storageDrawWrite.pImageInfo = nullptr;
+		storageDrawWrite.pTexelBufferView = nullptr;
+		writeArr.push_back(std::move(storageDrawWrite));
+
+		for (auto n = 0; useGpuCulling() && n < cullBufferInfo.size(); ++n) {
+			VkWriteDescriptorSet cullWrite;
+			cullWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			cullWrite.pNext = nullptr;
+			cullWrite.dstSet = cache.cullSet;
+			cullWrite.dstBinding = n;
+			cullWrite.dstArrayElement = 0;
+			cullWrite.descriptorType = n == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			cullWrite.descriptorCount = 1;
+			cullWrite.pBufferInfo = &cullBufferInfo[n];
+			cullWrite.pImageInfo = nullptr;
+			cullWrite.pTexelBufferView = nullptr;
+			writeArr.push_back(std::move(cullWrite));
+		}
+		cache.uniformVersion = uniformDescriptorVersion;
+	}
+
+	std::vector<VkDescriptorImageInfo> imageInfoList;
+	if (materialStale) {
+		imageInfoList.resize(imageSet.image.size());
+		for (auto k = 0; k < imageSet.image.size(); ++k) {
+			VkDescriptorImageInfo& imageInfo = imageInfoList[k];
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfo.imageView = imageSet.view[k];
+			imageInfo.sampler = 0;
+		}
+
+		for (auto k = 0; k < matList.size(); ++k) {
+			const auto& mat = matList[k];
+			//binding per slot, slots the material lacks get the first image, their variant never samples it
+			std::array<uint32_t, TestMaxTextureCount> slotImage{};
+			for (const auto& entry : mat.getTextureEntry()) {
+				slotImage[static_cast<size_t>(entry.slot)] = entry.textureIndex;
+			}
+			for (auto t = 0; t < TestMaxTextureCount && !imageInfoList.empty(); ++t) {
+				VkWriteDescriptorSet textureWrite;
+				textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				textureWrite.pNext = nullptr;
+				textureWrite.dstSet = cache.materialSet[k];
+				textureWrite.dstBinding = t + 1;
+				textureWrite.dstArrayElement = 0;
+				textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+				textureWrite.descriptorCount = 1;
+				textureWrite.pBufferInfo = nullptr;
+				textureWrite.pImageInfo = &imageInfoList[slotImage[t]];
+				textureWrite.pTexelBufferView = nullptr;
+				writeArr.push_back(std::move(textureWrite));
+			}
+		}
+		cache.materialVersion = materialDescriptorVersion;
+	}
+
+	if (!writeArr.empty()) {
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeArr.size()), writeArr.data(), 0, nullptr);
+		descriptorWriteCount += static_cast<uint32_t>(writeArr.size());
+	}
+	//sets bound by the recorded command buffer are no longer valid for it
+	rewritten = true;
 	return true;
 }
 
@@ -798,15 +1231,25 @@ bool VulkanEnv::createCommandPool() {
 	infoResetable.pNext = nullptr;
 	infoResetable.queueFamilyIndex = queueFamily.graphics;
 
-	return vkCreateCommandPool(device, &info, nullptr, &commandPool) == VK_SUCCESS &&
-		vkCreateCommandPool(device, &infoResetable, nullptr, &commandPoolReset) == VK_SUCCESS;
+	if (vkCreateCommandPool(device, &info, nullptr, &commandPool) != VK_SUCCESS ||
+		vkCreateCommandPool(device, &infoResetable, nullptr, &commandPoolReset) != VK_SUCCESS) {
+		return false;
+	}
+	//one pool per draw chunk, a chunk is recorded by one worker at a time
+	commandPoolChunk.resize(recordThreadCount);
+	for (auto& pool : commandPoolChunk) {
+		if (vkCreateCommandPool(device, &infoResetable, nullptr, &pool) != VK_SUCCESS) {
+			return false;
+		}
+	}
+	return recordThread.create(recordThreadCount);
 }
 
-bool VulkanEnv::allocateCommandBuffer(const VkCommandPool pool, const uint32_t count, VkCommandBuffer* cmd) {
+bool VulkanEnv::allocateCommandBuffer(const VkCommandPool pool, const VkCommandBufferLevel level, const uint32_t count, VkCommandBuffer* cmd) {
 	VkCommandBufferAllocateInfo cmdInfo;
 	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	cmdInfo.pNext = nullptr;
-	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdInfo.level = level;
 	cmdInfo.commandPool = pool;
 	cmdInfo.commandBufferCount = count;
 	return vkAllocateCommandBuffers(device, &cmdInfo, cmd) == VK_SUCCESS;
@@ -814,11 +1257,41 @@ bool VulkanEnv::allocateCommandBuffer(const VkCommandPool pool, const uint32_t c
 
 bool VulkanEnv::allocateFrameCommandBuffer() {
 	commandBuffer.resize(swapchain.size());
-	return allocateCommandBuffer(commandPoolReset, static_cast<uint32_t>(commandBuffer.size()), commandBuffer.data());
+	recordedVersion.resize(swapchain.size(), 0);
+	imageFence.resize(swapchain.size(), VK_NULL_HANDLE);
+	secondaryCommandBuffer.resize(swapchain.size());
+	for (auto& secondary : secondaryCommandBuffer) {
+		//[subpass][chunk], a chunk's buffers share its pool since one worker records them all
+		auto chunkCount = commandPoolChunk.size();
+		secondary.resize(chunkCount * subpassCount());
+		for (auto n = 0; n < secondary.size(); ++n) {
+			if (!allocateCommandBuffer(commandPoolChunk[n % chunkCount], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1, &secondary[n])) {
+				return false;
+			}
+		}
+	}
+	if (useGpuTimestamp()) {
+		timestampPending.resize(swapchain.size(), 0);
+		VkQueryPoolCreateInfo queryInfo;
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.flags = 0;
+		queryInfo.pNext = nullptr;
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryInfo.queryCount = swapchain.size() * TimestampCount;
+		queryInfo.pipelineStatistics = 0;
+		if (vkCreateQueryPool(device, &queryInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+			return false;
+		}
+	}
+	return allocateCommandBuffer(commandPoolReset, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(commandBuffer.size()), commandBuffer.data());
 }
 
-bool VulkanEnv::setupCommandBuffer(const uint32_t index, const uint32_t imageIndex) {
-	auto& cmd = commandBuffer[index];
+void VulkanEnv::invalidateCommandBuffer() {
+	++drawVersion;
+}
+
+bool VulkanEnv::setupCommandBuffer(const uint32_t imageIndex) {
+	auto& cmd = commandBuffer[imageIndex];
 	VkCommandBufferBeginInfo beginInfo;
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = 0;
@@ -849,23 +1322,490 @@ bool VulkanEnv::setupCommandBuffer(const uint32_t index, const uint32_t imageInd
 		renderPassBegin.clearValueCount = 3;
 	}
 
-	vkCmdBeginRenderPass(cmd, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineGroup.getGraphicsPipeline());
-	vkCmdSetViewport(cmd, 0, 1, &pipelineGroup.getViewport());
-	const auto& currentDescriptorSet = descriptorSet[imageIndex];
-	vkCmdBindVertexBuffers(cmd, 0, static_cast<uint32_t>(vertexBuffer.buffer.size()), vertexBuffer.buffer.data(), vertexBuffer.offset.data());
-	for (auto i = 0; i < indexBuffer.offset.size(); ++i) {
-		const auto& drawInfo = indexBuffer.drawInfo[i];
-		VkDescriptorSet bindingSet[]{ currentDescriptorSet.back(), currentDescriptorSet[drawInfo.setIndex] };
-		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 2, bindingSet, 0, nullptr);
-		vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, indexBuffer.offset[i], VK_INDEX_TYPE_UINT16);
-		vkCmdPushConstants(cmd, graphicsPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, MeshNode::getConstantSize(), drawInfo.constantData);
-		vkCmdDrawIndexed(cmd, indexBuffer.iCount[i], 1, 0, indexBuffer.vOffset[i], 0);
+	auto timestamp = useGpuTimestamp();
+	auto firstQuery = imageIndex * TimestampCount;
+	if (timestamp) {
+		vkCmdResetQueryPool(cmd, timestampPool, firstQuery, TimestampCount);
+	}
+	if (useGpuCulling()) {
+		//compute work can't go inside a render pass
+		recordCull(cmd, imageIndex);
+	}
+	if (timestamp) {
+		//bottom of pipe waits for the cull pass, only the render pass is measured
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, firstQuery);
+	}
+	if (useIndirectDraw()) {
+		//a handful of commands, not worth splitting across threads
+		vkCmdBeginRenderPass(cmd, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+		if (depthPrepass) {
+			recordDrawIndirect(cmd, imageIndex, true);
+			if (timestamp) {
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, firstQuery + 2);
+			}
+			vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
+		}
+		recordDrawIndirect(cmd, imageIndex, false);
+	}
+	else if (recordThread.size() == 0) {
+		vkCmdBeginRenderPass(cmd, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
+		if (depthPrepass) {
+			recordDraw(cmd, imageIndex, 0, drawRun.size(), true);
+			if (timestamp) {
+				vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, firstQuery + 2);
+			}
+			vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
+		}
+		recordDraw(cmd, imageIndex, 0, drawRun.size(), false);
+	}
+	else {
+		//each chunk of the draw list goes to a secondary buffer per subpass, recorded on the worker threads
+		vkCmdBeginRenderPass(cmd, &renderPassBegin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		auto& secondary = secondaryCommandBuffer[imageIndex];
+		auto chunkCount = static_cast<uint32_t>(secondary.size()) / subpassCount();
+		std::vector<uint8_t> recorded(chunkCount, 0);
+		recordThread.run(chunkCount, [&](uint32_t worker, uint32_t chunk) {
+			recorded[chunk] = setupSecondaryCommandBuffer(imageIndex, chunk);
+		});
+		if (std::find(recorded.begin(), recorded.end(), 0) != recorded.end()) {
+			vkCmdEndRenderPass(cmd);
+			vkEndCommandBuffer(cmd);
+			return false;
+		}
+		vkCmdExecuteCommands(cmd, chunkCount, secondary.data());
+		if (depthPrepass) {
+			//the prepass end timestamp is written by the first colour chunk
+			vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(cmd, chunkCount, secondary.data() + chunkCount);
+		}
 	}
 	vkCmdEndRenderPass(cmd);
+	if (timestamp) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, firstQuery + 1);
+	}
 	return vkEndCommandBuffer(cmd) == VK_SUCCESS;
 }
 
+bool VulkanEnv::setupSecondaryCommandBuffer(const uint32_t imageIndex, const uint32_t chunk) {
+	auto drawCount = drawRun.size();
+	auto chunkCount = secondaryCommandBuffer[imageIndex].size() / subpassCount();
+	auto chunkSize = (drawCount + chunkCount - 1) / chunkCount;
+	auto begin = std::min(drawCount, chunk * chunkSize);
+	auto end = std::min(drawCount, begin + chunkSize);
+	for (uint32_t subpass = 0; subpass < subpassCount(); ++subpass) {
+		auto& cmd = secondaryCommandBuffer[imageIndex][subpass * chunkCount + chunk];
+		VkCommandBufferInheritanceInfo inheritance;
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.pNext = nullptr;
+		inheritance.renderPass = renderPass;
+		inheritance.subpass = subpass;
+		inheritance.framebuffer = swapchain.getFramebuffer(imageIndex);
+		inheritance.occlusionQueryEnable = VK_FALSE;
+		inheritance.queryFlags = 0;
+		inheritance.pipelineStatistics = 0;
+		VkCommandBufferBeginInfo beginInfo;
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pNext = nullptr;
+		beginInfo.pInheritanceInfo = &inheritance;
+		if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+			return false;
+		}
+		auto prepass = depthPrepass && subpass == 0;
+		if (depthPrepass && !prepass && chunk == 0 && useGpuTimestamp()) {
+			//executed after every prepass chunk
+			vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, imageIndex * TimestampCount + 2);
+		}
+		recordDraw(cmd, imageIndex, begin, end, prepass);
+		if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void VulkanEnv::recordDraw(VkCommandBuffer cmd, const uint32_t imageIndex, size_t begin, size_t end, bool prepass) {
+	//secondary buffers inherit nothing but the render pass, all state is set per buffer
+	auto pipelineOf = [&](int setIndex) {
+		return prepass ? pipelineGroup.getDepthPipeline() : pipelineGroup.getGraphicsPipeline(drawVariant(setIndex));
+	};
+	auto pipeline = pipelineOf(begin < end ? indexBuffer.drawInfo[drawRun[begin].firstDraw].setIndex : 0);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	setViewportScissor(cmd);
+	const auto& cache = descriptorCache[imageIndex];
+	vkCmdBindVertexBuffers(cmd, 0, static_cast<uint32_t>(vertexBuffer.buffer.size()), vertexBuffer.buffer.data(), vertexBuffer.offset.data());
+	for (auto k = begin; k < end; ++k) {
+		const auto& run = drawRun[k];
+		const auto& drawInfo = indexBuffer.drawInfo[run.firstDraw];
+		auto g = indexBuffer.geometry[run.firstDraw];
+		//runs are ordered by pipeline, a switch happens once per variant
+		auto next = pipelineOf(drawInfo.setIndex);
+		if (next != pipeline) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, next);
+			pipeline = next;
+		}
+		VkDescriptorSet bindingSet[]{ cache.uniformSet, cache.materialSet[drawInfo.setIndex] };
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 2, bindingSet, 0, nullptr);
+		vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, indexBuffer.offset[g], indexBuffer.indexType[g]);
+		//transform is read from the model storage buffer, so the recording survives animation
+		auto lod = indexBuffer.lodBase[g] + run.lod;
+		vkCmdDrawIndexed(cmd, indexBuffer.lodIndexCount[lod], run.instanceCount, indexBuffer.lodFirstIndex[lod], indexBuffer.vOffset[g], run.firstDraw);
+	}
+}
+
+uint32_t VulkanEnv::drawVariant(int setIndex) const {
+	return setIndex >= 0 && static_cast<size_t>(setIndex) < materialVariant.size() ? materialVariant[setIndex] : 0;
+}
+
+void VulkanEnv::setViewportScissor(VkCommandBuffer cmd) {
+	const auto& extent = swapchain.getExtent();
+	VkViewport viewport;
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor;
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
+
+void VulkanEnv::updateDrawRun() {
+	std::vector<uint32_t> slot;
+	if (useCpuCulling()) {
+		//visible indices are in render list order
+		const auto& visible = renderingData->getVisibleDraw();
+		slot.reserve(visible.size());
+		for (auto i : visible) {
+			slot.push_back(indexBuffer.drawSlot[i]);
+		}
+		std::sort(slot.begin(), slot.end());
+	}
+	else {
+		slot.resize(indexBuffer.drawInfo.size());
+		for (uint32_t i = 0; i < slot.size(); ++i) {
+			slot[i] = i;
+		}
+	}
+	//indirect commands are built once, they keep the full mesh
+	std::vector<uint8_t> slotLod(indexBuffer.drawInfo.size(), 0);
+	const auto& drawLod = renderingData->getDrawLod();
+	if (!useIndirectDraw() && drawLod.size() == slotLod.size()) {
+		for (size_t i = 0; i < drawLod.size(); ++i) {
+			auto slotIndex = indexBuffer.drawSlot[i];
+			auto g = indexBuffer.geometry[slotIndex];
+			slotLod[slotIndex] = static_cast<uint8_t>(std::min<uint32_t>(drawLod[i], indexBuffer.lodCount[g] - 1));
+		}
+	}
+	drawRun.clear();
+	for (auto i : slot) {
+		if (!drawRun.empty()) {
+			auto& last = drawRun.back();
+			auto next = last.firstDraw + last.instanceCount;
+			if (next == i && indexBuffer.geometry[i] == indexBuffer.geometry[last.firstDraw] && slotLod[i] == last.lod) {
+				++last.instanceCount;
+				continue;
+			}
+		}
+		drawRun.push_back({ i, 1, slotLod[i] });
+	}
+}
+
+uint32_t VulkanEnv::subpassCount() const {
+	return depthPrepass ? 2 : 1;
+}
+
+bool VulkanEnv::useGpuTimestamp() const {
+	return gpuTimestamp && timestampPeriod > 0.0f;
+}
+
+void VulkanEnv::readTimestamp(const uint32_t imageIndex) {
+	//the prepass end is only written with the prepass
+	uint64_t tick[TimestampCount];
+	auto queryCount = depthPrepass ? TimestampCount : 2;
+	if (vkGetQueryPoolResults(device, timestampPool, imageIndex * TimestampCount, queryCount, sizeof(tick), tick, sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+		return;
+	}
+	auto elapsed = [this](uint64_t from, uint64_t to) {
+		return static_cast<double>((to - from) & timestampMask) * timestampPeriod * 1e-6;
+	};
+	gpuTimeSum += elapsed(tick[0], tick[1]);
+	if (depthPrepass) {
+		gpuPrepassTimeSum += elapsed(tick[0], tick[2]);
+	}
+	if (++gpuTimeFrameCount < TimestampLogInterval) {
+		return;
+	}
+	std::cout << "gpu render pass: " << gpuTimeSum / gpuTimeFrameCount << " ms";
+	if (depthPrepass) {
+		auto prepass = gpuPrepassTimeSum / gpuTimeFrameCount;
+		std::cout << " (depth prepass " << prepass << " ms, color " << gpuTimeSum / gpuTimeFrameCount - prepass << " ms)";
+	}
+	std::cout << std::endl;
+	gpuTimeSum = 0.0;
+	gpuPrepassTimeSum = 0.0;
+	gpuTimeFrameCount = 0;
+}
+
+bool VulkanEnv::useCpuCulling() const {
+	return cpuCulling && !useIndirectDraw();
+}
+
+void VulkanEnv::recordDrawIndirect(VkCommandBuffer cmd, const uint32_t imageIndex, bool prepass) {
+	//the prepass reads the same (culled) commands, both subpasses draw the same triangles
+	auto pipelineOf = [&](int setIndex) {
+		return prepass ? pipelineGroup.getDepthPipeline() : pipelineGroup.getGraphicsPipeline(drawVariant(setIndex));
+	};
+	auto pipeline = pipelineOf(indirectBuffer.bucket.empty() ? 0 : indirectBuffer.bucket[0].setIndex);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	setViewportScissor(cmd);
+	const auto& cache = descriptorCache[imageIndex];
+	vkCmdBindVertexBuffers(cmd, 0, static_cast<uint32_t>(vertexBuffer.buffer.size()), vertexBuffer.buffer.data(), vertexBuffer.offset.data());
+	//draw offsets are baked into firstIndex, the whole index buffer is bound once per index type
+	VkIndexType boundType = VK_INDEX_TYPE_MAX_ENUM;
+	for (uint32_t b = 0; b < indirectBuffer.bucket.size(); ++b) {
+		const auto& bucket = indirectBuffer.bucket[b];
+		auto next = pipelineOf(bucket.setIndex);
+		if (next != pipeline) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, next);
+			pipeline = next;
+		}
+		if (bucket.indexType != boundType) {
+			vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, bucket.indexType);
+			boundType = bucket.indexType;
+		}
+		VkDescriptorSet bindingSet[]{ cache.uniformSet, cache.materialSet[bucket.setIndex] };
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 2, bindingSet, 0, nullptr);
+		if (useGpuCulling()) {
+			//the surviving commands are packed at the front of the bucket, count written by the cull pass
+			vkCmdDrawIndexedIndirectCount(cmd, cullCommandBuffer[imageIndex]->buffer, bucket.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+				cullCountBuffer[imageIndex]->buffer, b * sizeof(uint32_t), bucket.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else {
+			vkCmdDrawIndexedIndirect(cmd, indirectBuffer.buffer, bucket.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+				bucket.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+}
+
+void VulkanEnv::recordCull(VkCommandBuffer cmd, const uint32_t imageIndex) {
+	auto commandCount = static_cast<uint32_t>(indexBuffer.drawInfo.size());
+	auto countBuffer = cullCountBuffer[imageIndex]->buffer;
+	vkCmdFillBuffer(cmd, countBuffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkBufferMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = countBuffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineGroup.getComputePipeline());
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &descriptorCache[imageIndex].cullSet, 0, nullptr);
+	vkCmdPushConstants(cmd, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(commandCount), &commandCount);
+	vkCmdDispatch(cmd, (commandCount + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+	//both the compacted commands & the counts are consumed as indirect parameters
+	VkBufferMemoryBarrier output[2];
+	output[0] = barrier;
+	output[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	output[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	output[1] = output[0];
+	output[1].buffer = cullCommandBuffer[imageIndex]->buffer;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 2, output, 0, nullptr);
+}
+
+bool VulkanEnv::checkGpuCull(const uint32_t imageIndex) {
+	const auto& bucket = indirectBuffer.bucket;
+	if (bucket.empty()) {
+		return true;
+	}
+	auto countSize = bucket.size() * sizeof(uint32_t);
+	VkBuffer readback;
+	VmaAllocation readbackAllocation;
+	if (!createBuffer(vmaAllocator, countSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, readback, readbackAllocation)) {
+		return false;
+	}
+	VkCommandBuffer cmd;
+	if (!allocateCommandBuffer(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &cmd)) {
+		vmaDestroyBuffer(vmaAllocator, readback, readbackAllocation);
+		return false;
+	}
+	bool result = beginCommand(cmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	if (result) {
+		//the frame's cull pass went to the same queue before, the barrier orders the copy after its writes
+		VkBufferMemoryBarrier barrier;
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.pNext = nullptr;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = cullCountBuffer[imageIndex]->buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		VkBufferCopy region{ 0, 0, countSize };
+		vkCmdCopyBuffer(cmd, cullCountBuffer[imageIndex]->buffer, readback, 1, &region);
+		result = vkEndCommandBuffer(cmd) == VK_SUCCESS &&
+			submitCommand(&cmd, 1, graphicsQueue, VK_NULL_HANDLE) &&
+			vkQueueWaitIdle(graphicsQueue) == VK_SUCCESS;
+	}
+	vkFreeCommandBuffers(device, commandPool, 1, &cmd);
+	std::vector<uint32_t> gpuCount(bucket.size());
+	if (result) {
+		void* data;
+		result = vmaMapMemory(vmaAllocator, readbackAllocation, &data) == VK_SUCCESS;
+		if (result) {
+			vmaInvalidateAllocation(vmaAllocator, readbackAllocation, 0, VK_WHOLE_SIZE);
+			memcpy(gpuCount.data(), data, countSize);
+			vmaUnmapMemory(vmaAllocator, readbackAllocation);
+		}
+	}
+	vmaDestroyBuffer(vmaAllocator, readback, readbackAllocation);
+	if (!result) {
+		return false;
+	}
+
+	//same bounds, model matrices & view the frame uploaded, counted per bucket like the compaction
+	std::vector<glm::mat4> model;
+	std::vector<glm::vec4> sphere;
+	model.reserve(cullCommandDraw.size());
+	sphere.reserve(cullCommandDraw.size());
+	for (auto draw : cullCommandDraw) {
+		model.push_back(static_cast<const MeshConstant*>(indexBuffer.drawInfo[draw].constantData)->model);
+		sphere.push_back(drawBound[draw]);
+	}
+	const auto& matrix = renderingData->getMatrixUniform();
+	auto visible = cullSphere(makeFrustum(matrix.proj * matrix.view), model, sphere);
+	std::vector<uint32_t> cpuCount(bucket.size(), 0);
+	size_t b = 0;
+	for (auto command : visible) {
+		while (command >= bucket[b].firstCommand + bucket[b].commandCount) {
+			++b;
+		}
+		++cpuCount[b];
+	}
+	uint32_t gpuVisible = 0;
+	uint32_t mismatch = 0;
+	for (size_t n = 0; n < bucket.size(); ++n) {
+		gpuVisible += gpuCount[n];
+		mismatch += gpuCount[n] != cpuCount[n] ? 1 : 0;
+	}
+	std::cout << "gpu cull check " << cullCommandDraw.size() << " commands, " << bucket.size() << " buckets: visible gpu " << gpuVisible
+		<< ", cpu " << visible.size() << (mismatch == 0 ? "" : " (MISMATCH in " + std::to_string(mismatch) + " buckets)") << std::endl;
+	return true;
+}
+
+VkIndexType VulkanEnv::uploadIndexType(uint32_t stride) const {
+	auto type = indexTypeFromStride(stride);
+	return type == VK_INDEX_TYPE_UINT8_EXT && !indexTypeUint8Supported ? VK_INDEX_TYPE_UINT16 : type;
+}
+
+bool VulkanEnv::useIndirectDraw() const {
+	return indirectDraw && indirectDrawSupported;
+}
+
+bool VulkanEnv::useGpuCulling() const {
+	return gpuCulling && useIndirectDraw() && drawIndirectCountSupported;
+}
+
+bool VulkanEnv::createIndirectBuffer() {
+	//one instanced command per run, the cull pass tests a single transform per command so it gets one per draw
+	std::vector<DrawRun> run;
+	if (useGpuCulling()) {
+		run.reserve(indexBuffer.drawInfo.size());
+		for (uint32_t i = 0; i < indexBuffer.drawInfo.size(); ++i) {
+			run.push_back({ i, 1, 0 });
+		}
+	}
+	else {
+		run = drawRun;
+	}
+	//commands are grouped by material, each command keeps its first draw index as firstInstance
+	auto commandCount = static_cast<uint32_t>(run.size());
+	std::vector<uint32_t> order(commandCount);
+	for (uint32_t i = 0; i < commandCount; ++i) {
+		order[i] = i;
+	}
+	//a bucket shares both the material and the index type, buckets of one pipeline are adjacent
+	std::stable_sort(order.begin(), order.end(), [this, &run](uint32_t a, uint32_t b) {
+		auto setA = indexBuffer.drawInfo[run[a].firstDraw].setIndex;
+		auto setB = indexBuffer.drawInfo[run[b].firstDraw].setIndex;
+		auto variantA = drawVariant(setA);
+		auto variantB = drawVariant(setB);
+		auto typeA = indexBuffer.indexType[indexBuffer.geometry[run[a].firstDraw]];
+		auto typeB = indexBuffer.indexType[indexBuffer.geometry[run[b].firstDraw]];
+		if (variantA != variantB) {
+			return variantA < variantB;
+		}
+		return setA < setB || (setA == setB && typeA < typeB);
+	});
+
+	std::vector<VkDrawIndexedIndirectCommand> command(commandCount);
+	std::vector<CullData> cullData(commandCount);
+	indirectBuffer.bucket.clear();
+	cullCommandDraw.clear();
+	for (uint32_t k = 0; k < commandCount; ++k) {
+		auto i = run[order[k]].firstDraw;
+		auto g = indexBuffer.geometry[i];
+		auto& draw = command[k];
+		auto lod = indexBuffer.lodBase[g] + run[order[k]].lod;
+		draw.indexCount = indexBuffer.lodIndexCount[lod];
+		draw.instanceCount = run[order[k]].instanceCount;
+		draw.firstIndex = static_cast<uint32_t>(indexBuffer.offset[g] / indexTypeSize(indexBuffer.indexType[g])) + indexBuffer.lodFirstIndex[lod];
+		draw.vertexOffset = static_cast<int32_t>(indexBuffer.vOffset[g]);
+		draw.firstInstance = i;
+		auto setIndex = indexBuffer.drawInfo[i].setIndex;
+		auto indexType = indexBuffer.indexType[g];
+		if (indirectBuffer.bucket.empty() || indirectBuffer.bucket.back().setIndex != setIndex || indirectBuffer.bucket.back().indexType != indexType) {
+			indirectBuffer.bucket.push_back({ setIndex, indexType, k, 0 });
+		}
+		++indirectBuffer.bucket.back().commandCount;
+		cullData[k].sphere = drawBound[i];
+		cullData[k].bucket = static_cast<uint32_t>(indirectBuffer.bucket.size() - 1);
+		cullData[k].bucketFirst = indirectBuffer.bucket.back().firstCommand;
+		if (useGpuCulling()) {
+			cullCommandDraw.push_back(i);
+		}
+	}
+
+	auto size = std::max<VkDeviceSize>(1, command.size()) * sizeof(VkDrawIndexedIndirectCommand);
+	if (!useGpuCulling()) {
+		if (!createBuffer(vmaAllocator, size,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY, indirectBuffer.buffer, indirectBuffer.allocation)) {
+			return false;
+		}
+		return command.empty() || uploader.stageBuffer(command.data(), command.size() * sizeof(VkDrawIndexedIndirectCommand), indirectBuffer.buffer, 0,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+	}
+	//with culling, the commands & their bounds are only read by the cull pass
+	auto cullSize = std::max<VkDeviceSize>(1, cullData.size()) * sizeof(CullData);
+	if (!createBuffer(vmaAllocator, size,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY, indirectBuffer.buffer, indirectBuffer.allocation) ||
+		!createBuffer(vmaAllocator, cullSize,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY, cullDataBuffer.buffer, cullDataBuffer.allocation)) {
+		return false;
+	}
+	return command.empty() || (
+		uploader.stageBuffer(command.data(), command.size() * sizeof(VkDrawIndexedIndirectCommand), indirectBuffer.buffer, 0,
+			VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) &&
+		uploader.stageBuffer(cullData.data(), cullData.size() * sizeof(CullData), cullDataBuffer.buffer, 0,
+			VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
+}
+
 bool VulkanEnv::createFrameSyncObject() {
 	inFlightFrame.resize(swapchain.size());
 
@@ -901,14 +1841,31 @@ void VulkanEnv::destroy() {
 	for (auto& pool : descriptorPoolFree) {
 		vkDestroyDescriptorPool(device, pool, nullptr);
 	}
-	for (auto& frame : inFlightFrame) {
-		vkDestroyDescriptorPool(device, frame.descriptorPool, nullptr);
+	for (auto& cache : descriptorCache) {
+		vkDestroyDescriptorPool(device, cache.pool, nullptr);
 	}
 	for (auto i = 0; i < vertexBuffer.buffer.size(); ++i) {
 		vmaDestroyBuffer(vmaAllocator, vertexBuffer.buffer[i], vertexBuffer.allocation[i]);
 	}
 	vmaDestroyBuffer(vmaAllocator, indexBuffer.buffer, indexBuffer.allocation);
-	vkDestroyFence(device, fenceVertexIndexCopy, nullptr);
+	vmaDestroyBuffer(vmaAllocator, indirectBuffer.buffer, indirectBuffer.allocation);
+	if (cullDataBuffer.buffer != VK_NULL_HANDLE) {
+		vmaDestroyBuffer(vmaAllocator, cullDataBuffer.buffer, cullDataBuffer.allocation);
+	}
+	pipelineGroup.destroyGraphicsPipeline();
+	pipelineGroup.destroyComputePipeline();
+	vkDestroyPipelineLayout(device, graphicsPipelineLayout, nullptr);
+	vkDestroyRenderPass(device, renderPass, nullptr);
+	for (const auto& buffer : perImageBuffer) {
+		vmaDestroyBuffer(vmaAllocator, buffer.buffer, buffer.allocation);
+	}
+	if (!pipelineGroup.savePipelineCache()) {
+		std::cout << "pipeline cache " << pipelineCachePath << " not written" << std::endl;
+	}
+	pipelineGroup.destroyPipelineCache();
+	vkDestroyQueryPool(device, timestampPool, nullptr);
+	vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayoutCull, nullptr);
 	for (auto i = 0; i < imageSet.image.size(); ++i) {
 		vkDestroyImageView(device, imageSet.view[i], nullptr);
 		vmaDestroyImage(vmaAllocator, imageSet.image[i], imageSet.allocation[i]);
@@ -916,9 +1873,13 @@ void VulkanEnv::destroy() {
 	for (const auto& sampler : imageSet.sampler) {
 		vkDestroySampler(device, sampler, nullptr);
 	}
-	vkDestroyFence(device, fenceImageCopy, nullptr);
+	uploader.destroy();
 	vkDestroyCommandPool(device, commandPool, nullptr);
 	vkDestroyCommandPool(device, commandPoolReset, nullptr);
+	recordThread.destroy();
+	for (auto& pool : commandPoolChunk) {
+		vkDestroyCommandPool(device, pool, nullptr);
+	}
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayoutUniform, nullptr);
 	for (auto& layout : descriptorSetLayoutMaterial) {
 		vkDestroyDescriptorSetLayout(device, layout, nullptr);
@@ -935,19 +1896,88 @@ bool VulkanEnv::recreateSwapchain() {
 	swapchain.querySupport();
 
 	std::cout << "recreate swapchain" << std::endl;
-	bool result = logResult("create swapchain", swapchain.createSwapchain()) &&
-		logResult("create msaa color buffer", swapchain.createMsaaColorBuffer()) &&
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!logResult("create swapchain", swapchain.createSwapchain())) {
+		return false;
+	}
+	//render pass, pipelines & per image buffers/command buffers/descriptor sets were made for these
+	auto formatChanged = swapchain.getFormat() != retiredSwapchain.getFormat();
+	auto countChanged = swapchain.size() != retiredSwapchain.size();
+	if ((formatChanged || countChanged) && !rebuildImageResource(formatChanged, countChanged)) {
+		return false;
+	}
+	bool result = logResult("create msaa color buffer", swapchain.createMsaaColorBuffer()) &&
 		logResult("create depth buffer", swapchain.createDepthBuffer()) &&
-		logResult("create render pass", createRenderPass()) &&
-		logResult("create graphics pipeline layout", createGraphicsPipelineLayout()) &&
-		logResult("create graphics pipeline", createGraphicsPipeline()) &&
 		logResult("create framebuffer", swapchain.createFramebuffer()) &&
-		logResult("create uniform buffer", createUniformBuffer()) &&
-		logResult("prepare descriptor", prepareDescriptor()) &&
 		logResult("update uniform buffer", updateUniformBuffer());
+	//recorded framebuffers & viewport are stale
+	invalidateCommandBuffer();
+	auto time = std::chrono::high_resolution_clock::now();
+	std::cout << "swapchain recreated in "
+		<< std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count() << "ms" << std::endl;
 	return result;
 }
 
+bool VulkanEnv::rebuildImageResource(bool formatChanged, bool countChanged) {
+	std::cout << "swapchain format or image count changed, rebuilding" << std::endl;
+	//rare, waiting for idle keeps everything below out of use & retires the old swapchain right away
+	vkDeviceWaitIdle(device);
+	retiredSwapchain.destroy();
+	retiredFrame = nullptr;
+	++imageResourceVersion;
+	if (formatChanged) {
+		pipelineGroup.destroyGraphicsPipeline();
+		vkDestroyRenderPass(device, renderPass, nullptr);
+		if (!logResult("create render pass", createRenderPass()) || !logResult("loading shader", shaderManager->preload())) {
+			return false;
+		}
+		//the pipeline cache makes this cheap
+		auto created = logResult("create graphics pipeline", createGraphicsPipeline());
+		shaderManager->unload();
+		if (!created) {
+			return false;
+		}
+	}
+	if (!countChanged) {
+		return true;
+	}
+	for (auto& frame : inFlightFrame) {
+		vkDestroySemaphore(device, frame.semaphoreRenderFinished, nullptr);
+		vkDestroyFence(device, frame.fenceImageAcquired, nullptr);
+		vkDestroyFence(device, frame.fenceInFlight, nullptr);
+	}
+	inFlightFrame.clear();
+	currentFrame = 0;
+	for (const auto& buffer : perImageBuffer) {
+		vmaDestroyBuffer(vmaAllocator, buffer.buffer, buffer.allocation);
+	}
+	perImageBuffer.clear();
+	for (const auto& cache : descriptorCache) {
+		releaseDescriptorPool(cache.pool);
+	}
+	descriptorCache.clear();
+	if (!commandBuffer.empty()) {
+		vkFreeCommandBuffers(device, commandPoolReset, static_cast<uint32_t>(commandBuffer.size()), commandBuffer.data());
+	}
+	auto chunkCount = commandPoolChunk.size();
+	for (const auto& secondary : secondaryCommandBuffer) {
+		for (auto n = 0; n < secondary.size(); ++n) {
+			vkFreeCommandBuffers(device, commandPoolChunk[n % chunkCount], 1, &secondary[n]);
+		}
+	}
+	commandBuffer.clear();
+	recordedVersion.clear();
+	imageFence.clear();
+	secondaryCommandBuffer.clear();
+	timestampPending.clear();
+	vkDestroyQueryPool(device, timestampPool, nullptr);
+	timestampPool = VK_NULL_HANDLE;
+	return logResult("create uniform buffer", createUniformBuffer()) &&
+		logResult("prepare descriptor", prepareDescriptor()) &&
+		logResult("allocate swapchain command buffer", allocateFrameCommandBuffer()) &&
+		logResult("create frame sync object", createFrameSyncObject());
+}
+
 bool VulkanEnv::updateUniformBuffer() {
 	for (auto i = 0; i < uniformBufferMatrix.size(); ++i) {
 		if (!updateUniformBufferMatrix(i) || ! updateUniformBufferLight(i)) {
@@ -975,6 +2005,21 @@ bool VulkanEnv::updateUniformBufferLight(const uint32_t imageIndex) {
 	return true;
 }
 
+bool VulkanEnv::updateStorageBufferDraw(const uint32_t imageIndex) {
+	void* buffer;
+	vmaMapMemory(vmaAllocator, storageBufferDraw[imageIndex]->allocation, &buffer);
+	auto* draw = static_cast<DrawData*>(buffer);
+	for (const auto& drawInfo : indexBuffer.drawInfo) {
+		memcpy(&draw->mesh, drawInfo.constantData, sizeof(MeshConstant));
+		draw->materialIndex = static_cast<uint32_t>(drawInfo.setIndex);
+		draw->positionOffset = drawInfo.positionOffset;
+		draw->positionScale = drawInfo.positionScale;
+		++draw;
+	}
+	vmaUnmapMemory(vmaAllocator, storageBufferDraw[imageIndex]->allocation);
+	return true;
+}
+
 void VulkanEnv::releaseDescriptorPool(VkDescriptorPool pool) {
 	if (pool == nullptr) return;
 	vkResetDescriptorPool(device, pool, 0);
@@ -995,11 +2040,7 @@ bool VulkanEnv::frameResizeCheck(VkResult result, const InFlightFrame& frame) {
 	if (retiredFrame == nullptr && (swapchain.resized() || result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)) {
 		swapchain.waitForValidSize();
 		retiredFrame = &frame;
-
-		shaderManager->preload();
-		recreateSwapchain();
-		shaderManager->unload();
-		return true;
+		return recreateSwapchain();
 	}
 	if (result != VK_SUCCESS) {
 		return false;
@@ -1009,7 +2050,6 @@ bool VulkanEnv::frameResizeCheck(VkResult result, const InFlightFrame& frame) {
 
 bool VulkanEnv::drawFrame(const RenderingData& renderingData) {
 	auto& frame = inFlightFrame[currentFrame];
-	auto frameIndex = currentFrame;
 	currentFrame = (currentFrame + 1) % swapchain.size();
 	uint32_t imageIndex;
 	uint64_t timeout = 1000000000;//ns
@@ -1024,30 +2064,99 @@ bool VulkanEnv::drawFrame(const RenderingData& renderingData) {
 		retiredSwapchain.destroy();
 		retiredFrame = nullptr;
 	}
+	auto resourceVersion = imageResourceVersion;
 	if (!frameResizeCheck(acquireResult, frame)) {
 		return false;
 	}
+	//frame objects & command buffers were replaced, the image acquired from the old swapchain is dropped
+	if (resourceVersion != imageResourceVersion) {
+		return true;
+	}
 
-	releaseDescriptorPool(frame.descriptorPool);
-	requestDescriptorPool(0, frame.descriptorPool);
-	setupDescriptorSet(imageIndex, frame.descriptorPool);
-	setupCommandBuffer(frameIndex, imageIndex);
+	//the image's command buffer may still be pending from the last frame that drew to it
+	auto& lastFence = imageFence[imageIndex];
+	if (lastFence != VK_NULL_HANDLE && lastFence != frame.fenceInFlight) {
+		vkWaitForFences(device, 1, &lastFence, VK_TRUE, UINT64_MAX);
+	}
+	lastFence = frame.fenceInFlight;
+	if (useGpuTimestamp() && timestampPending[imageIndex]) {
+		//the fence covers the last submission of this image's command buffer
+		readTimestamp(imageIndex);
+		timestampPending[imageIndex] = 0;
+	}
+
+	if (renderingData.getRenderListVersion() != renderListVersion) {
+		renderListVersion = renderingData.getRenderListVersion();
+		invalidateCommandBuffer();
+	}
+	//recorded draws only cover what was visible & the lods picked when recording
+	auto visibleChanged = useCpuCulling() && renderingData.getVisibleVersion() != visibleVersion;
+	auto lodChanged = !useIndirectDraw() && renderingData.getLodVersion() != lodVersion;
+	if (visibleChanged || lodChanged) {
+		visibleVersion = renderingData.getVisibleVersion();
+		lodVersion = renderingData.getLodVersion();
+		updateDrawRun();
+		invalidateCommandBuffer();
+	}
+	//descriptor sets are cached per image, only stale ones are written
+	descriptorWriteCount = 0;
+	bool descriptorRewritten;
+	if (!setupDescriptorSet(imageIndex, descriptorRewritten)) {
+		return false;
+	}
+	if (descriptorWriteCount > 0) {
+		std::cout << "descriptor write: " << descriptorWriteCount << " (image " << imageIndex << ")" << std::endl;
+	}
+	if (descriptorRewritten || recordedVersion[imageIndex] != drawVersion) {
+		if (!setupCommandBuffer(imageIndex)) {
+			return false;
+		}
+		recordedVersion[imageIndex] = drawVersion;
+	}
+	updateStorageBufferDraw(imageIndex);
+
+	//frame only waits for pending uploads on the gpu timeline, the cpu never blocks on them
+	uploader.collect();
+	auto uploadValue = uploader.pendingValue();
+	auto uploadTimeline = uploader.getTimeline();
+	VkTimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.pNext = nullptr;
+	timelineInfo.waitSemaphoreValueCount = 1;
+	timelineInfo.pWaitSemaphoreValues = &uploadValue;
+	timelineInfo.signalSemaphoreValueCount = 0;
+	timelineInfo.pSignalSemaphoreValues = nullptr;
 
 	VkSubmitInfo submitInfo;
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.pNext = nullptr;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer[frameIndex];
+	submitInfo.pCommandBuffers = &commandBuffer[imageIndex];
 	submitInfo.waitSemaphoreCount = 0;
 	submitInfo.pWaitSemaphores = VK_NULL_HANDLE;
-	VkPipelineStageFlags waitStage[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	//indirect commands are read before vertex input, the cull pass reads them even earlier
+	VkPipelineStageFlags waitStage[] = { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
 	submitInfo.pWaitDstStageMask = waitStage;
+	if (uploadValue > 0) {
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &uploadTimeline;
+	}
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &frame.semaphoreRenderFinished;
 
 	vkResetFences(device, 1, &frame.fenceInFlight);
 	//std::cout << "frame submit " << currentFrame << std::endl;
 	vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.fenceInFlight);
+	if (useGpuTimestamp()) {
+		timestampPending[imageIndex] = 1;
+	}
+	if (cullCheckPending && useGpuCulling()) {
+		cullCheckPending = false;
+		if (!checkGpuCull(imageIndex)) {
+			std::cout << "gpu cull check failed" << std::endl;
+		}
+	}
 
 	VkPresentInfoKHR presentInfo;
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -9,6 +9,8 @@
 #include "VulkanSupportStruct.h"
 #include "VulkanSwapchain.h"
 #include "VulkanPipelineGroup.h"
+#include "VulkanUploader.h"
+#include "ThreadPool.h"
 #include <vector>
 
 class VulkanEnv
@@ -26,24 +28,87 @@ private:
 	VmaAllocator vmaAllocator;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue;
 	VulkanSwapchain swapchain;
 	VulkanSwapchain retiredSwapchain;
+	//bumped when a format or image count change rebuilt the per image resources, frame objects from before are gone
+	uint32_t imageResourceVersion = 0;
 	VulkanPipelineGroup pipelineGroup;
+	VulkanUploader uploader;
 	const InFlightFrame* retiredFrame = nullptr;
 	std::vector<const Buffer*> uniformBufferMatrix;
 	std::vector<const Buffer*> uniformBufferLight;
-	std::vector<std::vector<VkDescriptorSet>> descriptorSet;
+	std::vector<const Buffer*> storageBufferDraw;
+	//backing of the per image buffers above, reserved up front so the pointers stay valid
+	std::vector<Buffer> perImageBuffer;
+	//per swapchain image, written once & refreshed only when the versions below change
+	std::vector<DescriptorCache> descriptorCache;
 	std::vector<VkDescriptorPool> descriptorPoolFree;
-	//TODO use pipeline cache
+	uint32_t uniformDescriptorVersion = 0;
+	uint32_t materialDescriptorVersion = 0;
+	uint32_t materialVersion = 0;
+	uint32_t descriptorWriteCount = 0;
 	VkDescriptorSetLayout descriptorSetLayoutUniform;
 	std::vector<VkDescriptorSetLayout> descriptorSetLayoutMaterial;
 	VkRenderPass renderPass;
 	VkPipelineLayout graphicsPipelineLayout;
+	//graphics pipeline variant of each material, from its shader & prototype
+	std::vector<uint32_t> materialVariant;
 	VkCommandPool commandPool;
 	VkCommandPool commandPoolReset;
+	//per swapchain image, re-recorded only when drawVersion changes
 	std::vector<VkCommandBuffer> commandBuffer;
+	//[image][chunk], used when draws are recorded on worker threads
+	std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffer;
+	std::vector<VkCommandPool> commandPoolChunk;
+	ThreadPool recordThread;
+	uint32_t recordThreadCount = 0;
+	std::vector<uint32_t> recordedVersion;
+	std::vector<VkFence> imageFence;
+	uint32_t drawVersion = 1;
+	uint32_t renderListVersion = 0;
 	VertexBuffer vertexBuffer;
 	IndexBuffer indexBuffer;
+	IndirectBuffer indirectBuffer;
+	bool indirectDraw = false;
+	bool indirectDrawSupported = false;
+	bool indexTypeUint8Supported = false;
+	bool textureCompressionBCSupported = false;
+	//gpu culling, compacts the indirect commands per bucket right before the render pass
+	VkDescriptorSetLayout descriptorSetLayoutCull = VK_NULL_HANDLE;
+	VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+	Buffer cullDataBuffer{};
+	std::vector<const Buffer*> cullCommandBuffer;
+	std::vector<const Buffer*> cullCountBuffer;
+	std::vector<glm::vec4> drawBound;
+	//draw of every indirect command, what the cpu reference of the cull check tests
+	std::vector<uint32_t> cullCommandDraw;
+	bool cullCheckPending = false;
+	//instanced draws of the direct path
+	std::vector<DrawRun> drawRun;
+	int cullShaderIndex = -1;
+	bool gpuCulling = false;
+	bool drawIndirectCountSupported = false;
+	//cpu culling, direct draws only record the draws RenderingData found visible
+	bool cpuCulling = false;
+	uint32_t visibleVersion = 0;
+	//layout of the uploaded vertices & of the pipeline's vertex input, views in another layout are converted
+	VertexFormat vertexFormat = VertexFormat::Float;
+	//direct draws are recorded at the lod RenderingData picked
+	uint32_t lodVersion = 0;
+	//depth only subpass drawing everything before the colour subpass, shaderIndex is its vertex only shader
+	bool depthPrepass = false;
+	int depthShaderIndex = -1;
+	//TimestampCount queries per swapchain image, written by the image's command buffer
+	bool gpuTimestamp = false;
+	VkQueryPool timestampPool = VK_NULL_HANDLE;
+	std::vector<uint8_t> timestampPending;
+	float timestampPeriod = 0.0f;//ns per tick, 0 when the graphics queue has no timestamps
+	uint64_t timestampMask = 0;
+	double gpuTimeSum = 0.0;//ms
+	double gpuPrepassTimeSum = 0.0;
+	uint32_t gpuTimeFrameCount = 0;
+	std::string pipelineCachePath;
 	ImageSet imageSet;
 
 	std::vector<const char*> extension;
@@ -53,21 +118,64 @@ private:
 
 	QueueFamily queueFamily;
 	float queuePriority = 1.0;
-
-	VkFence fenceVertexIndexCopy;
-	VkFence fenceImageCopy;
 private:
 	bool queueFamilyValid(const VkPhysicalDevice device, uint32_t& score);
+	bool rebuildImageResource(bool formatChanged, bool countChanged);
 	void releaseDescriptorPool(VkDescriptorPool pool);
 	bool requestDescriptorPool(int requirement, VkDescriptorPool& pool);
 	bool createDescriptorPool(int requirement, VkDescriptorPool& pool);
-	bool allocateCommandBuffer(const VkCommandPool pool, const uint32_t count, VkCommandBuffer* cmd);
-	bool setupDescriptorSet(int imageIndex, VkDescriptorPool pool);
-	bool setupCommandBuffer(const uint32_t index, const uint32_t imageIndex);
+	bool allocateCommandBuffer(const VkCommandPool pool, const VkCommandBufferLevel level, const uint32_t count, VkCommandBuffer* cmd);
+	bool allocateDescriptorSet(DescriptorCache& cache);
+	bool setupDescriptorSet(int imageIndex, bool& rewritten);
+	bool setupCommandBuffer(const uint32_t imageIndex);
+	//records the chunk's draws once per subpass
+	bool setupSecondaryCommandBuffer(const uint32_t imageIndex, const uint32_t chunk);
+	//the depth pipeline in the prepass, otherwise the variant of each run's material, bound when it changes
+	void recordDraw(VkCommandBuffer cmd, const uint32_t imageIndex, size_t begin, size_t end, bool prepass);
+	uint32_t drawVariant(int setIndex) const;
+	//viewport & scissor over the whole swapchain extent
+	void setViewportScissor(VkCommandBuffer cmd);
+	bool createPerImageBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage allocUsage, const Buffer*& buffer);
+	//rebuilds drawRun, only from the visible draws with cpu culling, split where the lod changes
+	void updateDrawRun();
+	bool useCpuCulling() const;
+	void recordDrawIndirect(VkCommandBuffer cmd, const uint32_t imageIndex, bool prepass);
+	void recordCull(VkCommandBuffer cmd, const uint32_t imageIndex);
+	//reads back the bucket counts of the image's last cull pass & compares them with cullSphere, waits for the queue
+	bool checkGpuCull(const uint32_t imageIndex);
+	bool useIndirectDraw() const;
+	//type an index view of the given stride is uploaded & drawn with on this device
+	VkIndexType uploadIndexType(uint32_t stride) const;
+	bool useGpuCulling() const;
+	bool createIndirectBuffer();
+	void invalidateCommandBuffer();
+	//2 with the depth prepass, every draw is recorded in each
+	uint32_t subpassCount() const;
+	bool useGpuTimestamp() const;
+	//accumulates the image's last render pass timing, logged every TimestampLogInterval frames
+	void readTimestamp(const uint32_t imageIndex);
 public:
 	VulkanSwapchain& getSwapchain() noexcept;
 	void setRenderingData(const RenderingData& data) noexcept;
 	void setRenderingManager(const MaterialManager&, ShaderManager&) noexcept;
+	//0 records on the calling thread, otherwise the draw list is split across this many workers
+	void setRecordThreadCount(uint32_t count) noexcept;
+	//falls back to direct draws when the device lacks multiDrawIndirect/drawIndirectFirstInstance
+	void setIndirectDraw(bool enable) noexcept;
+	//needs indirect draw & drawIndirectCount, shaderIndex points at a compute shader in the shader manager
+	void setGpuCulling(bool enable, int shaderIndex) noexcept;
+	//direct draws only, RenderingData::updateVisibleDraw has to run before each drawFrame
+	void setCpuCulling(bool enable) noexcept;
+	//the next frame's gpu culling result is checked against the cpu reference & logged, no effect without gpu culling
+	void requestCullCheck() noexcept;
+	//the vertex shader has to read this layout, see VertexPacking.h
+	void setVertexFormat(VertexFormat format) noexcept;
+	//shaderIndex points at a vertex only shader in the shader manager, gl_Position has to match the graphics shader's
+	void setDepthPrepass(bool enable, int shaderIndex) noexcept;
+	//ignored when the graphics queue has no timestamp support
+	void setGpuTimestamp(bool enable) noexcept;
+	//pipeline cache file read at createPipelineCache & written at destroy, empty keeps it in memory only
+	void setPipelineCachePath(const std::string& path);
 	void enableValidationLayer(std::vector<const char*>&& layer);
 	void checkExtensionRequirement();
 	void selectPhysicalDevice(const PhysicalDeviceCandidate& candidate);
@@ -78,9 +186,12 @@ public:
 	bool createDevice();
 	bool createAllocator();
 	bool createRenderPass();
+	bool createPipelineCache();
 	bool createDescriptorSetLayout();
 	bool createGraphicsPipelineLayout();
+	//a pipeline per distinct (material shader, prototype) pair, created in parallel, before createVertexBufferIndice
 	bool createGraphicsPipeline();
+	bool createCullPipeline();
 	bool createTextureImage(const std::vector<ImageInput>& input);
 	bool createTextureImageView();
 	bool createTextureSampler();
@@ -93,10 +204,13 @@ public:
 	bool createFrameSyncObject();
 	void destroy();
 
+	//only the swapchain images, attachments & framebuffers on a resize, everything else is size independent
+	//a format change also rebuilds the render pass & pipelines, an image count change every per image resource
 	bool recreateSwapchain();
 	bool updateUniformBuffer();
 	bool updateUniformBufferMatrix(const uint32_t imageIndex);
 	bool updateUniformBufferLight(const uint32_t imageIndex);
+	bool updateStorageBufferDraw(const uint32_t imageIndex);
 	bool frameResizeCheck(VkResult result, const InFlightFrame& frame);
 	bool drawFrame(const RenderingData& renderingData);
 };
@@ -1,5 +1,5 @@
 #include "VulkanHelper.h"
-#include "MeshNode.h"
+#include "ImageInput.h"
 #include <algorithm>
 #include <iostream>
 
@@ -24,9 +24,23 @@ bool deviceValid(const VkPhysicalDevice device, uint32_t& score) {
 
 //this should be changed according to actual feature demands
 bool deviceFeatureSupport(const VkPhysicalDevice device, uint32_t& score) {
-	VkPhysicalDeviceFeatures features;
-	vkGetPhysicalDeviceFeatures(device, &features);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	//1.2 feature struct is only valid to query on 1.2 devices
+	if (properties.apiVersion < VK_API_VERSION_1_2) {
+		return false;
+	}
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features2);
+	const auto& features = features2.features;
 	//required
+	if (!features12.timelineSemaphore) {
+		return false;
+	}
 	if (features.samplerAnisotropy) {
 		score += static_cast<uint32_t>(PhysicalDeviceScore::SamplerAnisotropy);
 	}
@@ -74,6 +88,30 @@ bool deviceExtensionSupport(const VkPhysicalDevice device, const std::vector<con
 	return true;
 }
 
+std::vector<const char*> filterDeviceExtension(const VkPhysicalDevice device, const std::vector<const char*>& extension, uint32_t optionalOffset) {
+	uint32_t count;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+	std::vector<VkExtensionProperties> properties(count);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &count, properties.data());
+
+	std::vector<const char*> enabled(extension.begin(), extension.begin() + optionalOffset);
+	for (auto i = optionalOffset; i < extension.size(); ++i) {
+		for (const auto& ext : properties) {
+			if (strcmp(extension[i], ext.extensionName) == 0) {
+				enabled.push_back(extension[i]);
+				break;
+			}
+		}
+	}
+	return enabled;
+}
+
+bool hasExtension(const std::vector<const char*>& extension, const char* name) {
+	return std::any_of(extension.begin(), extension.end(), [name](const char* ext) {
+		return strcmp(ext, name) == 0;
+	});
+}
+
 bool querySwapChainSupport(const VkPhysicalDevice device, const VkSurfaceKHR surface, SwapchainSupport* support) {
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &support->capabilities);
 	uint32_t count;
@@ -161,20 +199,49 @@ VkSampleCountFlagBits findUsableMsaaSampleCount(VkPhysicalDevice device, uint32_
 	return static_cast<VkSampleCountFlagBits>(count);
 }
 
-bool createGraphicsPipelineLayoutWithVertexConst(VkDevice device, VkDescriptorSetLayout* layout, uint32_t layoutCount, VkPipelineLayout* pipelineLayout) {
-	VkPushConstantRange vertexConstant;
-	vertexConstant.offset = 0;
-	vertexConstant.size = MeshNode::getConstantSize();
-	vertexConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+VkFormat imageFormat(ImageFormat format, bool srgb) {
+	switch (format) {
+	case ImageFormat::Bc1:
+		return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case ImageFormat::Bc3:
+		return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+	default:
+		return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+VkIndexType indexTypeFromStride(uint32_t stride) {
+	switch (stride) {
+	case 1:
+		return VK_INDEX_TYPE_UINT8_EXT;
+	case 4:
+		return VK_INDEX_TYPE_UINT32;
+	default:
+		return VK_INDEX_TYPE_UINT16;
+	}
+}
+
+uint32_t indexTypeSize(VkIndexType type) {
+	switch (type) {
+	case VK_INDEX_TYPE_UINT8_EXT:
+		return 1;
+	case VK_INDEX_TYPE_UINT32:
+		return 4;
+	default:
+		return 2;
+	}
+}
 
+bool createPipelineLayout(VkDevice device, VkDescriptorSetLayout* layout, uint32_t layoutCount, VkPipelineLayout* pipelineLayout,
+	const VkPushConstantRange* pushConstant, uint32_t pushConstantCount) {
 	VkPipelineLayoutCreateInfo info;
 	info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	info.flags = 0;
 	info.pNext = nullptr;
 	info.setLayoutCount = layoutCount;
 	info.pSetLayouts = layout;
-	info.pushConstantRangeCount = 1;
-	info.pPushConstantRanges = &vertexConstant;
+	info.pushConstantRangeCount = pushConstantCount;
+	info.pPushConstantRanges = pushConstant;
 
 	return vkCreatePipelineLayout(device, &info, nullptr, pipelineLayout) == VK_SUCCESS;
 }
@@ -225,10 +292,6 @@ bool createBuffer(VmaAllocator vmaAllocator, VkDeviceSize size, VkBufferUsageFla
 	return vmaCreateBuffer(vmaAllocator, &info, &allocInfo, &buffer, &allocation, nullptr) == VK_SUCCESS;
 }
 
-bool createStagingBuffer(VmaAllocator vmaAllocator, VkDeviceSize size, VkBuffer& buffer, VmaAllocation& allocation) {
-	return createBuffer(vmaAllocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, buffer, allocation);
-}
-
 bool createImage(VmaAllocator vmaAllocator, const VkImageCreateInfo& info, VkImage& image, VmaAllocation& allocation) {
 	VmaAllocationCreateInfo allocInfo{};
 	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -258,13 +321,17 @@ bool submitCommand(VkCommandBuffer* cmd, uint32_t count, VkQueue queue, VkFence
 	return vkQueueSubmit(queue, 1, &info, fence) == VK_SUCCESS;
 }
 
-void cmdCopyImage(VkCommandBuffer cmd, VkBuffer src, VkImage dst, uint32_t width, uint32_t height, uint32_t mipLevel) {
+void cmdCopyImage(VkCommandBuffer cmd, VkBuffer src, VkDeviceSize srcOffset, VkImage dst, uint32_t width, uint32_t height, uint32_t mipLevel) {
+	cmdCopyImageRows(cmd, src, srcOffset, dst, width, 0, height, mipLevel);
+}
+
+void cmdCopyImageRows(VkCommandBuffer cmd, VkBuffer src, VkDeviceSize srcOffset, VkImage dst, uint32_t width, uint32_t firstRow, uint32_t rowCount, uint32_t mipLevel) {
 	VkBufferImageCopy copy;
-	copy.bufferOffset = 0;
+	copy.bufferOffset = srcOffset;
 	copy.bufferRowLength = 0;
 	copy.bufferImageHeight = 0;
-	copy.imageOffset = { 0, 0, 0 };
-	copy.imageExtent = { width, height, 1 };
+	copy.imageOffset = { 0, static_cast<int32_t>(firstRow), 0 };
+	copy.imageExtent = { width, rowCount, 1 };
 	copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	copy.imageSubresource.mipLevel = mipLevel;
 	copy.imageSubresource.baseArrayLayer = 0;
@@ -272,7 +339,7 @@ void cmdCopyImage(VkCommandBuffer cmd, VkBuffer src, VkImage dst, uint32_t width
 	vkCmdCopyBufferToImage(cmd, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
 }
 
-bool cmdGenerateTextureMipmap(VkCommandBuffer cmd, VkImage image, const ImageOption& option, uint32_t width, uint32_t height) {
+void cmdGenerateTextureMipmap(VkCommandBuffer cmd, VkImage image, const ImageOption& option, uint32_t width, uint32_t height) {
 	VkImageMemoryBarrier barrier;
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.pNext = nullptr;
@@ -343,7 +410,51 @@ bool cmdGenerateTextureMipmap(VkCommandBuffer cmd, VkImage image, const ImageOpt
 		0, nullptr,
 		0, nullptr,
 		1, &barrier);
-	return vkEndCommandBuffer(cmd) == VK_SUCCESS;
+}
+
+void cmdImageOwnership(VkCommandBuffer cmd, VkImage image, const ImageOption& option, VkImageLayout layout, uint32_t srcFamily, uint32_t dstFamily,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+	VkImageMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.oldLayout = layout;
+	barrier.newLayout = layout;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = option.mipLevel;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(cmd,
+		srcStage, dstStage,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
+
+void cmdBufferOwnership(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t srcFamily, uint32_t dstFamily,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+	VkBufferMemoryBarrier barrier;
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.buffer = buffer;
+	barrier.offset = offset;
+	barrier.size = size;
+	vkCmdPipelineBarrier(cmd,
+		srcStage, dstStage,
+		0,
+		0, nullptr,
+		1, &barrier,
+		0, nullptr);
 }
 
 bool cmdTransitionImageLayout(VkCommandBuffer cmd, VkPhysicalDevice physicalDevice, VkImage image, const ImageOption& option, VkImageLayout oldLayout, VkImageLayout newLayout) {
@@ -2,6 +2,8 @@
 #include "VulkanSupportStruct.h"
 #include <vector>
 
+enum class ImageFormat : uint32_t;
+
 enum class PhysicalDeviceScore : uint32_t {
 	//GPU type
 	DiscreteGPU = 300,
@@ -14,12 +16,16 @@ enum class PhysicalDeviceScore : uint32_t {
 	OptionalExtensionAvailable = 20,
 	//queue family
 	QueueFamilyValid = 1000,
+	DedicatedTransferQueue = 20,
 };
 
 //device
 bool deviceValid(const VkPhysicalDevice device, uint32_t& score);
 bool deviceFeatureSupport(const VkPhysicalDevice device, uint32_t& score);
 bool deviceExtensionSupport(const VkPhysicalDevice device, const std::vector<const char*>& extension, uint32_t optionalOffset, uint32_t& score);
+//required extensions + the optional ones the device has
+std::vector<const char*> filterDeviceExtension(const VkPhysicalDevice device, const std::vector<const char*>& extension, uint32_t optionalOffset);
+bool hasExtension(const std::vector<const char*>& extension, const char* name);
 
 //swapchain
 bool querySwapChainSupport(const VkPhysicalDevice device, const VkSurfaceKHR surface, SwapchainSupport* support);
@@ -35,12 +41,19 @@ VkSampleCountFlagBits findUsableMsaaSampleCount(VkPhysicalDevice device, uint32_
 bool createShaderModule(const VkDevice device, const std::vector<char>& code, VkShaderModule* shaderModule);
 bool createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t mipLevel, VkImageView& view);
 
+//vulkan format of a texture format, srgb or unorm by colour space
+VkFormat imageFormat(ImageFormat format, bool srgb);
+
+//index
+VkIndexType indexTypeFromStride(uint32_t stride);
+uint32_t indexTypeSize(VkIndexType type);
+
 //layout
-bool createGraphicsPipelineLayoutWithVertexConst(VkDevice device, VkDescriptorSetLayout* layout, uint32_t layoutCount, VkPipelineLayout* pipelineLayout);
+bool createPipelineLayout(VkDevice device, VkDescriptorSetLayout* layout, uint32_t layoutCount, VkPipelineLayout* pipelineLayout,
+	const VkPushConstantRange* pushConstant = nullptr, uint32_t pushConstantCount = 0);
 
 //memory
 bool createBuffer(VmaAllocator vmaAllocator, VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage allocUsage, VkBuffer& buffer, VmaAllocation& allocation);
-bool createStagingBuffer(VmaAllocator vmaAllocator, VkDeviceSize size, VkBuffer& buffer, VmaAllocation& allocation);
 bool createImage(VmaAllocator vmaAllocator, const VkImageCreateInfo& info, VkImage& image, VmaAllocation& allocation);
 
 //command buffer
@@ -48,6 +61,13 @@ bool beginCommand(VkCommandBuffer& cmd, VkCommandBufferUsageFlags flag);
 bool submitCommand(VkCommandBuffer* cmd, uint32_t count, VkQueue queue, VkFence fence);
 
 //image
-void cmdCopyImage(VkCommandBuffer cmd, VkBuffer src, VkImage dst, uint32_t width, uint32_t height, uint32_t mipLevel);
-bool cmdGenerateTextureMipmap(VkCommandBuffer cmd, VkImage image, const ImageOption& option, uint32_t width, uint32_t height);
+void cmdCopyImage(VkCommandBuffer cmd, VkBuffer src, VkDeviceSize srcOffset, VkImage dst, uint32_t width, uint32_t height, uint32_t mipLevel);
+//copies rowCount tightly packed rows starting at firstRow
+void cmdCopyImageRows(VkCommandBuffer cmd, VkBuffer src, VkDeviceSize srcOffset, VkImage dst, uint32_t width, uint32_t firstRow, uint32_t rowCount, uint32_t mipLevel);
+void cmdGenerateTextureMipmap(VkCommandBuffer cmd, VkImage image, const ImageOption& option, uint32_t width, uint32_t height);
+//queue family ownership transfer, recorded once as release on the source queue and once as acquire on the destination queue
+void cmdImageOwnership(VkCommandBuffer cmd, VkImage image, const ImageOption& option, VkImageLayout layout, uint32_t srcFamily, uint32_t dstFamily,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage);
+void cmdBufferOwnership(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t srcFamily, uint32_t dstFamily,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage);
 bool cmdTransitionImageLayout(VkCommandBuffer cmd, VkPhysicalDevice physicalDevice, VkImage image, const ImageOption& option, VkImageLayout oldLayout, VkImageLayout newLayout);
\ No newline at end of file
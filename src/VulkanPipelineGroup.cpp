@@ -1,30 +1,237 @@
 #pragma once
 #include "VulkanPipelineGroup.h"
 #include "VulkanHelper.h"
+#include "FileHelper.h"
 #include "VulkanSwapchain.h"
 #include "MeshNode.h"
 #include "ShaderInput.h"
+#include "MaterialInput.h"
+#include "ThreadPool.h"
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
 #include <cassert>
 
+namespace {
+	//the driver's own cache header is not trusted alone, some drivers crash on data from another driver version
+	struct PipelineCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vendorId;
+		uint32_t deviceId;
+		uint32_t driverVersion;
+		uint8_t deviceUuid[VK_UUID_SIZE];
+		uint8_t pipelineCacheUuid[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+	constexpr char PipelineCacheMagic[4] = { 'V', 'P', 'P', 'C' };
+	//bump whenever the header changes
+	constexpr uint32_t PipelineCacheVersion = 1;
+
+	//header of the given device, data size & hash left to the caller
+	PipelineCacheHeader deviceHeader(VkPhysicalDevice physicalDevice) {
+		VkPhysicalDeviceIDProperties idProperties{};
+		idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &idProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+		PipelineCacheHeader header{};
+		memcpy(header.magic, PipelineCacheMagic, sizeof(PipelineCacheMagic));
+		header.version = PipelineCacheVersion;
+		header.vendorId = properties.properties.vendorID;
+		header.deviceId = properties.properties.deviceID;
+		header.driverVersion = properties.properties.driverVersion;
+		memcpy(header.deviceUuid, idProperties.deviceUUID, VK_UUID_SIZE);
+		memcpy(header.pipelineCacheUuid, properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+		return header;
+	}
+
+	//cache bytes written for the same device & driver, empty when there is no usable file
+	std::vector<uint8_t> readCacheFile(const std::string& path, const PipelineCacheHeader& expected) {
+		std::ifstream input(path, std::ios::binary);
+		if (!input.is_open()) {
+			return {};
+		}
+		PipelineCacheHeader header;
+		if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			memcmp(&header, &expected, offsetof(PipelineCacheHeader, dataSize)) != 0) {
+			std::cout << "pipeline cache " << path << " is from another device or driver, discarded" << std::endl;
+			return {};
+		}
+		//checked before allocating, a corrupt size must not throw
+		if (header.dataSize != remainingBytes(input)) {
+			std::cout << "pipeline cache " << path << " is corrupt, discarded" << std::endl;
+			return {};
+		}
+		std::vector<uint8_t> data(header.dataSize);
+		if (!input.read(reinterpret_cast<char*>(data.data()), data.size()) || hashBytes(data.data(), data.size()) != header.dataHash) {
+			std::cout << "pipeline cache " << path << " is corrupt, discarded" << std::endl;
+			return {};
+		}
+		return data;
+	}
+
+	float elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+		auto time = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<float, std::chrono::milliseconds::period>(time - start).count();
+	}
+
+	void logCreateTime(const char* kind, std::chrono::high_resolution_clock::time_point start) {
+		std::cout << kind << " pipeline created in " << elapsedMs(start) << "ms" << std::endl;
+	}
+
+	//a VkBool32 per texture slot, constant_id n is slot n
+	constexpr uint32_t SpecializationCount = static_cast<uint32_t>(TextureSlot::Count);
+
+	struct Specialization {
+		VkBool32 hasTexture[SpecializationCount];
+		VkSpecializationMapEntry entry[SpecializationCount];
+		VkSpecializationInfo info;
+
+		explicit Specialization(uint32_t textureMask) {
+			for (uint32_t n = 0; n < SpecializationCount; ++n) {
+				hasTexture[n] = (textureMask >> n) & 1u ? VK_TRUE : VK_FALSE;
+				entry[n].constantID = n;
+				entry[n].offset = n * sizeof(VkBool32);
+				entry[n].size = sizeof(VkBool32);
+			}
+			info.mapEntryCount = SpecializationCount;
+			info.pMapEntries = entry;
+			info.dataSize = sizeof(hasTexture);
+			info.pData = hasTexture;
+		}
+		Specialization(const Specialization&) = delete;
+	};
+}
+
 void VulkanPipelineGroup::setDevice(VkDevice value) {
 	device = value;
 }
 
-VkPipeline VulkanPipelineGroup::getGraphicsPipeline() const {
-	return graphicsPipeline;
+bool VulkanPipelineGroup::createPipelineCache(VkPhysicalDevice physical, const std::string& path) {
+	physicalDevice = physical;
+	cachePath = path;
+	std::vector<uint8_t> data;
+	if (!cachePath.empty()) {
+		data = readCacheFile(cachePath, deviceHeader(physicalDevice));
+		std::cout << "pipeline cache " << cachePath << (data.empty() ? " empty, cold start" : " loaded, warm start")
+			<< " (" << data.size() << " bytes)" << std::endl;
+	}
+	VkPipelineCacheCreateInfo cacheInfo;
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.flags = 0;
+	cacheInfo.pNext = nullptr;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) == VK_SUCCESS) {
+		return true;
+	}
+	//the driver may still refuse data it wrote itself, start over without it
+	cacheInfo.initialDataSize = 0;
+	cacheInfo.pInitialData = nullptr;
+	return vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) == VK_SUCCESS;
+}
+
+bool VulkanPipelineGroup::savePipelineCache() const {
+	if (cachePath.empty() || pipelineCache == VK_NULL_HANDLE) {
+		return true;
+	}
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS) {
+		return false;
+	}
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+		return false;
+	}
+	data.resize(size);
+	auto header = deviceHeader(physicalDevice);
+	header.dataSize = data.size();
+	header.dataHash = hashBytes(data.data(), data.size());
+	auto written = writeFileAtomic(cachePath, [&](std::ofstream& output) {
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output.write(reinterpret_cast<const char*>(data.data()), data.size());
+	});
+	if (!written) {
+		return false;
+	}
+	std::cout << "pipeline cache " << cachePath << " saved (" << data.size() << " bytes)" << std::endl;
+	return true;
+}
+
+void VulkanPipelineGroup::destroyPipelineCache() {
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	pipelineCache = VK_NULL_HANDLE;
+}
+
+VkPipeline VulkanPipelineGroup::getGraphicsPipeline(uint32_t variant) const {
+	assert(variant < graphicsPipeline.size());
+	return graphicsPipeline[variant];
+}
+
+uint32_t VulkanPipelineGroup::graphicsPipelineCount() const {
+	return static_cast<uint32_t>(graphicsPipeline.size());
 }
 
-const VkViewport& VulkanPipelineGroup::getViewport() const {
-	return viewport;
+VkPipeline VulkanPipelineGroup::getDepthPipeline() const {
+	return depthPipeline;
 }
 
-bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain) {
+VkPipeline VulkanPipelineGroup::getComputePipeline() const {
+	return computePipeline;
+}
+
+bool VulkanPipelineGroup::createGraphicsPipeline(const std::vector<PipelineVariant>& variant, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain,
+	VertexFormat format, DepthMode mode, uint32_t threadCount) {
+	assert(mode != DepthMode::Prepass);
+	assert(graphicsPipeline.empty());
+	auto count = static_cast<uint32_t>(variant.size());
+	graphicsPipeline.assign(count, VK_NULL_HANDLE);
+	std::vector<uint8_t> created(count, 0);
+	std::vector<float> createTime(count, 0.0f);
+	auto start = std::chrono::high_resolution_clock::now();
+	ThreadPool createThread;
+	auto workerCount = std::min(threadCount, count);
+	createThread.create(workerCount);
+	createThread.run(count, [&](uint32_t, uint32_t task) {
+		auto taskStart = std::chrono::high_resolution_clock::now();
+		Specialization specialization(variant[task].textureMask);
+		created[task] = createPipeline(*variant[task].shader, layout, renderPass, swapchain, format, mode, &specialization.info, graphicsPipeline[task]);
+		createTime[task] = elapsedMs(taskStart);
+	});
+	createThread.destroy();
+	//logged after the join so the lines don't interleave
+	for (uint32_t k = 0; k < count; ++k) {
+		std::cout << "graphics pipeline " << k << " (texture mask 0x" << std::hex << variant[k].textureMask << std::dec << ") "
+			<< (created[k] ? "created in " : "failed after ") << createTime[k] << "ms" << std::endl;
+	}
+	std::cout << count << " graphics pipeline on " << std::max(1u, workerCount) << " thread in " << elapsedMs(start) << "ms" << std::endl;
+	return std::find(created.begin(), created.end(), 0) == created.end();
+}
+
+bool VulkanPipelineGroup::createDepthPipeline(const ShaderInput& shader, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain, VertexFormat format) {
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!createPipeline(shader, layout, renderPass, swapchain, format, DepthMode::Prepass, nullptr, depthPipeline)) {
+		return false;
+	}
+	logCreateTime("depth", start);
+	return true;
+}
+
+bool VulkanPipelineGroup::createPipeline(const ShaderInput& shader, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain, VertexFormat format,
+	DepthMode mode, const VkSpecializationInfo* specialization, VkPipeline& pipeline) {
+	auto depthOnly = mode == DepthMode::Prepass;
 	VkShaderModule vertShader;
 	createShaderModule(device, shader.getVertData(), &vertShader);
-	VkShaderModule fragShader;
-	createShaderModule(device, shader.getFragData(), &fragShader);
+	VkShaderModule fragShader = VK_NULL_HANDLE;
+	if (!depthOnly) {
+		createShaderModule(device, shader.getFragData(), &fragShader);
+	}
 
 	VkPipelineShaderStageCreateInfo vertStage;
 	vertStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -41,18 +248,19 @@ bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPi
 	fragStage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 	fragStage.module = fragShader;
 	fragStage.pName = "main";
-	fragStage.pSpecializationInfo = nullptr;
+	fragStage.pSpecializationInfo = specialization;
 	VkPipelineShaderStageCreateInfo shaderStageInfo[] = { vertStage, fragStage };
 
-	auto vertexBinding = MeshNode::getBindingDescription();
-	auto vertexAttribute = MeshNode::getAttributeDescription();
+	//the prepass only fetches the position stream
+	auto vertexBinding = MeshNode::getBindingDescription(format, depthOnly);
+	auto vertexAttribute = MeshNode::getAttributeDescription(format, depthOnly);
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo;
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputInfo.flags = 0;
 	vertexInputInfo.pNext = nullptr;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &vertexBinding;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexBinding.size());
+	vertexInputInfo.pVertexBindingDescriptions = vertexBinding.data();
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttribute.size());
 	vertexInputInfo.pVertexAttributeDescriptions = vertexAttribute.data();
 
@@ -63,35 +271,24 @@ bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPi
 	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	auto& extent = swapchain.getExtent();
-
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(extent.width);
-	viewport.height = static_cast<float>(extent.height);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor;
-	scissor.offset = { 0, 0 };
-	scissor.extent = extent;
-
+	//both set when recording, from the current swapchain extent
 	VkPipelineViewportStateCreateInfo viewportStateInfo;
 	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportStateInfo.flags = 0;
 	viewportStateInfo.pNext = nullptr;
 	viewportStateInfo.viewportCount = 1;
-	viewportStateInfo.pViewports = &viewport;
+	viewportStateInfo.pViewports = nullptr;
 	viewportStateInfo.scissorCount = 1;
-	viewportStateInfo.pScissors = &scissor;
+	viewportStateInfo.pScissors = nullptr;
 
 	VkPipelineDepthStencilStateCreateInfo depthStencil;
 	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencil.flags = 0;
 	depthStencil.pNext = nullptr;
 	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	//after the prepass the depth buffer already holds the nearest surface, equal keeps exactly one fragment per sample
+	depthStencil.depthWriteEnable = mode == DepthMode::Equal ? VK_FALSE : VK_TRUE;
+	depthStencil.depthCompareOp = mode == DepthMode::Equal ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.minDepthBounds = 0.0f;
 	depthStencil.maxDepthBounds = 1.0f;
@@ -141,7 +338,7 @@ bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPi
 	colorBlendStateInfo.pNext = nullptr;
 	colorBlendStateInfo.logicOpEnable = VK_FALSE;
 	colorBlendStateInfo.logicOp = VK_LOGIC_OP_COPY;
-	colorBlendStateInfo.attachmentCount = 1;
+	colorBlendStateInfo.attachmentCount = depthOnly ? 0 : 1;
 	colorBlendStateInfo.pAttachments = &colorBlendAttachment;
 	colorBlendStateInfo.blendConstants[0] = 0.0f;
 	colorBlendStateInfo.blendConstants[1] = 0.0f;
@@ -150,6 +347,7 @@ bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPi
 
 	std::vector<VkDynamicState> dynamicState{
 		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
 	};
 	VkPipelineDynamicStateCreateInfo dynamicStateInfo;
 	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
@@ -162,7 +360,7 @@ bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPi
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineInfo.flags = 0;
 	pipelineInfo.pNext = nullptr;
-	pipelineInfo.stageCount = 2;
+	pipelineInfo.stageCount = depthOnly ? 1 : 2;
 	pipelineInfo.pStages = shaderStageInfo;
 	pipelineInfo.pVertexInputState = &vertexInputInfo;
 	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
@@ -175,25 +373,69 @@ bool VulkanPipelineGroup::createGraphicsPipeline(const ShaderInput& shader, VkPi
 	pipelineInfo.pDynamicState = &dynamicStateInfo;
 	pipelineInfo.layout = layout;
 	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0;
+	pipelineInfo.subpass = mode == DepthMode::Equal ? 1 : 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(
+	auto result = vkCreateGraphicsPipelines(
 		device,
-		VK_NULL_HANDLE,
+		pipelineCache,
 		1,
 		&pipelineInfo,
 		nullptr,
-		&graphicsPipeline) != VK_SUCCESS) {
+		&pipeline);
+	vkDestroyShaderModule(device, vertShader, nullptr);
+	vkDestroyShaderModule(device, fragShader, nullptr);
+	return result == VK_SUCCESS;
+}
+
+bool VulkanPipelineGroup::createComputePipeline(const ShaderInput& shader, VkPipelineLayout layout) {
+	VkShaderModule compShader;
+	if (!createShaderModule(device, shader.getCompData(), &compShader)) {
 		return false;
 	}
 
-	vkDestroyShaderModule(device, vertShader, nullptr);
-	vkDestroyShaderModule(device, fragShader, nullptr);
+	VkPipelineShaderStageCreateInfo compStage;
+	compStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compStage.flags = 0;
+	compStage.pNext = nullptr;
+	compStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compStage.module = compShader;
+	compStage.pName = "main";
+	compStage.pSpecializationInfo = nullptr;
+
+	VkComputePipelineCreateInfo pipelineInfo;
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.flags = 0;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.stage = compStage;
+	pipelineInfo.layout = layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &computePipeline);
+	vkDestroyShaderModule(device, compShader, nullptr);
+	if (result != VK_SUCCESS) {
+		return false;
+	}
+	logCreateTime("compute", start);
 	return true;
 }
 
+void VulkanPipelineGroup::destroyGraphicsPipeline() {
+	for (auto pipeline : graphicsPipeline) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+	vkDestroyPipeline(device, depthPipeline, nullptr);
+	graphicsPipeline.clear();
+	depthPipeline = VK_NULL_HANDLE;
+}
+
+void VulkanPipelineGroup::destroyComputePipeline() {
+	vkDestroyPipeline(device, computePipeline, nullptr);
+	computePipeline = VK_NULL_HANDLE;
+}
 
 bool VulkanPipelineGroup::createDerivedPipeline() {
 	//TODO
@@ -1,21 +1,66 @@
 #pragma once
 #include "VulkanSupportStruct.h"
+#include "MeshStruct.h"
 #include "vk_mem_alloc.h"
+#include <string>
+#include <vector>
 
 class VulkanSwapchain;
 class ShaderInput;
 
+//how a graphics pipeline uses the depth buffer
+enum class DepthMode : uint8_t {
+	Write,//tested & written, the only subpass
+	Prepass,//position only, no fragment stage, subpass 0 of the depth prepass render pass
+	Equal,//colour after the prepass, subpass 1, only the fragment that won the prepass passes, no depth write
+};
+
+//one graphics pipeline per distinct shader & material texture set
+struct PipelineVariant {
+	const ShaderInput* shader;
+	uint32_t textureMask;//MaterialPrototype::textureMask, bit n feeds the fragment shader's constant_id n
+};
+
 class VulkanPipelineGroup {
 private:
 	//value copy from VulkanEnv
 	VkDevice device;
 
-	VkPipeline graphicsPipeline;
-	VkViewport viewport;
+	//indexed like the variant list they were created from
+	std::vector<VkPipeline> graphicsPipeline;
+	VkPipeline depthPipeline = VK_NULL_HANDLE;
+	VkPipeline computePipeline = VK_NULL_HANDLE;
+	//every pipeline is created through it, outlives swapchain recreation
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	std::string cachePath;
+	//thread safe, the cache synchronizes itself
+	bool createPipeline(const ShaderInput& shader, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain, VertexFormat format,
+		DepthMode mode, const VkSpecializationInfo* specialization, VkPipeline& pipeline);
 public:
 	void setDevice(VkDevice value);
-	VkPipeline getGraphicsPipeline() const;
-	const VkViewport& getViewport() const;
-	bool createGraphicsPipeline(const ShaderInput& shader, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain);
+	//seeded from the file at path when its header matches the device & driver, empty otherwise
+	//an empty path keeps the cache in memory only
+	bool createPipelineCache(VkPhysicalDevice physical, const std::string& path);
+	//written aside & renamed, the cache is kept for the next run
+	bool savePipelineCache() const;
+	void destroyPipelineCache();
+	VkPipeline getGraphicsPipeline(uint32_t variant) const;
+	uint32_t graphicsPipelineCount() const;
+	VkPipeline getDepthPipeline() const;
+	VkPipeline getComputePipeline() const;
+	//vertex input follows format, the vertex shader has to read the same layout
+	//viewport & scissor are dynamic, the pipelines don't depend on the swapchain size
+	//mode is Write, or Equal when the render pass has the depth prepass
+	//one pipeline per variant, created on threadCount threads (0 creates them on the calling thread)
+	bool createGraphicsPipeline(const std::vector<PipelineVariant>& variant, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain,
+		VertexFormat format, DepthMode mode, uint32_t threadCount);
+	//vertex only shader reading the position stream alone, same pipeline layout as the graphics pipeline
+	bool createDepthPipeline(const ShaderInput& shader, VkPipelineLayout layout, VkRenderPass renderPass, const VulkanSwapchain& swapchain, VertexFormat format);
+	//graphics & depth pipeline
+	void destroyGraphicsPipeline();
+	//not tied to the swapchain, lives until destroyComputePipeline
+	bool createComputePipeline(const ShaderInput& shader, VkPipelineLayout layout);
+	void destroyComputePipeline();
 	bool createDerivedPipeline();
 };
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "VulkanStagingRing.h"
+
+VkDeviceSize VulkanStagingRing::align(VkDeviceSize size) {
+	return (size + Alignment - 1) & ~(Alignment - 1);
+}
+
+void VulkanStagingRing::setAllocator(VmaAllocator allocator) noexcept {
+	vmaAllocator = allocator;
+}
+
+bool VulkanStagingRing::create(VkDeviceSize size) {
+	VkBufferCreateInfo info;
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.flags = 0;
+	info.pNext = nullptr;
+	info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	info.size = size;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	info.queueFamilyIndexCount = 0;
+	info.pQueueFamilyIndices = nullptr;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	VmaAllocationInfo allocResult;
+	if (vmaCreateBuffer(vmaAllocator, &info, &allocInfo, &buffer.buffer, &buffer.allocation, &allocResult) != VK_SUCCESS) {
+		return false;
+	}
+	mapped = static_cast<uint8_t*>(allocResult.pMappedData);
+	capacity = size;
+	head = 0;
+	tail = 0;
+	used = 0;
+	unfenced = 0;
+	stat = {};
+	stat.capacity = size;
+	return mapped != nullptr;
+}
+
+bool VulkanStagingRing::allocate(VkDeviceSize size, VkDeviceSize& offset) {
+	size = align(size);
+	if (size > capacity - used) {
+		return false;
+	}
+	if (head >= tail) {
+		//free space is [head, capacity) + [0, tail)
+		if (capacity - head >= size) {
+			offset = head;
+		}
+		else if (tail >= size) {
+			//the end is wasted, it is reclaimed with the allocation that wraps
+			auto waste = capacity - head;
+			used += waste;
+			unfenced += waste;
+			offset = 0;
+			++stat.wrapCount;
+		}
+		else {
+			return false;
+		}
+	}
+	else if (tail - head >= size) {
+		offset = head;
+	}
+	else {
+		return false;
+	}
+	head = offset + size;
+	used += size;
+	unfenced += size;
+	++stat.allocationCount;
+	if (used > stat.highWater) {
+		stat.highWater = used;
+	}
+	return true;
+}
+
+void VulkanStagingRing::fence(uint64_t value) {
+	if (unfenced == 0) {
+		return;
+	}
+	region.push_back({ head, unfenced, value });
+	unfenced = 0;
+}
+
+void VulkanStagingRing::retire(uint64_t completedValue) {
+	while (!region.empty() && region.front().value <= completedValue) {
+		tail = region.front().end;
+		used -= region.front().size;
+		region.pop_front();
+	}
+	if (used == 0) {
+		//restart from the beginning to keep free space contiguous
+		head = 0;
+		tail = 0;
+	}
+}
+
+bool VulkanStagingRing::hasFenced() const {
+	return !region.empty();
+}
+
+uint64_t VulkanStagingRing::oldestValue() const {
+	return region.empty() ? 0 : region.front().value;
+}
+
+void VulkanStagingRing::countStall() {
+	++stat.stallCount;
+}
+
+VkBuffer VulkanStagingRing::getBuffer() const {
+	return buffer.buffer;
+}
+
+uint8_t* VulkanStagingRing::data(VkDeviceSize offset) const {
+	return mapped + offset;
+}
+
+VkDeviceSize VulkanStagingRing::chunkSize() const {
+	return capacity / 2;
+}
+
+const StagingRingStat& VulkanStagingRing::getStat() const {
+	return stat;
+}
+
+void VulkanStagingRing::destroy() {
+	if (buffer.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+	vmaDestroyBuffer(vmaAllocator, buffer.buffer, buffer.allocation);
+	buffer = {};
+	mapped = nullptr;
+	region.clear();
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "VulkanSupportStruct.h"
+#include "vk_mem_alloc.h"
+#include <deque>
+
+struct StagingRingStat {
+	VkDeviceSize capacity;
+	VkDeviceSize highWater;
+	uint32_t allocationCount;
+	uint32_t wrapCount;
+	uint32_t stallCount;
+};
+
+//persistently mapped staging memory, allocated linearly & wrapped around.
+//allocations made between two fence() calls are reclaimed together once the fence value completes
+class VulkanStagingRing {
+private:
+	struct Region {
+		VkDeviceSize end;
+		VkDeviceSize size;
+		uint64_t value;
+	};
+private:
+	//value copy from VulkanEnv
+	VmaAllocator vmaAllocator;
+
+	Buffer buffer{};
+	uint8_t* mapped = nullptr;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize head = 0;
+	VkDeviceSize tail = 0;
+	VkDeviceSize used = 0;
+	VkDeviceSize unfenced = 0;
+	std::deque<Region> region;
+	StagingRingStat stat{};
+public:
+	static constexpr VkDeviceSize Alignment = 16;
+	static VkDeviceSize align(VkDeviceSize size);
+
+	void setAllocator(VmaAllocator allocator) noexcept;
+	bool create(VkDeviceSize size);
+	bool allocate(VkDeviceSize size, VkDeviceSize& offset);
+	//tags all allocations since the last fence with the value they complete at
+	void fence(uint64_t value);
+	void retire(uint64_t completedValue);
+	bool hasFenced() const;
+	uint64_t oldestValue() const;
+	void countStall();
+	VkBuffer getBuffer() const;
+	uint8_t* data(VkDeviceSize offset) const;
+	//largest single allocation, keeps the ring able to hold at least two batches
+	VkDeviceSize chunkSize() const;
+	const StagingRingStat& getStat() const;
+	void destroy();
+};
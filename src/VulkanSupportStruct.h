@@ -6,11 +6,13 @@
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
 #include "vk_mem_alloc.h"
+#include "glm.hpp"
 #include <vector>
 
 struct QueueFamily {
 	uint32_t graphics;
 	uint32_t present;
+	uint32_t transfer;//same as graphics when no dedicated family exists
 };
 
 struct SwapchainSupport {
@@ -29,7 +31,15 @@ struct InFlightFrame {
 	VkSemaphore semaphoreRenderFinished;
 	VkFence fenceImageAcquired;
 	VkFence fenceInFlight;
-	VkDescriptorPool descriptorPool;
+};
+
+struct DescriptorCache {
+	VkDescriptorPool pool;
+	VkDescriptorSet uniformSet;
+	std::vector<VkDescriptorSet> materialSet;//indexed by material
+	VkDescriptorSet cullSet;
+	uint32_t uniformVersion;
+	uint32_t materialVersion;
 };
 
 struct Buffer {
@@ -40,6 +50,9 @@ struct Buffer {
 struct DrawInfo {
 	int setIndex;
 	const void* constantData;
+	//undoes the position quantization of the packed vertex format, 0 & 1 for float
+	glm::vec4 positionOffset;
+	glm::vec4 positionScale;
 };
 
 struct DepthBuffer {
@@ -61,13 +74,45 @@ struct VertexBuffer {
 	std::vector<VkDeviceSize> offset;
 };
 
+//geometry is stored once per unique view, draws are its instances
 struct IndexBuffer {
 	VkBuffer buffer;
 	VmaAllocation allocation;
+	//per draw, sorted by geometry so instances of one geometry are adjacent
 	std::vector<DrawInfo> drawInfo;
+	std::vector<uint32_t> geometry;
+	//per draw in render list order -> position in drawInfo
+	std::vector<uint32_t> drawSlot;
+	//per geometry
 	std::vector<VkDeviceSize> offset;
 	std::vector<uint32_t> vOffset;
-	std::vector<uint32_t> iCount;
+	std::vector<VkIndexType> indexType;
+	std::vector<uint32_t> lodBase;//first entry of the geometry in the per lod lists
+	std::vector<uint32_t> lodCount;
+	//per lod of every geometry, lod 0 is the full mesh
+	std::vector<uint32_t> lodFirstIndex;//from the geometry offset
+	std::vector<uint32_t> lodIndexCount;
+};
+
+//adjacent draws of one geometry & lod, recorded as a single instanced draw
+struct DrawRun {
+	uint32_t firstDraw;
+	uint32_t instanceCount;
+	uint32_t lod;
+};
+
+//consecutive indirect commands sharing one material set
+struct DrawBucket {
+	int setIndex;
+	VkIndexType indexType;
+	uint32_t firstCommand;
+	uint32_t commandCount;
+};
+
+struct IndirectBuffer {
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	std::vector<DrawBucket> bucket;
 };
 
 struct ImageOption {
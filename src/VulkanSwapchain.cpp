@@ -25,14 +25,6 @@ void VulkanSwapchain::setAllocator(VmaAllocator allocator) noexcept {
 	vmaAllocator = allocator;
 }
 
-void VulkanSwapchain::setGraphicsPipeline(VkPipeline pipeline) noexcept {
-	graphicsPipeline = pipeline;
-}
-
-void VulkanSwapchain::setGraphicsPipelineLayout(VkPipelineLayout layout) noexcept {
-	graphicsPipelineLayout = layout;
-}
-
 void VulkanSwapchain::setRenderPass(VkRenderPass renderPassIn) noexcept {
 	renderPass = renderPassIn;
 }
@@ -241,20 +233,6 @@ bool VulkanSwapchain::createMsaaColorBuffer() {
 	return true;
 }
 
-void VulkanSwapchain::reserveForBufferCreate(int count) {
-	bufferList.reserve(bufferList.size() + count);
-}
-
-bool VulkanSwapchain::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage allocUsage, const Buffer*& buffer) {
-	Buffer created;
-	if (!::createBuffer(vmaAllocator, size, usage, allocUsage, created.buffer, created.allocation)) {
-		return false;
-	}
-	bufferList.push_back(std::move(created));
-	buffer = &bufferList.back();
-	return true;
-}
-
 void VulkanSwapchain::waitForValidSize() {
 	int width, height;
 	glfwGetFramebufferSize(window, &width, &height);
@@ -265,10 +243,7 @@ void VulkanSwapchain::waitForValidSize() {
 }
 
 void VulkanSwapchain::reset() {
-	bufferList.clear();
-	graphicsPipelineLayout = VK_NULL_HANDLE;
-	graphicsPipeline = VK_NULL_HANDLE;
-	renderPass = VK_NULL_HANDLE;
+	//render pass is kept, the next framebuffers use it again
 	swapchain = VK_NULL_HANDLE;
 }
 
@@ -287,12 +262,6 @@ void VulkanSwapchain::destroy() {
 	for (auto i = 0; i < imageView.size(); ++i) {
 		vkDestroyImageView(device, imageView[i], nullptr);
 	}
-	vkDestroyPipelineLayout(device, graphicsPipelineLayout, nullptr);
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyRenderPass(device, renderPass, nullptr);
-	for (const auto& buffer : bufferList) {
-		vmaDestroyBuffer(vmaAllocator, buffer.buffer, buffer.allocation);
-	}
 	vkDestroySwapchainKHR(device, swapchain, nullptr);
 	reset();
 }
\ No newline at end of file
@@ -9,10 +9,8 @@ private:
 	VkPhysicalDevice physicalDevice;
 	VkDevice device;
 	VmaAllocator vmaAllocator;
-	//owned resources, but create externally
-	VkPipelineLayout graphicsPipelineLayout;
-	VkPipeline graphicsPipeline;
-	VkRenderPass renderPass;
+	//value copy from VulkanEnv, framebuffers are created against it
+	VkRenderPass renderPass = VK_NULL_HANDLE;
 
 	GLFWwindow* window;
 	VkSurfaceKHR surface;
@@ -24,7 +22,6 @@ private:
 	std::vector<VkFramebuffer> framebuffer;
 	DepthBuffer depthBuffer;
 	MsaaColorBuffer msaaColorBuffer;
-	std::vector<Buffer> bufferList;
 
 	SwapchainSupport support;
 	uint32_t maxFrameInFlight;
@@ -39,8 +36,6 @@ public:
 	void setInstance(VkInstance instance) noexcept;
 	void setDevice(VkDevice device) noexcept;
 	void setAllocator(VmaAllocator allocator) noexcept;
-	void setGraphicsPipeline(VkPipeline pipeline) noexcept;
-	void setGraphicsPipelineLayout(VkPipelineLayout layout) noexcept;
 	void setRenderPass(VkRenderPass renderPassIn) noexcept;
 	void setPreferedPresentMode(const VkPresentModeKHR mode) noexcept;
 	void setMsaaSample(const uint32_t count) noexcept;
@@ -60,9 +55,8 @@ public:
 	bool createFramebuffer();
 	bool createDepthBuffer();
 	bool createMsaaColorBuffer();
-	void reserveForBufferCreate(int count);
-	bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VmaMemoryUsage allocUsage, const Buffer*& buffer);
 	void waitForValidSize();
+	//only the size dependent resources, the render pass belongs to VulkanEnv
 	void destroy();
 	void reset();
 
@@ -0,0 +1,376 @@
+#include "VulkanUploader.h"
+#include "VulkanHelper.h"
+#include "ImageInput.h"
+#include <iostream>
+#include <algorithm>
+
+void VulkanUploader::setPhysicalDevice(VkPhysicalDevice value) noexcept {
+	physicalDevice = value;
+}
+
+void VulkanUploader::setDevice(VkDevice value, VmaAllocator allocator) noexcept {
+	device = value;
+	vmaAllocator = allocator;
+	ring.setAllocator(allocator);
+}
+
+void VulkanUploader::setQueue(VkQueue transfer, uint32_t transferFamilyIndex, VkQueue graphics, uint32_t graphicsFamilyIndex) noexcept {
+	transferQueue = transfer;
+	transferFamily = transferFamilyIndex;
+	graphicsQueue = graphics;
+	graphicsFamily = graphicsFamilyIndex;
+}
+
+bool VulkanUploader::ownershipTransfer() const {
+	return transferFamily != graphicsFamily;
+}
+
+bool VulkanUploader::create(VkDeviceSize stagingRingSize) {
+	if (!ring.create(stagingRingSize)) {
+		return false;
+	}
+	VkCommandPoolCreateInfo poolInfo;
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.pNext = nullptr;
+	poolInfo.queueFamilyIndex = transferFamily;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferPool) != VK_SUCCESS) {
+		return false;
+	}
+	poolInfo.queueFamilyIndex = graphicsFamily;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &graphicsPool) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkSemaphoreTypeCreateInfo typeInfo;
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.pNext = nullptr;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+	VkSemaphoreCreateInfo semaphoreInfo;
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.flags = 0;
+	semaphoreInfo.pNext = &typeInfo;
+	return vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) == VK_SUCCESS;
+}
+
+bool VulkanUploader::begin() {
+	if (recording) {
+		std::cout << "upload batch already begun" << std::endl;
+		return false;
+	}
+	current = {};
+	current.start = std::chrono::high_resolution_clock::now();
+	batchStat = {};
+	ownedBuffer.clear();
+	recording = true;
+
+	VkCommandBufferAllocateInfo cmdInfo;
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cmdInfo.pNext = nullptr;
+	cmdInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	cmdInfo.commandBufferCount = 1;
+	cmdInfo.commandPool = transferPool;
+	if (vkAllocateCommandBuffers(device, &cmdInfo, &current.transferCmd) != VK_SUCCESS) {
+		return false;
+	}
+	cmdInfo.commandPool = graphicsPool;
+	if (vkAllocateCommandBuffers(device, &cmdInfo, &current.graphicsCmd) != VK_SUCCESS) {
+		return false;
+	}
+	return beginCommand(current.transferCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) &&
+		beginCommand(current.graphicsCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+}
+
+bool VulkanUploader::allocateStaging(VkDeviceSize size, VkDeviceSize& offset) {
+	if (VulkanStagingRing::align(size) > ring.chunkSize()) {
+		std::cout << "staging allocation larger than ring chunk: " << size << "/" << ring.chunkSize() << std::endl;
+		return false;
+	}
+	while (!ring.allocate(size, offset)) {
+		if (!ring.hasFenced()) {
+			//the rest of the ring belongs to the batch being recorded, send it off & continue in a new one
+			if (!submit() || !begin()) {
+				return false;
+			}
+			continue;
+		}
+		ring.countStall();
+		if (!waitValue(ring.oldestValue())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool VulkanUploader::stageImage(const ImageInput& texture, VkImage image, const ImageOption& option, VkImageLayout initialLayout) {
+	VkDeviceSize size = texture.getByteSize();
+	auto width = static_cast<uint32_t>(texture.getWidth());
+	auto height = static_cast<uint32_t>(texture.getHeight());
+	//baked textures carry every level, the others only level 0 & get the rest blitted
+	std::vector<ImageLevel> level = texture.isBaked() ? texture.getLevel() : std::vector<ImageLevel>{ { 0, static_cast<uint32_t>(size), width, height } };
+	//a row is a row of 4x4 blocks for compressed formats
+	auto block = blockSize(texture.getFormat());
+	auto rowHeight = block > 0 ? 4u : 1u;
+	const auto* pixel = texture.pixel();
+	cmdTransitionImageLayout(current.transferCmd, physicalDevice, image, option, initialLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	for (uint32_t mip = 0; mip < level.size(); ++mip) {
+		const auto& levelInfo = level[mip];
+		VkDeviceSize rowPitch = block > 0 ? (levelInfo.width + 3) / 4 * block : levelInfo.width * 4;
+		auto rowTotal = (levelInfo.height + rowHeight - 1) / rowHeight;
+		auto bandRow = static_cast<uint32_t>(std::max<VkDeviceSize>(1, ring.chunkSize() / rowPitch));
+		//copied in bands of rows when larger than a ring chunk, the image stays on the transfer queue until the last band
+		for (uint32_t row = 0; row < rowTotal; row += bandRow) {
+			auto rowCount = std::min(bandRow, rowTotal - row);
+			VkDeviceSize offset;
+			if (!allocateStaging(rowCount * rowPitch, offset)) {
+				return false;
+			}
+			memcpy(ring.data(offset), pixel + levelInfo.offset + row * rowPitch, rowCount * rowPitch);
+			auto firstTexel = row * rowHeight;
+			cmdCopyImageRows(current.transferCmd, ring.getBuffer(), offset, image, levelInfo.width, firstTexel,
+				std::min(rowCount * rowHeight, levelInfo.height - firstTexel), mip);
+		}
+	}
+
+	auto transferCmd = current.transferCmd;
+	auto graphicsCmd = current.graphicsCmd;
+	if (ownershipTransfer()) {
+		//release on transfer queue, matching acquire on graphics queue, layout is kept
+		cmdImageOwnership(transferCmd, image, option, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, transferFamily, graphicsFamily,
+			VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		cmdImageOwnership(graphicsCmd, image, option, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, transferFamily, graphicsFamily,
+			0, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+	//blit requires a graphics capable queue
+	if (texture.shouldGenerateMipmap()) {
+		cmdGenerateTextureMipmap(graphicsCmd, image, option, width, height);
+	}
+	else {
+		cmdTransitionImageLayout(graphicsCmd, physicalDevice, image, option, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	batchStat.byteSize += size;
+	++batchStat.imageCount;
+	return true;
+}
+
+bool VulkanUploader::stageBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+	const auto* src = static_cast<const uint8_t*>(data);
+	VkDeviceSize copied = 0;
+	while (copied < size) {
+		auto chunk = std::min(size - copied, ring.chunkSize());
+		VkDeviceSize offset;
+		if (!allocateStaging(chunk, offset)) {
+			return false;
+		}
+		memcpy(ring.data(offset), src + copied, chunk);
+
+		VkBufferCopy copy;
+		copy.srcOffset = offset;
+		copy.dstOffset = dstOffset + copied;
+		copy.size = chunk;
+		vkCmdCopyBuffer(current.transferCmd, ring.getBuffer(), dst, 1, &copy);
+		auto owned = std::find_if(ownedBuffer.rbegin(), ownedBuffer.rend(), [&](const OwnedBuffer& range) {
+			return range.buffer == dst && range.offset + range.size == copy.dstOffset;
+		});
+		if (owned != ownedBuffer.rend()) {
+			owned->size += chunk;
+			owned->dstAccess |= dstAccess;
+			owned->dstStage |= dstStage;
+		}
+		else {
+			ownedBuffer.push_back({ dst, copy.dstOffset, chunk, dstAccess, dstStage });
+		}
+		copied += chunk;
+	}
+	batchStat.byteSize += size;
+	++batchStat.bufferCount;
+	return true;
+}
+
+bool VulkanUploader::submit() {
+	if (!recording) {
+		return true;
+	}
+	recording = false;
+	if (ownershipTransfer()) {
+		for (const auto& owned : ownedBuffer) {
+			cmdBufferOwnership(current.transferCmd, owned.buffer, owned.offset, owned.size, transferFamily, graphicsFamily,
+				VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			cmdBufferOwnership(current.graphicsCmd, owned.buffer, owned.offset, owned.size, transferFamily, graphicsFamily,
+				0, owned.dstAccess,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, owned.dstStage);
+		}
+	}
+	ownedBuffer.clear();
+	if (vkEndCommandBuffer(current.transferCmd) != VK_SUCCESS ||
+		vkEndCommandBuffer(current.graphicsCmd) != VK_SUCCESS) {
+		releaseBatch(current);
+		return false;
+	}
+
+	//transfer queue signals copy done, graphics queue waits for it then signals the batch complete
+	auto copyValue = timelineValue + 1;
+	auto completeValue = timelineValue + 2;
+	VkTimelineSemaphoreSubmitInfo transferTimeline;
+	transferTimeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	transferTimeline.pNext = nullptr;
+	transferTimeline.waitSemaphoreValueCount = 0;
+	transferTimeline.pWaitSemaphoreValues = nullptr;
+	transferTimeline.signalSemaphoreValueCount = 1;
+	transferTimeline.pSignalSemaphoreValues = &copyValue;
+	VkSubmitInfo transferSubmit;
+	transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	transferSubmit.pNext = &transferTimeline;
+	transferSubmit.commandBufferCount = 1;
+	transferSubmit.pCommandBuffers = &current.transferCmd;
+	transferSubmit.waitSemaphoreCount = 0;
+	transferSubmit.pWaitSemaphores = nullptr;
+	transferSubmit.pWaitDstStageMask = nullptr;
+	transferSubmit.signalSemaphoreCount = 1;
+	transferSubmit.pSignalSemaphores = &timeline;
+
+	VkTimelineSemaphoreSubmitInfo graphicsTimeline;
+	graphicsTimeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	graphicsTimeline.pNext = nullptr;
+	graphicsTimeline.waitSemaphoreValueCount = 1;
+	graphicsTimeline.pWaitSemaphoreValues = &copyValue;
+	graphicsTimeline.signalSemaphoreValueCount = 1;
+	graphicsTimeline.pSignalSemaphoreValues = &completeValue;
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkSubmitInfo graphicsSubmit;
+	graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	graphicsSubmit.pNext = &graphicsTimeline;
+	graphicsSubmit.commandBufferCount = 1;
+	graphicsSubmit.pCommandBuffers = &current.graphicsCmd;
+	graphicsSubmit.waitSemaphoreCount = 1;
+	graphicsSubmit.pWaitSemaphores = &timeline;
+	graphicsSubmit.pWaitDstStageMask = &waitStage;
+	graphicsSubmit.signalSemaphoreCount = 1;
+	graphicsSubmit.pSignalSemaphores = &timeline;
+
+	if (vkQueueSubmit(transferQueue, 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS ||
+		vkQueueSubmit(graphicsQueue, 1, &graphicsSubmit, VK_NULL_HANDLE) != VK_SUCCESS) {
+		releaseBatch(current);
+		return false;
+	}
+	timelineValue = completeValue;
+	//staging memory of the batch is reused once the graphics side completes
+	ring.fence(completeValue);
+	batchStat.submitCount = 2;
+	current.completeValue = completeValue;
+	current.stat = batchStat;
+	inFlight.push_back(current);
+	current = {};
+	return true;
+}
+
+bool VulkanUploader::wait() {
+	return waitValue(timelineValue);
+}
+
+bool VulkanUploader::waitValue(uint64_t value) {
+	if (value <= completedValue) {
+		return true;
+	}
+	VkSemaphoreWaitInfo info;
+	info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	info.pNext = nullptr;
+	info.flags = 0;
+	info.semaphoreCount = 1;
+	info.pSemaphores = &timeline;
+	info.pValues = &value;
+	if (vkWaitSemaphores(device, &info, UINT64_MAX) != VK_SUCCESS) {
+		return false;
+	}
+	collect();
+	return true;
+}
+
+void VulkanUploader::collect() {
+	if (inFlight.empty()) {
+		return;
+	}
+	if (vkGetSemaphoreCounterValue(device, timeline, &completedValue) != VK_SUCCESS) {
+		return;
+	}
+	auto iter = inFlight.begin();
+	for (; iter != inFlight.end() && iter->completeValue <= completedValue; ++iter) {
+		completeBatch(*iter);
+	}
+	inFlight.erase(inFlight.begin(), iter);
+	ring.retire(completedValue);
+}
+
+void VulkanUploader::completeBatch(Batch& batch) {
+	auto time = std::chrono::high_resolution_clock::now();
+	batch.stat.duration = std::chrono::duration<float, std::chrono::milliseconds::period>(time - batch.start).count();
+	batchStat = batch.stat;
+	totalStat.byteSize += batch.stat.byteSize;
+	totalStat.imageCount += batch.stat.imageCount;
+	totalStat.bufferCount += batch.stat.bufferCount;
+	totalStat.submitCount += batch.stat.submitCount;
+	totalStat.duration += batch.stat.duration;
+	releaseBatch(batch);
+}
+
+void VulkanUploader::releaseBatch(Batch& batch) {
+	if (batch.transferCmd != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(device, transferPool, 1, &batch.transferCmd);
+	}
+	if (batch.graphicsCmd != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(device, graphicsPool, 1, &batch.graphicsCmd);
+	}
+	batch = {};
+}
+
+VkSemaphore VulkanUploader::getTimeline() const {
+	return timeline;
+}
+
+uint64_t VulkanUploader::pendingValue() const {
+	return timelineValue > completedValue ? timelineValue : 0;
+}
+
+const UploadStat& VulkanUploader::getBatchStat() const {
+	return batchStat;
+}
+
+const UploadStat& VulkanUploader::getTotalStat() const {
+	return totalStat;
+}
+
+const StagingRingStat& VulkanUploader::getRingStat() const {
+	return ring.getStat();
+}
+
+void VulkanUploader::destroy() {
+	if (recording) {
+		recording = false;
+		releaseBatch(current);
+	}
+	wait();
+	ring.destroy();
+	vkDestroySemaphore(device, timeline, nullptr);
+	vkDestroyCommandPool(device, transferPool, nullptr);
+	vkDestroyCommandPool(device, graphicsPool, nullptr);
+	timeline = VK_NULL_HANDLE;
+	transferPool = VK_NULL_HANDLE;
+	graphicsPool = VK_NULL_HANDLE;
+}
+
+void logUploadStat(const char* title, const UploadStat& stat) {
+	auto mb = stat.byteSize / (1024.0 * 1024.0);
+	auto rate = stat.duration > 0.0f ? mb * 1000.0 / stat.duration : 0.0;
+	std::cout << title << ": " << stat.imageCount << " image, " << stat.bufferCount << " buffer, "
+		<< mb << "MB, " << stat.submitCount << " submit, "
+		<< stat.duration << "ms, " << rate << "MB/s" << std::endl;
+}
+
+void logStagingRingStat(const StagingRingStat& stat) {
+	std::cout << "staging ring: " << stat.capacity / (1024 * 1024) << "MB, high water " << stat.highWater / (1024.0 * 1024.0) << "MB, "
+		<< stat.allocationCount << " allocation, " << stat.wrapCount << " wrap, " << stat.stallCount << " stall" << std::endl;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "VulkanSupportStruct.h"
+#include "VulkanStagingRing.h"
+#include "vk_mem_alloc.h"
+#include <vector>
+#include <chrono>
+
+class ImageInput;
+
+struct UploadStat {
+	VkDeviceSize byteSize;
+	uint32_t imageCount;
+	uint32_t bufferCount;
+	uint32_t submitCount;
+	float duration;//ms, from begin to upload completion
+};
+
+//packs many uploads into the shared staging ring, copies run on the transfer queue,
+//ownership is handed to the graphics queue which finishes layout transitions & mip generation.
+//completion is tracked with a timeline semaphore, frame submission waits on it instead of the cpu
+class VulkanUploader {
+private:
+	struct Batch {
+		VkCommandBuffer transferCmd;
+		VkCommandBuffer graphicsCmd;
+		uint64_t completeValue;
+		std::chrono::high_resolution_clock::time_point start;
+		UploadStat stat;
+	};
+	struct OwnedBuffer {
+		VkBuffer buffer;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		VkAccessFlags dstAccess;
+		VkPipelineStageFlags dstStage;
+	};
+private:
+	//value copy from VulkanEnv
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	VmaAllocator vmaAllocator;
+	VkQueue transferQueue;
+	VkQueue graphicsQueue;
+	uint32_t transferFamily;
+	uint32_t graphicsFamily;
+
+	VkCommandPool transferPool = VK_NULL_HANDLE;
+	VkCommandPool graphicsPool = VK_NULL_HANDLE;
+	VkSemaphore timeline = VK_NULL_HANDLE;
+	uint64_t timelineValue = 0;
+	uint64_t completedValue = 0;
+	std::vector<Batch> inFlight;
+
+	VulkanStagingRing ring;
+
+	Batch current{};
+	bool recording = false;
+	//buffer ranges written by the current batch, contiguous writes are merged & released once at submit
+	std::vector<OwnedBuffer> ownedBuffer;
+	UploadStat batchStat{};
+	UploadStat totalStat{};
+
+	bool ownershipTransfer() const;
+	//flushes the current batch or waits for the oldest one when the ring is full
+	bool allocateStaging(VkDeviceSize size, VkDeviceSize& offset);
+	bool waitValue(uint64_t value);
+	void releaseBatch(Batch& batch);
+	void completeBatch(Batch& batch);
+public:
+	void setPhysicalDevice(VkPhysicalDevice value) noexcept;
+	void setDevice(VkDevice value, VmaAllocator allocator) noexcept;
+	void setQueue(VkQueue transfer, uint32_t transferFamilyIndex, VkQueue graphics, uint32_t graphicsFamilyIndex) noexcept;
+	bool create(VkDeviceSize stagingRingSize);
+	bool begin();
+	//large uploads are split in chunks, the batch may be submitted & continued in between
+	bool stageImage(const ImageInput& texture, VkImage image, const ImageOption& option, VkImageLayout initialLayout);
+	bool stageBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+	//returns without waiting, completion is signalled on the timeline semaphore
+	bool submit();
+	bool wait();
+	void collect();
+	VkSemaphore getTimeline() const;
+	//value a consumer has to wait for to see every submitted upload, 0 when nothing is pending
+	uint64_t pendingValue() const;
+	const UploadStat& getBatchStat() const;
+	const UploadStat& getTotalStat() const;
+	const StagingRingStat& getRingStat() const;
+	void destroy();
+};
+
+void logUploadStat(const char* title, const UploadStat& stat);
+void logStagingRingStat(const StagingRingStat& stat);